@@ -0,0 +1,249 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Checks that automation events land on their exact frame, keep their
+			 order at the same sample time, wait out a hold, and don't outlive
+			 a clear.
+*/
+
+// Local Includes
+#include "SimpleAudioAutomation.h"
+#include "HostToolsSupport.h"
+
+// System Includes
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#define kTestTimelineFrames 8192
+#define kTestStressEvents 200000
+
+static SimpleAudioDriverAutomationEvent MakeEvent(uint64_t in_sample_time, uint32_t in_value)
+{
+	SimpleAudioDriverAutomationEvent event = {};
+	event.m_sample_time = in_sample_time;
+	event.m_parameter = SimpleAudioDriverAutomationParameter_DataSource;
+	event.m_argument.m_value = in_value;
+	return event;
+}
+
+// Renders the timeline the way the I/O handler does: each block is split
+// into segments that end at the next event, and every frame of a segment
+// gets the value in effect at its start.
+static std::vector<uint32_t> RenderTimeline(SimpleAudioAutomation& io_automation, uint32_t in_block_frames, uint64_t in_num_frames)
+{
+	std::vector<uint32_t> values(in_num_frames, 0);
+	uint32_t value = 0;
+	for (uint64_t block_start = 0; block_start < in_num_frames; block_start += in_block_frames)
+	{
+		io_automation.Collect();
+		auto block_end = std::min<uint64_t>(block_start + in_block_frames, in_num_frames);
+		auto segment_start = block_start;
+		while (segment_start < block_end)
+		{
+			SimpleAudioDriverAutomationEvent event;
+			while (io_automation.PopEvent(segment_start, event))
+			{
+				value = event.m_argument.m_value;
+			}
+			auto next_event_time = io_automation.NextEventTime();
+			auto segment_end = next_event_time < block_end ? next_event_time : block_end;
+			for (auto frame = segment_start; frame < segment_end; frame++)
+			{
+				values[frame] = value;
+			}
+			segment_start = segment_end;
+		}
+	}
+	return values;
+}
+
+// An event changes the value at exactly its sample time, whatever the block
+// size, including events on a block boundary and on the first frame.
+static void CheckExactFrame()
+{
+	const uint64_t event_times[] = { 0, 1, 511, 512, 513, 1000, 1023, 4096, 4097, 8191 };
+	const uint32_t block_sizes[] = { 1, 14, 64, 256, 512, 1024, 4096 };
+	for (auto block_frames : block_sizes)
+	{
+		auto automation = new SimpleAudioAutomation();
+		automation->Initialize();
+		std::vector<SimpleAudioDriverAutomationEvent> events;
+		for (uint32_t i = 0; i < sizeof(event_times) / sizeof(event_times[0]); i++)
+		{
+			events.push_back(MakeEvent(event_times[i], i + 1));
+		}
+		// Schedule them out of order, since the app may.
+		std::swap(events[2], events[7]);
+		HostToolsCheck(automation->Schedule(events.data(), static_cast<uint32_t>(events.size())) == events.size(), "couldn't schedule the events");
+
+		auto values = RenderTimeline(*automation, block_frames, kTestTimelineFrames);
+		uint32_t expected = 0;
+		size_t next_event = 0;
+		for (uint64_t frame = 0; frame < kTestTimelineFrames; frame++)
+		{
+			while (next_event < sizeof(event_times) / sizeof(event_times[0]) && event_times[next_event] == frame)
+			{
+				expected = static_cast<uint32_t>(++next_event);
+			}
+			HostToolsCheck(values[frame] == expected, "%u-frame blocks: frame %llu has %u, expected %u",
+						   block_frames, static_cast<unsigned long long>(frame), values[frame], expected);
+		}
+		delete automation;
+	}
+}
+
+// Events due at the same sample time apply in the order they were scheduled,
+// both within a batch and across batches collected in different blocks.
+static void CheckSameTimeOrder()
+{
+	auto automation = new SimpleAudioAutomation();
+	automation->Initialize();
+	const SimpleAudioDriverAutomationEvent first_batch[] = { MakeEvent(1000, 1), MakeEvent(500, 100), MakeEvent(1000, 2), MakeEvent(1000, 3) };
+	automation->Schedule(first_batch, 4);
+	automation->Collect();
+	const SimpleAudioDriverAutomationEvent second_batch[] = { MakeEvent(1000, 4), MakeEvent(1000, 5) };
+	automation->Schedule(second_batch, 2);
+	automation->Collect();
+
+	const uint32_t expected[] = { 100, 1, 2, 3, 4, 5 };
+	SimpleAudioDriverAutomationEvent event;
+	for (auto value : expected)
+	{
+		HostToolsCheck(automation->PopEvent(1000, event), "event %u is missing", value);
+		HostToolsCheck(event.m_argument.m_value == value, "got event %u, expected %u", event.m_argument.m_value, value);
+	}
+	HostToolsCheck(!automation->PopEvent(UINT64_MAX, event), "an extra event was pending");
+	delete automation;
+}
+
+// A clear drops events the I/O handler already collected and events still in
+// the inbox, but not events scheduled after it.
+static void CheckClear()
+{
+	auto automation = new SimpleAudioAutomation();
+	automation->Initialize();
+	const SimpleAudioDriverAutomationEvent collected[] = { MakeEvent(100, 1), MakeEvent(200, 2) };
+	automation->Schedule(collected, 2);
+	automation->Collect();
+	const SimpleAudioDriverAutomationEvent queued[] = { MakeEvent(150, 3), MakeEvent(250, 4) };
+	automation->Schedule(queued, 2);
+	automation->Clear();
+	const SimpleAudioDriverAutomationEvent after_clear[] = { MakeEvent(300, 5) };
+	automation->Schedule(after_clear, 1);
+	automation->Collect();
+
+	SimpleAudioDriverAutomationEvent event;
+	HostToolsCheck(automation->PopEvent(UINT64_MAX, event) && event.m_argument.m_value == 5, "the event scheduled after the clear is missing");
+	HostToolsCheck(!automation->PopEvent(UINT64_MAX, event), "event %u survived the clear", event.m_argument.m_value);
+
+	// The inbox space the cleared events used is free again.
+	std::vector<SimpleAudioDriverAutomationEvent> fill(kSimpleAudioDriverAutomationCapacity, MakeEvent(400, 6));
+	HostToolsCheck(automation->Schedule(fill.data(), kSimpleAudioDriverAutomationCapacity) == kSimpleAudioDriverAutomationCapacity,
+				   "the inbox didn't take a full batch after the clear");
+	delete automation;
+}
+
+// Held events stay in the inbox, and the automation isn't idle until the
+// last of them has applied. A clear made during the hold still drops them.
+static void CheckHold()
+{
+	auto automation = new SimpleAudioAutomation();
+	automation->Initialize();
+	HostToolsCheck(automation->IsIdle(), "new automation isn't idle");
+	automation->SetHeld(true);
+	const SimpleAudioDriverAutomationEvent held[] = { MakeEvent(100, 1), MakeEvent(200, 2) };
+	automation->Schedule(held, 2);
+	automation->Collect();
+	
+	SimpleAudioDriverAutomationEvent event;
+	HostToolsCheck(!automation->PopEvent(UINT64_MAX, event), "a held event applied");
+	HostToolsCheck(!automation->IsIdle(), "automation with held events is idle");
+	
+	automation->SetHeld(false);
+	automation->Collect();
+	HostToolsCheck(automation->PopEvent(100, event) && event.m_argument.m_value == 1, "the first held event is missing");
+	HostToolsCheck(!automation->IsIdle(), "automation with a pending event is idle");
+	HostToolsCheck(automation->PopEvent(200, event) && event.m_argument.m_value == 2, "the second held event is missing");
+	HostToolsCheck(automation->IsIdle(), "automation isn't idle after its last event");
+	
+	automation->SetHeld(true);
+	automation->Schedule(held, 2);
+	automation->Clear();
+	automation->Collect();
+	automation->SetHeld(false);
+	automation->Collect();
+	HostToolsCheck(!automation->PopEvent(UINT64_MAX, event), "a held event survived the clear");
+	HostToolsCheck(automation->IsIdle(), "automation isn't idle after a clear");
+	delete automation;
+}
+
+// The work queue schedules and clears while the I/O handler collects. Each
+// event carries the number of clears made before it was scheduled, and once
+// the I/O handler applies an event, it must never apply one from before a
+// later clear.
+static void CheckClearGenerationUnderLoad()
+{
+	auto automation = new SimpleAudioAutomation();
+	automation->Initialize();
+	std::atomic<bool> done(false);
+	std::atomic<uint64_t> clears(0);
+
+	std::thread producer([&]() {
+		uint32_t generation = 0;
+		for (uint32_t i = 0; i < kTestStressEvents; i++)
+		{
+			if (i % 97 == 0)
+			{
+				automation->Clear();
+				generation++;
+			}
+			auto event = MakeEvent(i, generation);
+			while (automation->Schedule(&event, 1) == 0)
+			{
+				std::this_thread::yield();
+			}
+		}
+		clears.store(generation, std::memory_order_relaxed);
+		done.store(true, std::memory_order_release);
+	});
+
+	uint32_t newest_generation = 0;
+	uint64_t applied = 0;
+	while (true)
+	{
+		auto finished = done.load(std::memory_order_acquire);
+		automation->Collect();
+		SimpleAudioDriverAutomationEvent event;
+		while (automation->PopEvent(UINT64_MAX, event))
+		{
+			HostToolsCheck(event.m_argument.m_value >= newest_generation, "applied an event from generation %u after generation %u",
+						   event.m_argument.m_value, newest_generation);
+			newest_generation = event.m_argument.m_value;
+			applied++;
+		}
+		if (finished)
+		{
+			break;
+		}
+	}
+	producer.join();
+	HostToolsCheck(newest_generation == clears.load(), "the last generation applied was %u, not %llu",
+				   newest_generation, static_cast<unsigned long long>(clears.load()));
+	printf("applied %llu of %u events across %llu clears\n", static_cast<unsigned long long>(applied), kTestStressEvents,
+		   static_cast<unsigned long long>(clears.load()));
+	delete automation;
+}
+
+int main(int argc, const char* argv[])
+{
+	CheckExactFrame();
+	CheckSameTimeOrder();
+	CheckClear();
+	CheckHold();
+	CheckClearGenerationUnderLoad();
+	printf("automation: exact frames, same-time order, holds, and clears all hold\n");
+	return 0;
+}
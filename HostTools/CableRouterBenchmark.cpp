@@ -0,0 +1,100 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Measures how the cost of carrying audio between devices scales with the
+			 number of connected cables, and checks what each read mixes.
+*/
+
+// Local Includes
+#include "SimpleAudioCableRouter.h"
+#include "HostToolsSupport.h"
+
+// System Includes
+#include <stdio.h>
+#include <vector>
+
+#define kBenchmarkSampleRate 48000
+#define kBenchmarkChannels 1 // The device's streams are mono.
+#define kBenchmarkBlockFrames 512
+#define kBenchmarkRingFrames 32768 // One timestamp period, as on the device.
+#define kBenchmarkLatencyFrames 512
+#define kBenchmarkBlocks 20000
+#define kBenchmarkAmplitude 1000 // Small enough that every cable can be mixed without clipping.
+
+// The source device's output ring holds a ramp, so every frame the reader
+// gets can be traced back to the frame that was written.
+static int16_t OutputSample(uint64_t in_frame)
+{
+	return static_cast<int16_t>(static_cast<int64_t>(in_frame % (2 * kBenchmarkAmplitude)) - kBenchmarkAmplitude);
+}
+
+// Connects in_num_cables cables from device 0 into device 1 and runs both I/O
+// handlers' halves, a write then a read, for each block. Returns the time per
+// block, and fails if a read isn't the sum of every cable's delayed frames.
+static double RunCables(uint32_t in_num_cables)
+{
+	auto router = new SimpleAudioCableRouter();
+	router->Initialize();
+	for (uint32_t i = 0; i < in_num_cables; i++)
+	{
+		SimpleAudioDriverCableConfig config = {};
+		snprintf(config.m_name, sizeof(config.m_name), "Cable %u", i);
+		config.m_source_device = 0;
+		config.m_destination_device = 1;
+		config.m_latency_frames = kBenchmarkLatencyFrames;
+		uint32_t index = 0;
+		HostToolsCheck(router->Connect(config, &index) == kIOReturnSuccess, "couldn't connect cable %u", i);
+	}
+
+	std::vector<int16_t> output_ring(kBenchmarkRingFrames * kBenchmarkChannels);
+	std::vector<int16_t> input_ring(kBenchmarkRingFrames * kBenchmarkChannels);
+	for (size_t i = 0; i < output_ring.size(); i++)
+	{
+		output_ring[i] = OutputSample(i / kBenchmarkChannels);
+	}
+
+	double seconds = 0.0;
+	for (uint64_t block = 0; block < kBenchmarkBlocks; block++)
+	{
+		// The devices share a timeline that starts a period in, so the first
+		// read isn't clamped at frame 0.
+		uint64_t sample_time = block * kBenchmarkBlockFrames;
+		uint64_t timeline_frame = sample_time + kBenchmarkRingFrames;
+		auto start = HostToolsNow();
+		router->Write(0, timeline_frame, output_ring.data(), output_ring.size(), sample_time, kBenchmarkChannels, kBenchmarkSampleRate, kBenchmarkBlockFrames);
+		router->Read(1, timeline_frame, input_ring.data(), input_ring.size(), sample_time, kBenchmarkChannels, kBenchmarkSampleRate, kBenchmarkBlockFrames, 1.0f);
+		seconds += HostToolsSecondsSince(start);
+
+		// Before the latency has passed, the cables have nothing to give.
+		if (sample_time < kBenchmarkLatencyFrames)
+		{
+			continue;
+		}
+		for (uint32_t frame = 0; frame < kBenchmarkBlockFrames; frame++)
+		{
+			auto ring_frame = (sample_time + frame) % kBenchmarkRingFrames;
+			int32_t expected = in_num_cables * OutputSample((sample_time + frame - kBenchmarkLatencyFrames) % kBenchmarkRingFrames);
+			HostToolsCheck(input_ring[ring_frame * kBenchmarkChannels] == expected, "%u cables: frame %llu is %d, expected %d", in_num_cables,
+						   static_cast<unsigned long long>(sample_time + frame), input_ring[ring_frame * kBenchmarkChannels], expected);
+		}
+	}
+	delete router;
+	return seconds / kBenchmarkBlocks;
+}
+
+int main(int argc, const char* argv[])
+{
+	printf("Cable router, %u-frame blocks at %u Hz, %u channel, latency %u frames\n",
+		   kBenchmarkBlockFrames, kBenchmarkSampleRate, kBenchmarkChannels, kBenchmarkLatencyFrames);
+	printf("%-8s %14s %18s %14s\n", "cables", "us per block", "ns per cable-frame", "% real time");
+
+	double realtime_seconds = static_cast<double>(kBenchmarkBlockFrames) / kBenchmarkSampleRate;
+	for (uint32_t num_cables = 1; num_cables <= kSimpleAudioDriverMaxCables; num_cables *= 2)
+	{
+		auto seconds = RunCables(num_cables);
+		printf("%-8u %14.2f %18.2f %14.3f\n", num_cables, seconds * 1e6,
+			   seconds * 1e9 / (static_cast<double>(num_cables) * kBenchmarkBlockFrames), 100.0 * seconds / realtime_seconds);
+	}
+	return 0;
+}
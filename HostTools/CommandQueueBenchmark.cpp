@@ -0,0 +1,102 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Measures how fast commands move through the shared command queue, with
+			 several producers enqueueing while one consumer drains in batches.
+*/
+
+// Local Includes
+#include "SimpleAudioCommandQueue.h"
+#include "HostToolsSupport.h"
+
+// System Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#define kBenchmarkCommandsPerProducer 2000000
+
+// Runs in_num_producers threads that each enqueue their share of commands,
+// retrying while the queue is full, and drains on the calling thread in
+// batches of in_batch_size, the way the user client answers the doorbell.
+// Returns commands per second, and fails if any command is lost or reordered.
+static double RunProducers(uint32_t in_num_producers, uint32_t in_batch_size)
+{
+	auto queue = static_cast<SimpleAudioDriverCommandQueue*>(aligned_alloc(64, sizeof(SimpleAudioDriverCommandQueue)));
+	SimpleAudioCommandQueue::Initialize(queue);
+	uint64_t dequeue_position = 0;
+	
+	std::atomic<bool> start(false);
+	std::vector<std::thread> producers;
+	for (uint32_t producer = 0; producer < in_num_producers; producer++)
+	{
+		producers.emplace_back([=, &start]() {
+			while (!start.load(std::memory_order_acquire))
+			{
+				std::this_thread::yield();
+			}
+			for (uint32_t i = 0; i < kBenchmarkCommandsPerProducer; i++)
+			{
+				SimpleAudioDriverCommandSlot argument = {};
+				argument.m_argument.m_value = i;
+				while (!SimpleAudioCommandQueue::Enqueue(queue, producer, argument))
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+	
+	// Each producer's own commands must come out in the order it enqueued them.
+	std::vector<uint32_t> next_value(in_num_producers, 0);
+	std::vector<SimpleAudioDriverCommandSlot> commands(in_batch_size);
+	uint64_t total_commands = static_cast<uint64_t>(in_num_producers) * kBenchmarkCommandsPerProducer;
+	uint64_t num_received = 0;
+	
+	auto start_time = HostToolsNow();
+	start.store(true, std::memory_order_release);
+	while (num_received < total_commands)
+	{
+		uint32_t num_commands = SimpleAudioCommandQueue::Dequeue(queue, &dequeue_position, commands.data(), in_batch_size);
+		if (num_commands == 0)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		for (uint32_t i = 0; i < num_commands; i++)
+		{
+			auto producer = commands[i].m_command;
+			HostToolsCheck(producer < in_num_producers && commands[i].m_argument.m_value == next_value[producer],
+						   "command %llu arrived out of order", static_cast<unsigned long long>(num_received + i));
+			next_value[producer]++;
+		}
+		num_received += num_commands;
+	}
+	auto elapsed = HostToolsSecondsSince(start_time);
+	
+	for (auto& thread : producers)
+	{
+		thread.join();
+	}
+	free(queue);
+	return static_cast<double>(total_commands) / elapsed;
+}
+
+int main(int argc, const char* argv[])
+{
+	printf("Command queue throughput, %u commands per producer, capacity %u\n",
+		   kBenchmarkCommandsPerProducer, kSimpleAudioDriverCommandQueueCapacity);
+	printf("%-10s %-8s %14s\n", "producers", "batch", "Mcommands/s");
+	for (uint32_t num_producers : {1u, 2u, 4u})
+	{
+		for (uint32_t batch_size : {16u, static_cast<uint32_t>(kSimpleAudioDriverCommandQueueCapacity)})
+		{
+			auto rate = RunProducers(num_producers, batch_size);
+			printf("%-10u %-8u %14.2f\n", num_producers, batch_size, rate / 1e6);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,162 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Measures the memory 64 devices' portable state and stream rings take as
+			 they go from idle in lazy mode to running with everything in use.
+*/
+
+// Local Includes
+#include "SimpleAudioAutomation.h"
+#include "SimpleAudioInsertChain.h"
+#include "SimpleAudioIORecorder.h"
+#include "SimpleAudioPropertyStore.h"
+#include "SimpleAudioRenderAhead.h"
+#include "SimpleAudioRenderQuality.h"
+#include "HostToolsSupport.h"
+
+// System Includes
+#include <DriverKit/DriverKit.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+#define kBenchmarkNumDevices 64
+#define kBenchmarkRingFrames 32768 // One timestamp period, as on the device.
+#define kBenchmarkChannels 1 // The device's streams are mono.
+#define kBenchmarkSampleRate 44100.0
+
+// The helpers each device keeps in its ivars, with the memory the device
+// allocates for them on first use.
+struct BenchmarkDevice
+{
+	SimpleAudioInsertChain			m_insert_chain;
+	SimpleAudioRenderAhead			m_render_ahead;
+	SimpleAudioRenderQuality		m_render_quality;
+	SimpleAudioAutomation			m_automation;
+	SimpleAudioIORecorder			m_io_recorder;
+	SimpleAudioPropertyStore		m_property_store;
+	SimpleAudioIORecorder::Slot*	m_io_trace_slots;
+	int16_t*						m_output_ring;
+	int16_t*						m_input_ring;
+};
+
+static size_t ResidentBytes()
+{
+#if defined(__APPLE__)
+	mach_task_basic_info_data_t info = {};
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count);
+	return info.resident_size;
+#else
+	unsigned long size = 0;
+	unsigned long resident = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+	HostToolsCheck(statm != nullptr && fscanf(statm, "%lu %lu", &size, &resident) == 2, "couldn't read the resident size");
+	fclose(statm);
+	return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+// What GetMemoryUsage reports, less the parts only DriverKit can size.
+static size_t StateBytes(const BenchmarkDevice& in_device)
+{
+	return sizeof(in_device) + in_device.m_property_store.GetAllocatedBytes() +
+		(in_device.m_io_trace_slots != nullptr ? kSimpleAudioDriverIOTraceCapacity * sizeof(SimpleAudioIORecorder::Slot) : 0);
+}
+
+static void PrintStep(const char* in_name, const std::vector<BenchmarkDevice*>& in_devices, size_t in_baseline)
+{
+	size_t state_bytes = 0;
+	size_t ring_bytes = 0;
+	for (auto device : in_devices)
+	{
+		state_bytes += StateBytes(*device);
+		ring_bytes += device->m_output_ring != nullptr ? 2 * kBenchmarkRingFrames * kBenchmarkChannels * sizeof(int16_t) : 0;
+	}
+	auto resident = ResidentBytes() - in_baseline;
+	printf("%-28s %10.1f %10.1f %12.1f %10.1f\n", in_name, state_bytes / 1024.0 / in_devices.size(), ring_bytes / 1024.0 / in_devices.size(),
+		   resident / 1048576.0, resident / 1024.0 / in_devices.size());
+}
+
+int main(int argc, const char* argv[])
+{
+	printf("%u devices, %u-frame rings of %u channel\n", kBenchmarkNumDevices, kBenchmarkRingFrames, kBenchmarkChannels);
+	printf("%-28s %10s %10s %12s %10s\n", "", "state KiB", "rings KiB", "resident MiB", "KiB each");
+
+	// Every device starts with the custom property's defaults, as init sets them.
+	auto baseline = ResidentBytes();
+	std::vector<BenchmarkDevice*> devices;
+	for (uint32_t index = 0; index < kBenchmarkNumDevices; index++)
+	{
+		auto device = new BenchmarkDevice();
+		device->m_insert_chain.Initialize();
+		device->m_insert_chain.Prepare(kBenchmarkChannels, kBenchmarkSampleRate);
+		device->m_render_ahead.Initialize();
+		device->m_render_quality.Initialize();
+		device->m_automation.Initialize();
+		device->m_io_recorder.Initialize();
+		device->m_property_store.Initialize();
+		device->m_property_store.Set(kSimpleAudioDriverCustomPropertyQualifier0, kSimpleAudioDriverCustomPropertyDataValue0);
+		device->m_property_store.Set(kSimpleAudioDriverCustomPropertyQualifier1, kSimpleAudioDriverCustomPropertyDataValue1);
+		devices.push_back(device);
+	}
+	PrintStep("idle, lazy", devices, baseline);
+
+	// The smallest state each device keeps should stay below what lazy mode
+	// saves by releasing one ring.
+	auto idle_state_bytes = StateBytes(*devices[0]);
+	HostToolsCheck(idle_state_bytes < kBenchmarkRingFrames * kBenchmarkChannels * sizeof(int16_t),
+				   "an idle device keeps %zu bytes of state, more than one ring", idle_state_bytes);
+
+	// Committed rings become resident once the HAL and the I/O handler use them.
+	for (auto device : devices)
+	{
+		device->m_output_ring = IONewZero(int16_t, kBenchmarkRingFrames * kBenchmarkChannels);
+		device->m_input_ring = IONewZero(int16_t, kBenchmarkRingFrames * kBenchmarkChannels);
+		HostToolsCheck(device->m_output_ring != nullptr && device->m_input_ring != nullptr, "couldn't allocate the rings");
+		memset(device->m_output_ring, 1, kBenchmarkRingFrames * kBenchmarkChannels * sizeof(int16_t));
+		memset(device->m_input_ring, 1, kBenchmarkRingFrames * kBenchmarkChannels * sizeof(int16_t));
+	}
+	PrintStep("idle eager, or running", devices, baseline);
+
+	// A capture long enough to fill the recorder.
+	for (auto device : devices)
+	{
+		device->m_io_trace_slots = IONewZero(SimpleAudioIORecorder::Slot, kSimpleAudioDriverIOTraceCapacity);
+		HostToolsCheck(device->m_io_trace_slots != nullptr, "couldn't allocate the recorder's slots");
+		device->m_io_recorder.SetSlots(device->m_io_trace_slots);
+		device->m_io_recorder.SetEnabled(true);
+		for (uint32_t record = 0; record < kSimpleAudioDriverIOTraceCapacity; record++)
+		{
+			device->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_ZeroTimestamp, 0, record, record);
+		}
+	}
+	PrintStep("running, recording", devices, baseline);
+
+	// Every custom property pair in use.
+	for (auto device : devices)
+	{
+		for (uint32_t index = 2; index < kSimpleAudioDriverCustomPropertyCapacity; index++)
+		{
+			char qualifier[kSimpleAudioDriverCustomPropertyQualifierLength];
+			snprintf(qualifier, sizeof(qualifier), "Qualifier-%u", index);
+			HostToolsCheck(device->m_property_store.Set(qualifier, "Value"), "couldn't set pair %u", index);
+		}
+	}
+	PrintStep("running, every pair set", devices, baseline);
+
+	for (auto device : devices)
+	{
+		IOSafeDeleteNULL(device->m_output_ring, int16_t, kBenchmarkRingFrames * kBenchmarkChannels);
+		IOSafeDeleteNULL(device->m_input_ring, int16_t, kBenchmarkRingFrames * kBenchmarkChannels);
+		IOSafeDeleteNULL(device->m_io_trace_slots, SimpleAudioIORecorder::Slot, kSimpleAudioDriverIOTraceCapacity);
+		device->m_property_store.Free();
+		delete device;
+	}
+	return 0;
+}
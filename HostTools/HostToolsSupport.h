@@ -0,0 +1,38 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Timing and checking helpers that the host tools share.
+*/
+
+#ifndef HostToolsSupport_h
+#define HostToolsSupport_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+inline std::chrono::steady_clock::time_point HostToolsNow()
+{
+	return std::chrono::steady_clock::now();
+}
+
+inline double HostToolsSecondsSince(std::chrono::steady_clock::time_point in_start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - in_start).count();
+}
+
+// Stops the tool with a message when a check fails, so `make check` fails too.
+#define HostToolsCheck(condition, ...) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			fprintf(stderr, "%s:%d: check failed: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fprintf(stderr, "\n"); \
+			exit(1); \
+		} \
+	} while (0)
+
+#endif /* HostToolsSupport_h */
@@ -0,0 +1,350 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Replays an I/O capture from the app through the device's render path,
+			 and checks the replay against a capture it records itself.
+*/
+
+// Local Includes
+#include "SimpleAudioDriverKeys.h"
+#include "SimpleAudioInputRenderer.h"
+#include "SimpleAudioIORecorder.h"
+#include "HostToolsSupport.h"
+
+// System Includes
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#define kReplayRingFrames 32768 // One timestamp period, as on the device.
+#define kReplayDefaultChannels 1 // The device's input stream is mono.
+#define kReplayDefaultSampleRate 44100.0
+
+// The self-check records a session through the device's recorder, with
+// controls changing both at block starts and inside blocks.
+#define kSelfCheckSampleRate 48000
+#define kSelfCheckChannels 1
+#define kSelfCheckBlockFrames 512
+#define kSelfCheckBlocks 600
+#define kSelfCheckPeriodFrames 32768
+
+struct ReplayResult
+{
+	uint64_t	m_num_records;
+	uint64_t	m_num_blocks;
+	uint64_t	m_num_frames;
+	uint64_t	m_num_control_changes;
+	uint64_t	m_num_zero_timestamps;
+	uint64_t	m_num_discontinuities; // Blocks that didn't start where the last one ended.
+	uint64_t	m_num_io_starts;
+};
+
+static bool IsControlEvent(uint32_t in_event)
+{
+	return in_event == SimpleAudioDriverIOTraceEvent_DataSource || in_event == SimpleAudioDriverIOTraceEvent_InputVolume;
+}
+
+// Replays the records the way the I/O handler rendered them: a control change
+// recorded inside a block lands on its sample time, and each block writes its
+// frames to the output in order. The capture doesn't include the host's audio,
+// so loopback replays an output ring of silence.
+static ReplayResult Replay(const std::vector<SimpleAudioDriverIOTraceRecord>& in_records, uint32_t in_num_channels, FILE* in_output)
+{
+	ReplayResult result = {};
+	result.m_num_records = in_records.size();
+
+	std::vector<int16_t> output_ring(kReplayRingFrames * in_num_channels, 0);
+	std::vector<int16_t> input_ring(kReplayRingFrames * in_num_channels, 0);
+	std::vector<int16_t> block;
+	double sample_rate = kReplayDefaultSampleRate;
+	uint32_t data_source = 0;
+	float volume = 1.0f;
+	bool have_block = false;
+	uint64_t next_block_time = 0;
+
+	auto apply_control = [&](const SimpleAudioDriverIOTraceRecord& in_record) {
+		if (in_record.m_event == SimpleAudioDriverIOTraceEvent_DataSource)
+		{
+			data_source = in_record.m_value;
+		}
+		else
+		{
+			memcpy(&volume, &in_record.m_value, sizeof(volume));
+		}
+		result.m_num_control_changes++;
+	};
+
+	for (size_t index = 0; index < in_records.size(); index++)
+	{
+		const auto& record = in_records[index];
+		switch (record.m_event)
+		{
+			case SimpleAudioDriverIOTraceEvent_SampleRate:
+				sample_rate = record.m_value;
+				break;
+
+			case SimpleAudioDriverIOTraceEvent_StartIO:
+				have_block = false;
+				result.m_num_io_starts++;
+				break;
+
+			case SimpleAudioDriverIOTraceEvent_ZeroTimestamp:
+				result.m_num_zero_timestamps++;
+				break;
+
+			case SimpleAudioDriverIOTraceEvent_DataSource:
+			case SimpleAudioDriverIOTraceEvent_InputVolume:
+				apply_control(record);
+				break;
+
+			case SimpleAudioDriverIOTraceEvent_BeginRead:
+			{
+				// The handler records the block before the control changes it
+				// finds while rendering it, so those follow the block's record.
+				auto block_start = record.m_sample_time;
+				auto block_end = block_start + record.m_value;
+				if (have_block && block_start != next_block_time)
+				{
+					result.m_num_discontinuities++;
+				}
+				have_block = true;
+				next_block_time = block_end;
+
+				auto segment_start = block_start;
+				while (segment_start < block_end)
+				{
+					auto segment_end = block_end;
+					if (index + 1 < in_records.size() && IsControlEvent(in_records[index + 1].m_event) &&
+						in_records[index + 1].m_sample_time >= segment_start && in_records[index + 1].m_sample_time < block_end)
+					{
+						if (in_records[index + 1].m_sample_time == segment_start)
+						{
+							apply_control(in_records[++index]);
+							continue;
+						}
+						segment_end = in_records[index + 1].m_sample_time;
+					}
+					SimpleAudioInputRenderer::Render(data_source, volume, sample_rate, segment_start, segment_end - segment_start, false,
+													 output_ring.data(), output_ring.size(), input_ring.data(), input_ring.size(), in_num_channels);
+					segment_start = segment_end;
+				}
+
+				block.resize(record.m_value * in_num_channels);
+				for (size_t i = 0; i < block.size(); i++)
+				{
+					block[i] = input_ring[(block_start * in_num_channels + i) % input_ring.size()];
+				}
+				if (in_output != nullptr)
+				{
+					HostToolsCheck(fwrite(block.data(), sizeof(int16_t), block.size(), in_output) == block.size(), "failed to write the output");
+				}
+				result.m_num_blocks++;
+				result.m_num_frames += record.m_value;
+				break;
+			}
+
+			default:
+				break;
+		}
+	}
+	return result;
+}
+
+static bool ReadCapture(const char* in_path, SimpleAudioDriverIOTraceFileHeader* out_header, std::vector<SimpleAudioDriverIOTraceRecord>* out_records)
+{
+	FILE* file = fopen(in_path, "rb");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	bool ok = fread(out_header, sizeof(*out_header), 1, file) == 1 &&
+			  out_header->m_magic == kSimpleAudioDriverIOTraceFileMagic &&
+			  out_header->m_version == kSimpleAudioDriverIOTraceFileVersion;
+	SimpleAudioDriverIOTraceRecord record;
+	while (ok && fread(&record, sizeof(record), 1, file) == 1)
+	{
+		out_records->push_back(record);
+	}
+	fclose(file);
+	return ok;
+}
+
+// Records a session through the device's recorder, drains it into a capture
+// file the way the app does, and checks that the replay renders every block
+// with the controls in effect at each of its frames.
+static int RunSelfCheck()
+{
+	auto recorder = new SimpleAudioIORecorder();
+	recorder->Initialize();
+	std::vector<SimpleAudioIORecorder::Slot> slots(kSimpleAudioDriverIOTraceCapacity);
+	recorder->SetSlots(slots.data());
+	recorder->SetEnabled(true);
+
+	char path[] = "/tmp/IOTraceReplay.XXXXXX";
+	int descriptor = mkstemp(path);
+	HostToolsCheck(descriptor >= 0, "failed to create a capture file");
+	FILE* capture = fdopen(descriptor, "wb");
+	SimpleAudioDriverIOTraceFileHeader file_header = {kSimpleAudioDriverIOTraceFileMagic, kSimpleAudioDriverIOTraceFileVersion, 1, 1};
+	fwrite(&file_header, sizeof(file_header), 1, capture);
+
+	std::vector<uint8_t> drain_buffer(sizeof(SimpleAudioDriverIOTraceHeader) + kSimpleAudioDriverIOTraceMaxDrainRecords * sizeof(SimpleAudioDriverIOTraceRecord));
+	auto drain = [&]() {
+		while (true)
+		{
+			auto size = recorder->Drain(drain_buffer.data(), drain_buffer.size());
+			SimpleAudioDriverIOTraceHeader header;
+			memcpy(&header, drain_buffer.data(), sizeof(header));
+			HostToolsCheck(header.m_dropped_records == 0, "the recorder dropped %llu records", static_cast<unsigned long long>(header.m_dropped_records));
+			fwrite(drain_buffer.data() + sizeof(header), 1, size - sizeof(header), capture);
+			if (header.m_num_records < kSimpleAudioDriverIOTraceMaxDrainRecords)
+			{
+				break;
+			}
+		}
+	};
+
+	// The expected input, rendered one frame at a time with the controls
+	// in effect at that frame.
+	std::vector<int16_t> expected(kSelfCheckBlocks * kSelfCheckBlockFrames * kSelfCheckChannels);
+	std::vector<int16_t> silence(kReplayRingFrames * kSelfCheckChannels, 0);
+	std::vector<int16_t> ring(kReplayRingFrames * kSelfCheckChannels, 0);
+	uint32_t data_source = 440;
+	float volume = 1.0f;
+	auto record_data_source = [&](uint64_t in_sample_time) {
+		recorder->Record(SimpleAudioDriverIOTraceEvent_DataSource, data_source, in_sample_time, 0);
+	};
+	auto record_volume = [&](uint64_t in_sample_time) {
+		uint32_t volume_bits = 0;
+		memcpy(&volume_bits, &volume, sizeof(volume_bits));
+		recorder->Record(SimpleAudioDriverIOTraceEvent_InputVolume, volume_bits, in_sample_time, 0);
+	};
+
+	recorder->Record(SimpleAudioDriverIOTraceEvent_SampleRate, kSelfCheckSampleRate, 0, 0);
+	record_data_source(0);
+	record_volume(0);
+	recorder->Record(SimpleAudioDriverIOTraceEvent_StartIO, 0, 0, 0);
+	for (uint64_t block = 0; block < kSelfCheckBlocks; block++)
+	{
+		uint64_t block_start = block * kSelfCheckBlockFrames;
+		if (block_start % kSelfCheckPeriodFrames == 0)
+		{
+			recorder->Record(SimpleAudioDriverIOTraceEvent_ZeroTimestamp, 0, block_start, 0);
+		}
+		recorder->Record(SimpleAudioDriverIOTraceEvent_WriteEnd, kSelfCheckBlockFrames, block_start, 0);
+		recorder->Record(SimpleAudioDriverIOTraceEvent_BeginRead, kSelfCheckBlockFrames, block_start, 0);
+
+		// A change the HAL made lands at the block start, and an automation
+		// event inside the block lands on its own frame.
+		uint64_t change_frame = kSelfCheckBlockFrames;
+		if (block % 7 == 3)
+		{
+			data_source = data_source == 440 ? 880 : (data_source == 880 ? 0 : 440);
+			record_data_source(block_start);
+		}
+		if (block % 5 == 2)
+		{
+			change_frame = (block * 37) % kSelfCheckBlockFrames;
+		}
+
+		for (uint64_t frame = 0; frame < kSelfCheckBlockFrames; frame++)
+		{
+			if (frame == change_frame)
+			{
+				volume = volume == 1.0f ? 0.25f : 1.0f;
+				record_volume(block_start + frame);
+			}
+			SimpleAudioInputRenderer::Render(data_source, volume, kSelfCheckSampleRate, block_start + frame, 1, false,
+											 silence.data(), silence.size(), ring.data(), ring.size(), kSelfCheckChannels);
+			for (uint32_t channel = 0; channel < kSelfCheckChannels; channel++)
+			{
+				expected[(block_start + frame) * kSelfCheckChannels + channel] = ring[((block_start + frame) * kSelfCheckChannels + channel) % ring.size()];
+			}
+		}
+
+		// The app drains while I/O runs, so the capture is written in pieces.
+		if (block % 50 == 49)
+		{
+			drain();
+		}
+	}
+	recorder->Record(SimpleAudioDriverIOTraceEvent_StopIO, 0, kSelfCheckBlocks * kSelfCheckBlockFrames, 0);
+	drain();
+	fclose(capture);
+	delete recorder;
+
+	SimpleAudioDriverIOTraceFileHeader header = {};
+	std::vector<SimpleAudioDriverIOTraceRecord> records;
+	HostToolsCheck(ReadCapture(path, &header, &records), "failed to read the capture back");
+
+	FILE* output = tmpfile();
+	HostToolsCheck(output != nullptr, "failed to create the output file");
+	auto result = Replay(records, kSelfCheckChannels, output);
+	unlink(path);
+
+	HostToolsCheck(result.m_num_blocks == kSelfCheckBlocks, "replayed %llu blocks", static_cast<unsigned long long>(result.m_num_blocks));
+	HostToolsCheck(result.m_num_discontinuities == 0, "replayed %llu discontinuities", static_cast<unsigned long long>(result.m_num_discontinuities));
+
+	std::vector<int16_t> replayed(expected.size());
+	rewind(output);
+	HostToolsCheck(fread(replayed.data(), sizeof(int16_t), replayed.size(), output) == replayed.size(), "the output is short");
+	fclose(output);
+	for (size_t i = 0; i < expected.size(); i++)
+	{
+		HostToolsCheck(replayed[i] == expected[i], "sample %zu is %d, expected %d", i, replayed[i], expected[i]);
+	}
+
+	printf("replayed %llu records: %llu blocks, %llu control changes, every sample matches\n",
+		   static_cast<unsigned long long>(result.m_num_records), static_cast<unsigned long long>(result.m_num_blocks),
+		   static_cast<unsigned long long>(result.m_num_control_changes));
+	return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+	if (argc < 2)
+	{
+		return RunSelfCheck();
+	}
+
+	// IOTraceReplay <capture> [<output.raw> [<channels>]]
+	uint32_t num_channels = argc > 3 ? static_cast<uint32_t>(atoi(argv[3])) : kReplayDefaultChannels;
+	if (num_channels == 0)
+	{
+		fprintf(stderr, "usage: %s <capture> [<output.raw> [<channels>]]\n", argv[0]);
+		return 1;
+	}
+
+	SimpleAudioDriverIOTraceFileHeader header = {};
+	std::vector<SimpleAudioDriverIOTraceRecord> records;
+	if (!ReadCapture(argv[1], &header, &records))
+	{
+		fprintf(stderr, "%s isn't an I/O capture\n", argv[1]);
+		return 1;
+	}
+
+	FILE* output = nullptr;
+	if (argc > 2)
+	{
+		output = fopen(argv[2], "wb");
+		if (output == nullptr)
+		{
+			fprintf(stderr, "failed to create %s\n", argv[2]);
+			return 1;
+		}
+	}
+	auto result = Replay(records, num_channels, output);
+	if (output != nullptr)
+	{
+		fclose(output);
+	}
+
+	printf("%llu records, %u I/O runs, %llu blocks, %llu frames, %llu control changes, %llu zero timestamps, %llu discontinuities\n",
+		   static_cast<unsigned long long>(result.m_num_records), static_cast<unsigned>(result.m_num_io_starts),
+		   static_cast<unsigned long long>(result.m_num_blocks), static_cast<unsigned long long>(result.m_num_frames),
+		   static_cast<unsigned long long>(result.m_num_control_changes), static_cast<unsigned long long>(result.m_num_zero_timestamps),
+		   static_cast<unsigned long long>(result.m_num_discontinuities));
+	return 0;
+}
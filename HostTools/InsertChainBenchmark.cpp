@@ -0,0 +1,126 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Measures the insert chain with every band in use on a wide, fast format,
+			 and checks that it passes untouched samples through exactly.
+*/
+
+// Local Includes
+#include "SimpleAudioInsertChain.h"
+#include "HostToolsSupport.h"
+
+// System Includes
+#include <math.h>
+#include <vector>
+
+#define kBenchmarkSampleRate 96000.0
+#define kBenchmarkChannels 16
+#define kBenchmarkBlockFrames 64
+#define kBenchmarkRingFrames 16384
+#define kBenchmarkBlocks 200000
+
+static SimpleAudioDriverInsertChainConfig MakeFullConfig()
+{
+	SimpleAudioDriverInsertChainConfig config = {};
+	config.m_dc_blocker_enabled = 1;
+	config.m_limiter_enabled = 1;
+	config.m_limiter_threshold_db = -1.0f;
+	config.m_limiter_release_ms = 50.0f;
+	const uint32_t types[] = { SimpleAudioDriverFilterType_HighPass, SimpleAudioDriverFilterType_LowShelf, SimpleAudioDriverFilterType_Peak,
+							   SimpleAudioDriverFilterType_Peak, SimpleAudioDriverFilterType_Peak, SimpleAudioDriverFilterType_Peak,
+							   SimpleAudioDriverFilterType_HighShelf, SimpleAudioDriverFilterType_LowPass };
+	for (uint32_t band = 0; band < kSimpleAudioDriverInsertChainMaxBands; band++)
+	{
+		config.m_bands[band].m_type = types[band];
+		config.m_bands[band].m_frequency = 40.0f * powf(2.0f, static_cast<float>(band) * 1.3f);
+		config.m_bands[band].m_gain_db = band % 2 == 0 ? 3.0f : -3.0f;
+		config.m_bands[band].m_q = 0.9f;
+	}
+	return config;
+}
+
+// A chain that doesn't change the samples, here a limiter at 0 dB, has to
+// return every value exactly, including both ends of the range.
+static void CheckPassThrough()
+{
+	SimpleAudioInsertChain chain;
+	chain.Initialize();
+	chain.Prepare(2, kBenchmarkSampleRate);
+	SimpleAudioDriverInsertChainConfig config = {};
+	config.m_limiter_enabled = 1;
+	config.m_limiter_threshold_db = 0.0f;
+	config.m_limiter_release_ms = 50.0f;
+	HostToolsCheck(chain.Configure(config), "couldn't configure the limiter");
+	
+	std::vector<int16_t> ring(65536 * 2);
+	for (size_t i = 0; i < ring.size(); i++)
+	{
+		ring[i] = static_cast<int16_t>(static_cast<int32_t>(i / 2) - 32768);
+	}
+	auto original = ring;
+	for (uint64_t sample_time = 0; sample_time < 65536; sample_time += 512)
+	{
+		chain.Process(ring.data(), ring.size(), sample_time, 512, false);
+	}
+	for (size_t i = 0; i < ring.size(); i++)
+	{
+		HostToolsCheck(ring[i] == original[i], "sample %d came back as %d", original[i], ring[i]);
+	}
+}
+
+// The lanes hold 16 channels, so a wider format can only be bypassed.
+static void CheckWideFormat()
+{
+	SimpleAudioInsertChain chain;
+	chain.Initialize();
+	chain.Prepare(kSimpleAudioInsertChainMaxChannels + 2, kBenchmarkSampleRate);
+	HostToolsCheck(!chain.Configure(MakeFullConfig()), "a chain wider than its lanes shouldn't be configurable");
+	
+	// Turning on a configuration first and widening the format afterwards bypasses it.
+	chain.Prepare(2, kBenchmarkSampleRate);
+	HostToolsCheck(chain.Configure(MakeFullConfig()) && chain.IsActive(), "couldn't configure the chain");
+	chain.Prepare(kSimpleAudioInsertChainMaxChannels + 2, kBenchmarkSampleRate);
+	HostToolsCheck(!chain.IsActive(), "a chain wider than its lanes should be bypassed");
+	
+	std::vector<int16_t> ring(1024 * (kSimpleAudioInsertChainMaxChannels + 2), 1000);
+	chain.Process(ring.data(), ring.size(), 0, 1024, false);
+	for (auto sample : ring)
+	{
+		HostToolsCheck(sample == 1000, "the bypassed chain changed a sample");
+	}
+}
+
+int main(int argc, const char* argv[])
+{
+	CheckPassThrough();
+	CheckWideFormat();
+	
+	SimpleAudioInsertChain chain;
+	chain.Initialize();
+	chain.Prepare(kBenchmarkChannels, kBenchmarkSampleRate);
+	HostToolsCheck(chain.Configure(MakeFullConfig()), "couldn't configure the chain");
+	
+	std::vector<int16_t> ring(kBenchmarkRingFrames * kBenchmarkChannels);
+	for (size_t i = 0; i < ring.size(); i++)
+	{
+		ring[i] = static_cast<int16_t>(8000.0 * sin(0.001 * static_cast<double>(i)));
+	}
+	
+	printf("Insert chain, %u bands, %u channels, %u-frame blocks at %.0f Hz\n",
+		   kSimpleAudioDriverInsertChainMaxBands, kBenchmarkChannels, kBenchmarkBlockFrames, kBenchmarkSampleRate);
+	for (auto bypass_bands : {false, true})
+	{
+		auto start = HostToolsNow();
+		for (uint64_t block = 0; block < kBenchmarkBlocks; block++)
+		{
+			chain.Process(ring.data(), ring.size(), block * kBenchmarkBlockFrames, kBenchmarkBlockFrames, bypass_bands);
+		}
+		auto elapsed = HostToolsSecondsSince(start);
+		auto ns_per_block = elapsed * 1e9 / kBenchmarkBlocks;
+		auto block_ns = 1e9 * kBenchmarkBlockFrames / kBenchmarkSampleRate;
+		printf("  %-16s %8.0f ns per block, %5.2f%% of real time\n", bypass_bands ? "bands bypassed" : "all bands", ns_per_block,
+			   100.0 * ns_per_block / block_ns);
+	}
+	return 0;
+}
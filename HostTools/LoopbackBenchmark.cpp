@@ -0,0 +1,74 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Measures loopback that copies the output ring into the input ring against
+			 loopback that shares the output ring, and checks that the HAL
+			 reads the same samples either way.
+*/
+
+// Local Includes
+#include "SimpleAudioInputRenderer.h"
+#include "HostToolsSupport.h"
+
+// System Includes
+#include <math.h>
+#include <vector>
+
+#define kBenchmarkRingFrames 32768 // One timestamp period, as on the device.
+#define kBenchmarkBlockFrames 512
+#define kBenchmarkBlocks 200000
+
+// Reads an input block the way the HAL would, and sums it so the read can't be skipped.
+static uint64_t ReadBlock(const int16_t* in_ring, size_t in_ring_length, uint64_t in_sample_time, uint32_t in_num_channels)
+{
+	uint64_t sum = 0;
+	for (size_t i = 0; i < in_num_channels * kBenchmarkBlockFrames; i++)
+	{
+		sum += static_cast<uint16_t>(in_ring[(in_num_channels * in_sample_time + i) % in_ring_length]);
+	}
+	return sum;
+}
+
+int main(int argc, const char* argv[])
+{
+	printf("Loopback, %u-frame blocks from a %u-frame ring\n", kBenchmarkBlockFrames, kBenchmarkRingFrames);
+	for (uint32_t num_channels : {1u, 2u, 8u})
+	{
+		std::vector<int16_t> output_ring(kBenchmarkRingFrames * num_channels);
+		std::vector<int16_t> input_ring(kBenchmarkRingFrames * num_channels);
+		for (size_t i = 0; i < output_ring.size(); i++)
+		{
+			output_ring[i] = static_cast<int16_t>(8000.0 * sin(0.001 * static_cast<double>(i)));
+		}
+
+		// Copying at unity gain, the I/O handler writes each block into the
+		// input ring and the HAL reads it from there.
+		uint64_t copy_sum = 0;
+		auto start = HostToolsNow();
+		for (uint64_t block = 0; block < kBenchmarkBlocks; block++)
+		{
+			auto sample_time = block * kBenchmarkBlockFrames;
+			SimpleAudioInputRenderer::RenderLoopback(1.0f, sample_time, kBenchmarkBlockFrames, output_ring.data(), output_ring.size(),
+													 input_ring.data(), input_ring.size(), num_channels);
+			copy_sum += ReadBlock(input_ring.data(), input_ring.size(), sample_time, num_channels);
+		}
+		auto copy_seconds = HostToolsSecondsSince(start);
+
+		// Sharing, the HAL reads the output ring and the I/O handler does nothing.
+		uint64_t shared_sum = 0;
+		start = HostToolsNow();
+		for (uint64_t block = 0; block < kBenchmarkBlocks; block++)
+		{
+			shared_sum += ReadBlock(output_ring.data(), output_ring.size(), block * kBenchmarkBlockFrames, num_channels);
+		}
+		auto shared_seconds = HostToolsSecondsSince(start);
+		HostToolsCheck(copy_sum == shared_sum, "%u channels: the copied input doesn't match the output", num_channels);
+		HostToolsCheck(input_ring == output_ring, "%u channels: the input ring isn't an exact copy of the output", num_channels);
+
+		printf("  %u ch  %-7s %8.0f ns per block\n", num_channels, "copy", copy_seconds * 1e9 / kBenchmarkBlocks);
+		printf("  %u ch  %-7s %8.0f ns per block, %.1fx faster\n", num_channels, "shared",
+			   shared_seconds * 1e9 / kBenchmarkBlocks, copy_seconds / shared_seconds);
+	}
+	return 0;
+}
@@ -0,0 +1,139 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Renders one timeline offline serially and in parallel chunks, checks
+			 that both match the device's block-by-block render, and reports
+			 how much faster than real time each ran.
+*/
+
+// Local Includes
+#include "SimpleAudioOfflineRenderer.h"
+#include "SimpleAudioToneGenerator.h"
+#include "HostToolsSupport.h"
+
+// System Includes
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define kTestToneFrequency 440.0
+#define kTestVolume 0.5f
+#define kTestSampleRate 48000.0
+#define kTestChannels 2
+#define kTestBlockFrames 512
+#define kTestSeconds 60
+#define kTestParallelThreads 4
+#define kTestParallelChunkBlocks 16 // Small chunks, so every thread renders many of them.
+#define kTestWAVHeaderBytes 44
+
+// Renders the timeline the way the device's I/O handler does, one block at
+// a time into a ring as long as the timeline.
+static std::vector<int16_t> RenderReference(bool in_cheap_oscillator, uint64_t in_num_frames)
+{
+	std::vector<int16_t> samples(in_num_frames * kTestChannels);
+	for (uint64_t frame = 0; frame < in_num_frames; frame += kTestBlockFrames)
+	{
+		auto block_frames = std::min<uint64_t>(kTestBlockFrames, in_num_frames - frame);
+		SimpleAudioToneGenerator::Render(kTestToneFrequency, kTestVolume, kTestSampleRate, frame, block_frames, in_cheap_oscillator,
+										 samples.data(), samples.size(), frame, kTestChannels);
+	}
+	return samples;
+}
+
+static std::vector<uint8_t> ReadFile(const std::string& in_path)
+{
+	std::vector<uint8_t> bytes;
+	FILE* file = fopen(in_path.c_str(), "rb");
+	HostToolsCheck(file != nullptr, "couldn't open %s", in_path.c_str());
+	uint8_t buffer[65536];
+	size_t num_read = 0;
+	while ((num_read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		bytes.insert(bytes.end(), buffer, buffer + num_read);
+	}
+	fclose(file);
+	return bytes;
+}
+
+// The file holds exactly the reference samples, after a WAV header if it has one.
+static void CheckFile(const std::string& in_path, uint32_t in_file_type, const std::vector<int16_t>& in_reference)
+{
+	auto bytes = ReadFile(in_path);
+	size_t data_offset = 0;
+	if (in_file_type == SimpleAudioOfflineRenderFileType_WAV)
+	{
+		HostToolsCheck(bytes.size() >= kTestWAVHeaderBytes && memcmp(bytes.data(), "RIFF", 4) == 0 && memcmp(bytes.data() + 8, "WAVEfmt ", 8) == 0,
+					   "%s doesn't start with a WAV header", in_path.c_str());
+		uint16_t num_channels = static_cast<uint16_t>(bytes[22] | (bytes[23] << 8));
+		uint32_t sample_rate = bytes[24] | (bytes[25] << 8) | (bytes[26] << 16) | (static_cast<uint32_t>(bytes[27]) << 24);
+		uint32_t data_size = bytes[40] | (bytes[41] << 8) | (bytes[42] << 16) | (static_cast<uint32_t>(bytes[43]) << 24);
+		HostToolsCheck(num_channels == kTestChannels && sample_rate == static_cast<uint32_t>(kTestSampleRate),
+					   "%s describes %u channels at %u Hz", in_path.c_str(), num_channels, sample_rate);
+		HostToolsCheck(data_size == in_reference.size() * sizeof(int16_t), "%s describes %u bytes of samples", in_path.c_str(), data_size);
+		data_offset = kTestWAVHeaderBytes;
+	}
+	HostToolsCheck(bytes.size() == data_offset + in_reference.size() * sizeof(int16_t), "%s is %zu bytes", in_path.c_str(), bytes.size());
+
+	// Both files hold samples in host byte order on a little-endian host.
+	for (size_t i = 0; i < in_reference.size(); i++)
+	{
+		int16_t sample = 0;
+		memcpy(&sample, bytes.data() + data_offset + i * sizeof(int16_t), sizeof(sample));
+		HostToolsCheck(sample == in_reference[i], "%s: sample %zu is %d, expected %d", in_path.c_str(), i, sample, in_reference[i]);
+	}
+}
+
+int main(int argc, const char* argv[])
+{
+	// The files go in the directory given, or the temporary directory.
+	std::string directory = argc > 1 ? argv[1] : (getenv("TMPDIR") != nullptr ? getenv("TMPDIR") : "/tmp");
+	auto wav_path = directory + "/OfflineRenderTest.wav";
+	auto raw_path = directory + "/OfflineRenderTest.raw";
+	uint64_t num_frames = static_cast<uint64_t>(kTestSeconds * kTestSampleRate) + kTestBlockFrames / 2; // End mid-block.
+
+	printf("Offline render, %u s of %.0f Hz tone, %u channels at %.0f Hz, %u-frame blocks\n", kTestSeconds, kTestToneFrequency, kTestChannels,
+		   kTestSampleRate, kTestBlockFrames);
+	for (auto cheap_oscillator : {false, true})
+	{
+		auto reference = RenderReference(cheap_oscillator, num_frames);
+
+		SimpleAudioOfflineRenderConfig config = {};
+		config.m_tone_frequency = kTestToneFrequency;
+		config.m_volume = kTestVolume;
+		config.m_sample_rate = kTestSampleRate;
+		config.m_num_channels = kTestChannels;
+		config.m_num_frames = num_frames;
+		config.m_block_frames = kTestBlockFrames;
+		config.m_cheap_oscillator = cheap_oscillator;
+
+		// Serially into a WAV file, then in parallel chunks into a raw file.
+		SimpleAudioOfflineRenderResult serial = {};
+		config.m_num_threads = 1;
+		config.m_file_type = SimpleAudioOfflineRenderFileType_WAV;
+		HostToolsCheck(SimpleAudioOfflineRenderer::Render(config, wav_path.c_str(), &serial), "the serial render to %s failed", wav_path.c_str());
+
+		SimpleAudioOfflineRenderResult parallel = {};
+		config.m_num_threads = kTestParallelThreads;
+		config.m_chunk_blocks = kTestParallelChunkBlocks;
+		config.m_file_type = SimpleAudioOfflineRenderFileType_Raw;
+		HostToolsCheck(SimpleAudioOfflineRenderer::Render(config, raw_path.c_str(), &parallel), "the parallel render to %s failed", raw_path.c_str());
+
+		HostToolsCheck(serial.m_frames_written == num_frames && parallel.m_frames_written == num_frames, "rendered %llu and %llu of %llu frames",
+					   static_cast<unsigned long long>(serial.m_frames_written), static_cast<unsigned long long>(parallel.m_frames_written),
+					   static_cast<unsigned long long>(num_frames));
+		HostToolsCheck(parallel.m_num_threads == kTestParallelThreads && parallel.m_num_chunks > parallel.m_num_threads,
+					   "the parallel render used %u threads for %u chunks", parallel.m_num_threads, parallel.m_num_chunks);
+		HostToolsCheck(serial.m_checksum == parallel.m_checksum, "the serial checksum %016llx doesn't match the parallel %016llx",
+					   static_cast<unsigned long long>(serial.m_checksum), static_cast<unsigned long long>(parallel.m_checksum));
+		CheckFile(wav_path, SimpleAudioOfflineRenderFileType_WAV, reference);
+		CheckFile(raw_path, SimpleAudioOfflineRenderFileType_Raw, reference);
+
+		printf("  %-17s checksum %016llx\n", cheap_oscillator ? "cheap oscillator" : "full oscillator", static_cast<unsigned long long>(serial.m_checksum));
+		printf("    %-15s %7.0fx real time, 1 thread\n", "serial, WAV", serial.m_speedup);
+		printf("    %-15s %7.0fx real time, %u threads, %u chunks\n", "parallel, raw", parallel.m_speedup, parallel.m_num_threads, parallel.m_num_chunks);
+	}
+	printf("wrote %s and %s\n", wav_path.c_str(), raw_path.c_str());
+	return 0;
+}
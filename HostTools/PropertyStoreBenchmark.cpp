@@ -0,0 +1,142 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Measures inserts, lookups, updates, and snapshots in a full custom
+			 property store, and checks what the snapshot holds.
+*/
+
+// Local Includes
+#include "SimpleAudioPropertyStore.h"
+#include "HostToolsSupport.h"
+
+// System Includes
+#include <string.h>
+#include <vector>
+
+#define kBenchmarkRounds 200
+#define kBenchmarkSnapshots 2000
+
+static void MakeQualifier(uint32_t in_index, char* out_qualifier)
+{
+	snprintf(out_qualifier, kSimpleAudioDriverCustomPropertyQualifierLength, "Qualifier-%u", in_index);
+}
+
+static void MakeValue(uint32_t in_index, uint32_t in_round, char* out_value)
+{
+	snprintf(out_value, kSimpleAudioDriverCustomPropertyValueLength, "Value-%u-%u", in_index, in_round);
+}
+
+// Walks the snapshot the way the app does, and checks that it holds every
+// pair in the order it was first set, with the value from in_round.
+static void CheckSnapshot(const std::vector<uint8_t>& in_snapshot, uint32_t in_round)
+{
+	SimpleAudioDriverCustomPropertySnapshotHeader header = {};
+	memcpy(&header, in_snapshot.data(), sizeof(header));
+	HostToolsCheck(header.m_num_entries == kSimpleAudioDriverCustomPropertyCapacity, "the snapshot has %u pairs", header.m_num_entries);
+
+	size_t offset = sizeof(header);
+	for (uint32_t index = 0; index < header.m_num_entries; index++)
+	{
+		SimpleAudioDriverCustomPropertyRecord record = {};
+		HostToolsCheck(offset + sizeof(record) <= in_snapshot.size(), "pair %u is past the end of the snapshot", index);
+		memcpy(&record, in_snapshot.data() + offset, sizeof(record));
+		offset += sizeof(record);
+		HostToolsCheck(offset + record.m_qualifier_length + record.m_value_length <= in_snapshot.size(), "pair %u is past the end of the snapshot", index);
+
+		char qualifier[kSimpleAudioDriverCustomPropertyQualifierLength];
+		char value[kSimpleAudioDriverCustomPropertyValueLength];
+		MakeQualifier(index, qualifier);
+		MakeValue(index, in_round, value);
+		HostToolsCheck(record.m_qualifier_length == strlen(qualifier) && memcmp(in_snapshot.data() + offset, qualifier, record.m_qualifier_length) == 0,
+					   "pair %u has the wrong qualifier", index);
+		offset += record.m_qualifier_length;
+		HostToolsCheck(record.m_value_length == strlen(value) && memcmp(in_snapshot.data() + offset, value, record.m_value_length) == 0,
+					   "pair %u has the wrong value", index);
+		offset += record.m_value_length;
+	}
+	HostToolsCheck(offset == in_snapshot.size(), "the snapshot has %zu bytes after its last pair", in_snapshot.size() - offset);
+}
+
+int main(int argc, const char* argv[])
+{
+	std::vector<char> qualifiers(kSimpleAudioDriverCustomPropertyCapacity * kSimpleAudioDriverCustomPropertyQualifierLength);
+	std::vector<char> values(kSimpleAudioDriverCustomPropertyCapacity * kSimpleAudioDriverCustomPropertyValueLength);
+	auto qualifier = [&](uint32_t in_index) { return &qualifiers[in_index * kSimpleAudioDriverCustomPropertyQualifierLength]; };
+	auto value = [&](uint32_t in_index) { return &values[in_index * kSimpleAudioDriverCustomPropertyValueLength]; };
+	for (uint32_t index = 0; index < kSimpleAudioDriverCustomPropertyCapacity; index++)
+	{
+		MakeQualifier(index, qualifier(index));
+		MakeValue(index, 0, value(index));
+	}
+
+	// Each round starts empty, so the inserts include allocating the chunks.
+	auto store = new SimpleAudioPropertyStore();
+	double insert_seconds = 0.0;
+	for (uint32_t round = 0; round < kBenchmarkRounds; round++)
+	{
+		if (round > 0)
+		{
+			store->Free();
+		}
+		store->Initialize();
+		auto start = HostToolsNow();
+		for (uint32_t index = 0; index < kSimpleAudioDriverCustomPropertyCapacity; index++)
+		{
+			store->Set(qualifier(index), value(index));
+		}
+		insert_seconds += HostToolsSecondsSince(start);
+	}
+	HostToolsCheck(store->GetCount() == kSimpleAudioDriverCustomPropertyCapacity, "the store holds %u pairs", store->GetCount());
+	HostToolsCheck(!store->Set("One-too-many", "Value"), "a full store took another pair");
+
+	double lookup_seconds = 0.0;
+	for (uint32_t round = 0; round < kBenchmarkRounds; round++)
+	{
+		auto start = HostToolsNow();
+		for (uint32_t index = 0; index < kSimpleAudioDriverCustomPropertyCapacity; index++)
+		{
+			auto found = store->Find(qualifier(index));
+			HostToolsCheck(found != nullptr && strcmp(found, value(index)) == 0, "couldn't find %s", qualifier(index));
+		}
+		lookup_seconds += HostToolsSecondsSince(start);
+	}
+	HostToolsCheck(store->Find("Missing") == nullptr, "found a qualifier that was never set");
+
+	double update_seconds = 0.0;
+	for (uint32_t round = 1; round <= kBenchmarkRounds; round++)
+	{
+		for (uint32_t index = 0; index < kSimpleAudioDriverCustomPropertyCapacity; index++)
+		{
+			MakeValue(index, round, value(index));
+		}
+		auto start = HostToolsNow();
+		for (uint32_t index = 0; index < kSimpleAudioDriverCustomPropertyCapacity; index++)
+		{
+			store->Set(qualifier(index), value(index));
+		}
+		update_seconds += HostToolsSecondsSince(start);
+	}
+	HostToolsCheck(store->GetCount() == kSimpleAudioDriverCustomPropertyCapacity, "updates added pairs; the store holds %u", store->GetCount());
+
+	std::vector<uint8_t> snapshot(store->GetSerializedSize());
+	auto start = HostToolsNow();
+	for (uint32_t i = 0; i < kBenchmarkSnapshots; i++)
+	{
+		HostToolsCheck(store->Serialize(snapshot.data(), snapshot.size()) == snapshot.size(), "the snapshot isn't the size the store reported");
+	}
+	auto snapshot_seconds = HostToolsSecondsSince(start);
+	CheckSnapshot(snapshot, kBenchmarkRounds);
+	HostToolsCheck(store->Serialize(snapshot.data(), snapshot.size() - 1) == 0, "the store serialized into a buffer too small for it");
+	auto allocated_bytes = store->GetAllocatedBytes();
+	store->Free();
+	delete store;
+
+	double operations = static_cast<double>(kBenchmarkRounds) * kSimpleAudioDriverCustomPropertyCapacity;
+	printf("Property store, %u pairs, %zu bytes plus %zu allocated\n", kSimpleAudioDriverCustomPropertyCapacity, sizeof(SimpleAudioPropertyStore), allocated_bytes);
+	printf("  %-8s %8.1f ns per pair\n", "insert", insert_seconds * 1e9 / operations);
+	printf("  %-8s %8.1f ns per pair\n", "lookup", lookup_seconds * 1e9 / operations);
+	printf("  %-8s %8.1f ns per pair\n", "update", update_seconds * 1e9 / operations);
+	printf("  %-8s %8.2f us for %zu bytes\n", "snapshot", snapshot_seconds * 1e6 / kBenchmarkSnapshots, snapshot.size());
+	return 0;
+}
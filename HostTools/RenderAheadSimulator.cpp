@@ -0,0 +1,181 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Runs the render-ahead producer against a simulated HAL, work queue, and
+			 I/O handler, and checks every input block the HAL would read.
+*/
+
+// Local Includes
+#include "SimpleAudioRenderAhead.h"
+#include "SimpleAudioToneGenerator.h"
+#include "HostToolsSupport.h"
+
+// System Includes
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define kSimulatorSampleRate 48000.0
+#define kSimulatorChannels 2
+#define kSimulatorBlockFrames 512
+#define kSimulatorRingFrames 16384
+#define kSimulatorStagingFrames 32768 // One timestamp period, as on the device.
+#define kSimulatorMarginFrames 4096
+#define kSimulatorBlocks 20000
+
+// The controls as the HAL sees them. Some changes come through the work
+// queue, which snapshots them for the producer right away, and some are
+// made by the HAL directly, which the producer only learns about when the
+// I/O handler asks for a new snapshot.
+struct SimulatedControls
+{
+	std::mutex	m_mutex;
+	uint32_t	m_data_source = 440;
+	float		m_volume = 1.0f;
+	
+	void Get(uint32_t& out_data_source, float& out_volume)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		out_data_source = m_data_source;
+		out_volume = m_volume;
+	}
+	
+	void Set(uint32_t in_data_source, float in_volume)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_data_source = in_data_source;
+		m_volume = in_volume;
+	}
+};
+
+int main(int argc, const char* argv[])
+{
+	std::vector<int16_t> staging(kSimulatorStagingFrames * kSimulatorChannels);
+	std::vector<int16_t> ring(kSimulatorRingFrames * kSimulatorChannels);
+	std::vector<int16_t> expected(kSimulatorBlockFrames * kSimulatorChannels);
+	
+	SimpleAudioRenderAhead render_ahead;
+	render_ahead.Initialize();
+	render_ahead.SetStaging(staging.data(), kSimulatorStagingFrames, kSimulatorChannels);
+	render_ahead.SetSampleRate(kSimulatorSampleRate);
+	
+	SimulatedControls controls;
+	auto snapshot_controls = [&]() {
+		uint32_t data_source = 0;
+		float volume = 0.0f;
+		controls.Get(data_source, volume);
+		render_ahead.SetControls(data_source, volume);
+	};
+	snapshot_controls();
+	HostToolsCheck(render_ahead.SetEnabled(true, kSimulatorMarginFrames), "couldn't enable render-ahead");
+	render_ahead.Reset();
+	
+	std::atomic<bool> done(false);
+	std::atomic<bool> snapshot_requested(false);
+	std::atomic<uint64_t> num_work_queue_changes(0);
+	std::atomic<uint64_t> num_hal_changes(0);
+	
+	// The work queue changes the controls now and then, and answers the
+	// producer's requests for a new snapshot.
+	std::thread work_queue([&]() {
+		std::mt19937 random(1);
+		const uint32_t data_sources[] = { 440, 660, 880 };
+		while (!done.load(std::memory_order_relaxed))
+		{
+			if (snapshot_requested.exchange(false))
+			{
+				snapshot_controls();
+			}
+			auto choice = random() % 64;
+			if (choice < 2)
+			{
+				controls.Set(data_sources[random() % 3], static_cast<float>(random() % 100) / 100.0f);
+				if (choice == 0)
+				{
+					snapshot_controls();
+					num_work_queue_changes++;
+				}
+				else
+				{
+					num_hal_changes++;
+				}
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	});
+	
+	// The producer wakes several times per margin, and sometimes stalls long
+	// enough that the read position it loads is several blocks stale.
+	std::thread producer([&]() {
+		std::mt19937 random(2);
+		while (!done.load(std::memory_order_relaxed))
+		{
+			if (render_ahead.TakeControlsRequest())
+			{
+				snapshot_requested.store(true);
+			}
+			render_ahead.Render();
+			auto stall = random() % 16 == 0 ? 2000 : 200;
+			std::this_thread::sleep_for(std::chrono::microseconds(stall));
+		}
+	});
+	
+	// The I/O handler renders each block itself unless the producer already
+	// has, then the simulated HAL checks what it reads. The block before it must
+	// still hold what the I/O handler wrote, since nothing else writes the ring.
+	uint64_t num_checked_samples = 0;
+	uint32_t previous_data_source = 0;
+	float previous_volume = 0.0f;
+	for (uint64_t block = 0; block < kSimulatorBlocks; block++)
+	{
+		uint64_t sample_time = block * kSimulatorBlockFrames;
+		uint32_t data_source = 0;
+		float volume = 0.0f;
+		controls.Get(data_source, volume);
+		
+		if (!render_ahead.Consume(data_source, volume, sample_time, kSimulatorBlockFrames, ring.data(), ring.size()))
+		{
+			SimpleAudioToneGenerator::Render(data_source, volume, kSimulatorSampleRate, sample_time, kSimulatorBlockFrames, false,
+											 ring.data(), ring.size(), sample_time, kSimulatorChannels);
+		}
+		
+		auto check_block = [&](uint64_t in_sample_time, uint32_t in_data_source, float in_volume) {
+			SimpleAudioToneGenerator::Render(in_data_source, in_volume, kSimulatorSampleRate, in_sample_time, kSimulatorBlockFrames, false,
+											 expected.data(), expected.size(), 0, kSimulatorChannels);
+			for (size_t i = 0; i < expected.size(); i++)
+			{
+				auto ring_index = (in_sample_time * kSimulatorChannels + i) % ring.size();
+				HostToolsCheck(ring[ring_index] == expected[i], "sample %zu of the block at %llu is %d, expected %d",
+							   i, static_cast<unsigned long long>(in_sample_time), ring[ring_index], expected[i]);
+			}
+			num_checked_samples += expected.size();
+		};
+		check_block(sample_time, data_source, volume);
+		if (block > 0)
+		{
+			check_block(sample_time - kSimulatorBlockFrames, previous_data_source, previous_volume);
+		}
+		previous_data_source = data_source;
+		previous_volume = volume;
+		
+		// Run at roughly 100 times real time.
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+	done.store(true);
+	work_queue.join();
+	producer.join();
+	
+	SimpleAudioDriverDeviceStatistics statistics = {};
+	render_ahead.GetStatistics(&statistics);
+	printf("Render-ahead: %u blocks, %llu work-queue changes, %llu HAL changes\n", kSimulatorBlocks,
+		   static_cast<unsigned long long>(num_work_queue_changes.load()), static_cast<unsigned long long>(num_hal_changes.load()));
+	printf("  hits %llu, misses %llu, minimum lead %lld frames, %llu samples checked\n",
+		   static_cast<unsigned long long>(statistics.m_render_ahead_hits), static_cast<unsigned long long>(statistics.m_render_ahead_misses),
+		   static_cast<long long>(statistics.m_render_ahead_min_lead_frames), static_cast<unsigned long long>(num_checked_samples));
+	HostToolsCheck(statistics.m_render_ahead_hits > statistics.m_render_ahead_misses, "the producer should cover most blocks");
+	return 0;
+}
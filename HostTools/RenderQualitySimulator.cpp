@@ -0,0 +1,128 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Drives the quality governor with the measured cost of each tier under a
+			 changing budget, and checks that it steps down and back up.
+*/
+
+// Local Includes
+#include "SimpleAudioRenderQuality.h"
+#include "SimpleAudioInsertChain.h"
+#include "SimpleAudioToneGenerator.h"
+#include "HostToolsSupport.h"
+
+// System Includes
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#define kSimulatorSampleRate 48000.0
+#define kSimulatorChannels 1 // The device's input stream is mono.
+#define kSimulatorBlockFrames 512
+#define kSimulatorRingFrames 32768
+#define kSimulatorToneFrequency 440.0
+#define kSimulatorMeasureBlocks 2000
+#define kSimulatorNumTiers (SimpleAudioDriverQualityTier_CheapOscillator + 1)
+
+struct SimulatorPhase
+{
+	const char*	m_name;
+	uint32_t	m_num_blocks;
+	double		m_budget_us; // What SetRenderBudget would leave a block.
+	uint32_t	m_final_tier;
+	uint32_t	m_max_changes;
+};
+
+// Renders one block the way the I/O handler does at the tier: the tone, then
+// the insert chain.
+static double MeasureTier(uint32_t in_tier)
+{
+	SimpleAudioInsertChain chain;
+	chain.Initialize();
+	chain.Prepare(kSimulatorChannels, kSimulatorSampleRate);
+	SimpleAudioDriverInsertChainConfig config = {};
+	config.m_dc_blocker_enabled = 1;
+	config.m_limiter_enabled = 1;
+	config.m_limiter_threshold_db = -1.0f;
+	config.m_limiter_release_ms = 50.0f;
+	for (uint32_t band = 0; band < kSimpleAudioDriverInsertChainMaxBands; band++)
+	{
+		config.m_bands[band].m_type = SimpleAudioDriverFilterType_Peak;
+		config.m_bands[band].m_frequency = 60.0f * powf(2.0f, static_cast<float>(band));
+		config.m_bands[band].m_gain_db = band % 2 == 0 ? 3.0f : -3.0f;
+		config.m_bands[band].m_q = 0.9f;
+	}
+	HostToolsCheck(chain.Configure(config), "couldn't configure the insert chain");
+
+	std::vector<int16_t> ring(kSimulatorRingFrames * kSimulatorChannels);
+	std::vector<double> costs;
+	for (uint64_t block = 0; block < kSimulatorMeasureBlocks; block++)
+	{
+		uint64_t sample_time = block * kSimulatorBlockFrames;
+		auto start = HostToolsNow();
+		SimpleAudioToneGenerator::Render(kSimulatorToneFrequency, 1.0f, kSimulatorSampleRate, sample_time, kSimulatorBlockFrames,
+										 in_tier >= SimpleAudioDriverQualityTier_CheapOscillator, ring.data(), ring.size(), sample_time, kSimulatorChannels);
+		chain.Process(ring.data(), ring.size(), sample_time, kSimulatorBlockFrames, in_tier >= SimpleAudioDriverQualityTier_BypassEqualizer);
+		costs.push_back(HostToolsSecondsSince(start) * 1e6);
+	}
+	std::sort(costs.begin(), costs.end());
+	return costs[costs.size() / 2];
+}
+
+int main(int argc, const char* argv[])
+{
+	static const char* const tier_names[kSimulatorNumTiers] = { "full", "bypass equalizer", "cheap oscillator" };
+	double costs[kSimulatorNumTiers];
+	for (uint32_t tier = 0; tier < kSimulatorNumTiers; tier++)
+	{
+		costs[tier] = MeasureTier(tier);
+		printf("%-16s %6.2f us per %u-frame block\n", tier_names[tier], costs[tier], kSimulatorBlockFrames);
+	}
+
+	// The phases are set against the measured costs, so the run behaves the
+	// same on any host: an idle budget, one no tier fits in, then idle again.
+	double idle_budget = costs[SimpleAudioDriverQualityTier_Full] / 0.1;
+	double overloaded_budget = std::min(costs[SimpleAudioDriverQualityTier_Full], costs[SimpleAudioDriverQualityTier_CheapOscillator]) / 0.9;
+	const SimulatorPhase phases[] = {
+		{ "idle", 2000, idle_budget, SimpleAudioDriverQualityTier_Full, 0 },
+		{ "overloaded", 400, overloaded_budget, SimpleAudioDriverQualityTier_CheapOscillator, 2 },
+		{ "recovered", 1200, idle_budget, SimpleAudioDriverQualityTier_Full, 2 },
+	};
+
+	// The measured costs, with a fixed seed for the block-to-block jitter.
+	std::mt19937 random(7);
+	std::uniform_real_distribution<double> jitter(0.8, 1.2);
+	SimpleAudioRenderQuality quality;
+	quality.Initialize();
+	uint64_t block = 0;
+	uint64_t last_change_block = 0;
+	double realtime_us = kSimulatorBlockFrames / kSimulatorSampleRate * 1e6;
+	for (const auto& phase : phases)
+	{
+		printf("%s: budget %.2f us, %.3f%% of real time\n", phase.m_name, phase.m_budget_us, 100.0 * phase.m_budget_us / realtime_us);
+		uint32_t num_changes = 0;
+		for (uint32_t i = 0; i < phase.m_num_blocks; i++, block++)
+		{
+			auto previous_tier = quality.GetTier();
+			auto load = static_cast<float>(costs[previous_tier] * jitter(random) / phase.m_budget_us);
+			if (!quality.Update(load))
+			{
+				continue;
+			}
+
+			auto tier = quality.GetTier();
+			printf("  block %5llu: %s -> %s, smoothed load %.0f%%\n", static_cast<unsigned long long>(block),
+				   tier_names[previous_tier], tier_names[tier], 100.0f * quality.GetLoad());
+			HostToolsCheck(block - last_change_block >= (tier > previous_tier ? kQualitySettleBlocks : kQualityRecoverBlocks) || last_change_block == 0,
+						   "tier changed %llu blocks after the last change", static_cast<unsigned long long>(block - last_change_block));
+			last_change_block = block;
+			num_changes++;
+		}
+
+		HostToolsCheck(quality.GetTier() == phase.m_final_tier, "the %s phase ended at tier %u", phase.m_name, quality.GetTier());
+		HostToolsCheck(num_changes <= phase.m_max_changes, "the %s phase changed tier %u times", phase.m_name, num_changes);
+	}
+	return 0;
+}
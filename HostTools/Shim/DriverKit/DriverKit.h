@@ -0,0 +1,65 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The small part of DriverKit that the driver's portable helpers use, so the
+			 host tools can build them outside of DriverKit.
+*/
+
+#ifndef HostToolsDriverKit_h
+#define HostToolsDriverKit_h
+
+#include <DriverKit/IOReturn.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#ifndef NSEC_PER_SEC
+#define NSEC_PER_SEC 1000000000ull
+#endif
+
+// Host time is in nanoseconds, so the timebase is one to one.
+struct mach_timebase_info
+{
+	uint32_t numer;
+	uint32_t denom;
+};
+
+inline int mach_timebase_info(struct mach_timebase_info* out_info)
+{
+	out_info->numer = 1;
+	out_info->denom = 1;
+	return 0;
+}
+
+inline uint64_t mach_absolute_time()
+{
+	struct timespec now = {};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return static_cast<uint64_t>(now.tv_sec) * NSEC_PER_SEC + static_cast<uint64_t>(now.tv_nsec);
+}
+
+// The helpers that allocate on first use zero their memory the way IONewZero does.
+#define IONewZero(type, count) static_cast<type*>(calloc((count), sizeof(type)))
+#define IOSafeDeleteNULL(ptr, type, count) do { free(ptr); (ptr) = nullptr; } while (0)
+
+// glibc has strlcpy from 2.38 on.
+#if !defined(__APPLE__) && !(defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 38)))
+inline size_t strlcpy(char* out_dst, const char* in_src, size_t in_size)
+{
+	size_t length = strlen(in_src);
+	if (in_size > 0)
+	{
+		size_t count = length < in_size - 1 ? length : in_size - 1;
+		memcpy(out_dst, in_src, count);
+		out_dst[count] = 0;
+	}
+	return length;
+}
+#endif
+
+#endif /* HostToolsDriverKit_h */
@@ -0,0 +1,26 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The DriverKit return codes that the driver's portable helpers use.
+*/
+
+#ifndef HostToolsIOReturn_h
+#define HostToolsIOReturn_h
+
+typedef int kern_return_t;
+
+#define kIOReturnSuccess			0
+#define kIOReturnError				((kern_return_t)0xe00002bc)
+#define kIOReturnNoMemory			((kern_return_t)0xe00002bd)
+#define kIOReturnNoResources		((kern_return_t)0xe00002be)
+#define kIOReturnBadArgument		((kern_return_t)0xe00002c2)
+#define kIOReturnExclusiveAccess	((kern_return_t)0xe00002c5)
+#define kIOReturnUnsupported		((kern_return_t)0xe00002c7)
+#define kIOReturnNotOpen			((kern_return_t)0xe00002cd)
+#define kIOReturnNotReady			((kern_return_t)0xe00002d8)
+#define kIOReturnNotFound			((kern_return_t)0xe00002f0)
+#define kIOReturnNoSpace			((kern_return_t)0xe00002c3)
+#define kIOReturnOverrun			((kern_return_t)0xe00002e8)
+
+#endif /* HostToolsIOReturn_h */
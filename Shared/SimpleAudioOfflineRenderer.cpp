@@ -0,0 +1,224 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The implementation of the offline renderer, which runs the device's tone
+			 generator faster than real time and streams the result to a file.
+*/
+
+// Self Include
+#include "SimpleAudioOfflineRenderer.h"
+
+// Local Includes
+#include "../SimpleAudioDriverExtension/SimpleAudioToneGenerator.h"
+
+// System Includes
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define kOfflineRenderDefaultChunkBlocks 256
+#define kOfflineRenderChunksPerThread 2 // Chunk buffers per thread, so threads don't wait on the file.
+
+// The checksum adds up a hash of each sample mixed with its frame and channel,
+// so chunks can hash their own samples and the sum doesn't depend on how the
+// timeline was split.
+static inline uint64_t ChecksumSample(uint64_t in_position, int16_t in_sample)
+{
+	uint64_t value = (in_position * 0x9E3779B97F4A7C15ull) ^ static_cast<uint16_t>(in_sample);
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+	return value ^ (value >> 31);
+}
+
+static inline void WriteLittleEndian(uint8_t* out_bytes, uint32_t in_value, size_t in_num_bytes)
+{
+	for (size_t i = 0; i < in_num_bytes; i++)
+	{
+		out_bytes[i] = static_cast<uint8_t>(in_value >> (8 * i));
+	}
+}
+
+bool SimpleAudioOfflineRenderer::WriteWAVHeader(FILE* in_file, const SimpleAudioOfflineRenderConfig& in_config)
+{
+	uint32_t bytes_per_frame = in_config.m_num_channels * sizeof(int16_t);
+	uint32_t data_size = static_cast<uint32_t>(in_config.m_num_frames * bytes_per_frame);
+	uint8_t header[44];
+	memcpy(header, "RIFF", 4);
+	WriteLittleEndian(header + 4, 36 + data_size, 4);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	WriteLittleEndian(header + 16, 16, 4);
+	WriteLittleEndian(header + 20, 1, 2); // Integer PCM.
+	WriteLittleEndian(header + 22, in_config.m_num_channels, 2);
+	WriteLittleEndian(header + 24, static_cast<uint32_t>(in_config.m_sample_rate), 4);
+	WriteLittleEndian(header + 28, static_cast<uint32_t>(in_config.m_sample_rate) * bytes_per_frame, 4);
+	WriteLittleEndian(header + 32, bytes_per_frame, 2);
+	WriteLittleEndian(header + 34, 16, 2);
+	memcpy(header + 36, "data", 4);
+	WriteLittleEndian(header + 40, data_size, 4);
+	return fwrite(header, sizeof(header), 1, in_file) == 1;
+}
+
+/// - Tag: RenderChunk
+uint64_t SimpleAudioOfflineRenderer::RenderChunk(const SimpleAudioOfflineRenderConfig& in_config,
+												 uint64_t in_chunk_index,
+												 uint64_t in_chunk_frames,
+												 int16_t* out_samples,
+												 uint64_t* out_num_frames)
+{
+	// The chunk starts on a block boundary, so rendering it block by block
+	// starts every block at the sample time the device would.
+	auto first_frame = in_chunk_index * in_chunk_frames;
+	auto num_frames = std::min(in_chunk_frames, in_config.m_num_frames - first_frame);
+	auto chunk_length = in_chunk_frames * in_config.m_num_channels;
+	for (uint64_t offset = 0; offset < num_frames; offset += in_config.m_block_frames)
+	{
+		auto block_frames = std::min<uint64_t>(in_config.m_block_frames, num_frames - offset);
+		SimpleAudioToneGenerator::Render(in_config.m_tone_frequency, in_config.m_volume, in_config.m_sample_rate,
+										 in_config.m_start_sample_time + first_frame + offset, block_frames,
+										 in_config.m_cheap_oscillator, out_samples, chunk_length, offset, in_config.m_num_channels);
+	}
+
+	uint64_t checksum = 0;
+	auto first_position = first_frame * in_config.m_num_channels;
+	for (uint64_t i = 0; i < num_frames * in_config.m_num_channels; i++)
+	{
+		checksum += ChecksumSample(first_position + i, out_samples[i]);
+	}
+	*out_num_frames = num_frames;
+	return checksum;
+}
+
+/// - Tag: OfflineRender
+bool SimpleAudioOfflineRenderer::Render(const SimpleAudioOfflineRenderConfig& in_config,
+										const char* in_path,
+										SimpleAudioOfflineRenderResult* out_result)
+{
+	if (out_result == nullptr || in_config.m_num_channels == 0 || in_config.m_sample_rate <= 0.0 ||
+		in_config.m_block_frames == 0 || in_config.m_num_frames == 0)
+	{
+		return false;
+	}
+	memset(out_result, 0, sizeof(*out_result));
+
+	// A WAV file can't describe more than 4 GiB of samples; use a raw file for longer renders.
+	if (in_config.m_file_type == SimpleAudioOfflineRenderFileType_WAV &&
+		in_config.m_num_frames * in_config.m_num_channels * sizeof(int16_t) > UINT32_MAX - 36)
+	{
+		return false;
+	}
+
+	uint64_t chunk_blocks = in_config.m_chunk_blocks != 0 ? in_config.m_chunk_blocks : kOfflineRenderDefaultChunkBlocks;
+	uint64_t chunk_frames = chunk_blocks * in_config.m_block_frames;
+	uint64_t num_chunks = (in_config.m_num_frames + chunk_frames - 1) / chunk_frames;
+	uint64_t num_threads = in_config.m_num_threads != 0 ? in_config.m_num_threads : std::max(1u, std::thread::hardware_concurrency());
+	num_threads = std::min(num_threads, num_chunks);
+	uint64_t num_slots = num_threads * kOfflineRenderChunksPerThread;
+
+	auto start_time = std::chrono::steady_clock::now();
+
+	FILE* file = nullptr;
+	if (in_path != nullptr)
+	{
+		file = fopen(in_path, "wb");
+		if (file == nullptr)
+		{
+			return false;
+		}
+		if (in_config.m_file_type == SimpleAudioOfflineRenderFileType_WAV && !WriteWAVHeader(file, in_config))
+		{
+			fclose(file);
+			return false;
+		}
+	}
+
+	// A chunk goes in slot (chunk % num_slots), once the chunk that used the
+	// slot before it is in the file.
+	std::vector<std::vector<int16_t>> slot_samples(num_slots, std::vector<int16_t>(chunk_frames * in_config.m_num_channels));
+	std::vector<uint64_t> slot_frames(num_slots, 0);
+	std::vector<uint64_t> slot_checksums(num_slots, 0);
+	std::vector<int64_t> slot_chunks(num_slots, -1);
+	std::atomic<uint64_t> next_chunk(0);
+	uint64_t chunks_written = 0;
+	bool failed = false;
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	auto render_chunks = [&]() {
+		while (true)
+		{
+			auto chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+			if (chunk >= num_chunks)
+			{
+				break;
+			}
+			auto slot = chunk % num_slots;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [&]() { return failed || chunks_written + num_slots > chunk; });
+				if (failed)
+				{
+					break;
+				}
+			}
+
+			auto checksum = RenderChunk(in_config, chunk, chunk_frames, slot_samples[slot].data(), &slot_frames[slot]);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				slot_checksums[slot] = checksum;
+				slot_chunks[slot] = static_cast<int64_t>(chunk);
+			}
+			condition.notify_all();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (uint64_t i = 0; i < num_threads; i++)
+	{
+		threads.emplace_back(render_chunks);
+	}
+
+	// Write the chunks in order as they complete.
+	for (uint64_t chunk = 0; chunk < num_chunks && !failed; chunk++)
+	{
+		auto slot = chunk % num_slots;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [&]() { return slot_chunks[slot] == static_cast<int64_t>(chunk); });
+		}
+
+		auto num_samples = slot_frames[slot] * in_config.m_num_channels;
+		bool written = file == nullptr || fwrite(slot_samples[slot].data(), sizeof(int16_t), num_samples, file) == num_samples;
+		out_result->m_frames_written += slot_frames[slot];
+		out_result->m_checksum += slot_checksums[slot];
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			failed = !written;
+			chunks_written = chunk + 1;
+		}
+		condition.notify_all();
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	if (file != nullptr && fclose(file) != 0)
+	{
+		failed = true;
+	}
+
+	out_result->m_render_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	out_result->m_num_threads = static_cast<uint32_t>(num_threads);
+	out_result->m_num_chunks = static_cast<uint32_t>(num_chunks);
+	if (out_result->m_render_seconds > 0.0)
+	{
+		out_result->m_speedup = (static_cast<double>(out_result->m_frames_written) / in_config.m_sample_rate) / out_result->m_render_seconds;
+	}
+	return !failed;
+}
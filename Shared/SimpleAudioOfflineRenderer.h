@@ -0,0 +1,76 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Headers for the offline renderer, which runs the device's tone generator
+			 faster than real time and streams the result to a file.
+*/
+
+#ifndef SimpleAudioOfflineRenderer_h
+#define SimpleAudioOfflineRenderer_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+enum SimpleAudioOfflineRenderFileType
+{
+	SimpleAudioOfflineRenderFileType_Raw, // Interleaved 16-bit samples in host byte order, with no header.
+	SimpleAudioOfflineRenderFileType_WAV,
+};
+
+struct SimpleAudioOfflineRenderConfig
+{
+	double		m_tone_frequency; // A data source value, as the device uses it.
+	float		m_volume;
+	double		m_sample_rate;
+	uint32_t	m_num_channels;
+	uint64_t	m_start_sample_time;
+	uint64_t	m_num_frames;
+	uint32_t	m_block_frames; // The I/O buffer size the device renders blocks at.
+	bool		m_cheap_oscillator;
+	uint32_t	m_chunk_blocks; // Blocks in each chunk a thread renders, or 0 for a default.
+	uint32_t	m_num_threads; // 0 uses every core, and 1 renders serially.
+	uint32_t	m_file_type;
+};
+
+struct SimpleAudioOfflineRenderResult
+{
+	uint64_t	m_frames_written;
+	uint32_t	m_num_threads;
+	uint32_t	m_num_chunks;
+	double		m_render_seconds; // Wall-clock time, including writing the file.
+	double		m_speedup; // Seconds of audio rendered per second of wall-clock time.
+	uint64_t	m_checksum; // A hash of every sample and its position, to compare renders.
+};
+
+// The renderer splits the timeline into chunks of whole device blocks. Each
+// chunk starts at its own sample time, which is all the state the generator
+// carries from one block to the next, so the threads render chunks
+// independently and the output is bit-identical to a serial render with the
+// same block size. The thread that called Render writes chunks to the file in
+// order as they complete, and a bounded set of chunk buffers keeps memory flat
+// however long the render is.
+//
+// The renderer only uses the C++ standard library and the generator, so it
+// builds and runs on any host, not just the app.
+class SimpleAudioOfflineRenderer
+{
+public:
+	// Pass a null path to render and checksum without writing a file.
+	static bool		Render(const SimpleAudioOfflineRenderConfig& in_config,
+						   const char* in_path,
+						   SimpleAudioOfflineRenderResult* out_result);
+
+private:
+	static bool		WriteWAVHeader(FILE* in_file, const SimpleAudioOfflineRenderConfig& in_config);
+
+	// Returns the chunk's share of the checksum.
+	static uint64_t	RenderChunk(const SimpleAudioOfflineRenderConfig& in_config,
+								uint64_t in_chunk_index,
+								uint64_t in_chunk_frames,
+								int16_t* out_samples,
+								uint64_t* out_num_frames);
+};
+
+#endif /* SimpleAudioOfflineRenderer_h */
@@ -11,7 +11,31 @@ The Objective-C/Swift bridging header, which manages communications
 @interface SimpleAudioUserClient : NSObject
 
 - (NSString*) open;
+- (NSString*) close;
 - (NSString*) toggleDataSource;
+- (NSString*) toggleDataSourceAsync:(void (^)(NSString* result))completion;
 - (NSString*) toggleRate;
+- (NSString*) enqueueInputVolume:(float)volume;
+- (NSString*) enqueueDataSource:(uint32_t)dataSource;
+- (NSString*) ringCommandDoorbell;
+- (NSString*) setRenderAhead:(BOOL)enabled marginFrames:(uint32_t)marginFrames;
+- (NSString*) deviceStatistics;
+- (NSString*) setInsertBand:(uint32_t)band type:(uint32_t)type frequency:(float)frequency gainDb:(float)gainDb q:(float)q;
+- (NSString*) setDCBlockerEnabled:(BOOL)enabled;
+- (NSString*) setLimiterEnabled:(BOOL)enabled thresholdDb:(float)thresholdDb releaseMs:(float)releaseMs;
+- (NSString*) controlTraceSummary;
+- (NSString*) setIORecording:(BOOL)enabled;
+- (NSString*) drainIOTraceToFile:(NSString*)path;
+- (NSString*) setRenderBudget:(uint32_t)budgetPercent;
+- (NSString*) scheduleInputVolume:(float)volume atSampleTime:(uint64_t)sampleTime;
+- (NSString*) scheduleDataSource:(uint32_t)dataSource atSampleTime:(uint64_t)sampleTime;
+- (NSString*) clearAutomation;
+- (NSString*) connectCable:(NSString*)name from:(uint32_t)sourceDevice to:(uint32_t)destinationDevice latencyFrames:(uint32_t)latencyFrames;
+- (NSString*) disconnectCable:(uint32_t)cableIndex;
+- (NSString*) cableStatus;
+- (NSString*) setCustomPropertyValues:(NSDictionary<NSString*, NSString*>*)values;
+- (NSString*) setLazyStreamMemory:(BOOL)enabled idleMs:(uint32_t)idleMs;
+- (NSString*) memoryUsage;
+- (NSString*) renderOfflineToFile:(NSString*)path dataSource:(uint32_t)dataSource volume:(float)volume seconds:(double)seconds blockFrames:(uint32_t)blockFrames;
 
 @end
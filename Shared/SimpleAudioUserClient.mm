@@ -8,11 +8,17 @@ The implementation of the Objective-C bridging class, which manages
 
 #import "SimpleAudioUserClient.h"
 #import "SimpleAudioDriverKeys.h"
+#import "SimpleAudioOfflineRenderer.h"
+#import "../SimpleAudioDriverExtension/SimpleAudioCommandQueue.h"
+#import <algorithm>
+#import <vector>
 
 @interface SimpleAudioUserClient()
 @property IONotificationPortRef mIOKitNotificationPort;
 @property io_object_t ioObject;
 @property io_connect_t ioConnection;
+@property SimpleAudioDriverCommandQueue* commandQueue;
+@property SimpleAudioDriverInsertChainConfig insertChainConfig;
 @end
 
 @implementation SimpleAudioUserClient
@@ -22,6 +28,55 @@ The implementation of the Objective-C bridging class, which manages
 #import <CoreAudio/AudioServerPlugIn.h>
 #import <vector>
 
+// Reads the snapshot property and parses it into a dictionary of every
+// qualifier and value pair, or returns nil if the device doesn't have it.
+- (NSDictionary<NSString*, NSString*>*)customPropertySnapshot:(AudioObjectID)deviceID
+{
+	AudioObjectPropertyAddress prop_addr = {kSimpleAudioDriverCustomPropertySnapshotSelector, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMain};
+	CFStringRef qualifier = CFSTR(kSimpleAudioDriverCustomPropertySnapshotQualifier);
+	CFPropertyListRef snapshot_data = nullptr;
+	UInt32 the_size = sizeof(CFPropertyListRef);
+	OSStatus err = AudioObjectGetPropertyData(deviceID, &prop_addr, sizeof(CFStringRef), &qualifier, &the_size, &snapshot_data);
+	if (err || snapshot_data == nullptr)
+	{
+		return nil;
+	}
+	NSData* blob = (__bridge_transfer NSData*)snapshot_data;
+	if (![blob isKindOfClass:[NSData class]] || blob.length < sizeof(SimpleAudioDriverCustomPropertySnapshotHeader))
+	{
+		return nil;
+	}
+	
+	auto bytes = static_cast<const uint8_t*>(blob.bytes);
+	SimpleAudioDriverCustomPropertySnapshotHeader header = {};
+	memcpy(&header, bytes, sizeof(header));
+	NSMutableDictionary<NSString*, NSString*>* pairs = [NSMutableDictionary dictionaryWithCapacity:header.m_num_entries];
+	size_t offset = sizeof(header);
+	for (uint32_t index = 0; index < header.m_num_entries; index++)
+	{
+		SimpleAudioDriverCustomPropertyRecord record = {};
+		if (offset + sizeof(record) > blob.length)
+		{
+			return nil;
+		}
+		memcpy(&record, bytes + offset, sizeof(record));
+		offset += sizeof(record);
+		if (offset + record.m_qualifier_length + record.m_value_length > blob.length)
+		{
+			return nil;
+		}
+		NSString* pair_qualifier = [[NSString alloc] initWithBytes:bytes + offset length:record.m_qualifier_length encoding:NSUTF8StringEncoding];
+		offset += record.m_qualifier_length;
+		NSString* pair_value = [[NSString alloc] initWithBytes:bytes + offset length:record.m_value_length encoding:NSUTF8StringEncoding];
+		offset += record.m_value_length;
+		if (pair_qualifier != nil && pair_value != nil)
+		{
+			pairs[pair_qualifier] = pair_value;
+		}
+	}
+	return pairs;
+}
+
 // The CoreAudio framework and custom property API is only available in macOS.
 // Validate the device's custom properties by checking the data types, selector,
 // qualifier, and data value.
@@ -58,23 +113,30 @@ The implementation of the Objective-C bridging class, which manages
 		}
 		num_items = out_size / sizeof(AudioServerPlugInCustomPropertyInfo);
 		custom_prop_list.resize(num_items);
-		if (num_items != 1)
+		if (num_items != 2)
 		{
-			throw std::runtime_error("Should only have one custom property on the SimpleAudioDevice");
+			throw std::runtime_error("Should have the custom property and its snapshot on the SimpleAudioDevice");
 		}
 		
-		AudioServerPlugInCustomPropertyInfo custom_prop_info = custom_prop_list.front();
-		if (custom_prop_info.mSelector != kSimpleAudioDriverCustomPropertySelector)
-		{
-			throw std::runtime_error("Custom property selector is incorrect");
-		}
-		if (custom_prop_info.mQualifierDataType != kAudioServerPlugInCustomPropertyDataTypeCFString)
-		{
-			throw std::runtime_error("Custom property qualifier type is incorrect");
-		}
-		if (custom_prop_info.mPropertyDataType != kAudioServerPlugInCustomPropertyDataTypeCFString)
+		for (const auto& custom_prop_info : custom_prop_list)
 		{
-			throw std::runtime_error("Custom property data type is incorrect");
+			auto expected_data_type = kAudioServerPlugInCustomPropertyDataTypeCFString;
+			if (custom_prop_info.mSelector == kSimpleAudioDriverCustomPropertySnapshotSelector)
+			{
+				expected_data_type = kAudioServerPlugInCustomPropertyDataTypeCFPropertyList;
+			}
+			else if (custom_prop_info.mSelector != kSimpleAudioDriverCustomPropertySelector)
+			{
+				throw std::runtime_error("Custom property selector is incorrect");
+			}
+			if (custom_prop_info.mQualifierDataType != kAudioServerPlugInCustomPropertyDataTypeCFString)
+			{
+				throw std::runtime_error("Custom property qualifier type is incorrect");
+			}
+			if (custom_prop_info.mPropertyDataType != expected_data_type)
+			{
+				throw std::runtime_error("Custom property data type is incorrect");
+			}
 		}
 
 		std::vector<std::pair<CFStringRef, CFStringRef>> custom_prop_qualifier_data_pair = {
@@ -82,22 +144,25 @@ The implementation of the Objective-C bridging class, which manages
 			{ CFSTR(kSimpleAudioDriverCustomPropertyQualifier1), CFSTR(kSimpleAudioDriverCustomPropertyDataValue1) },
 		};
 		
-		prop_addr = { custom_prop_info.mSelector, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMain };
+		// Read every pair in one round trip through the snapshot, rather than
+		// one call per qualifier.
+		NSDictionary<NSString*, NSString*>* snapshot = [self customPropertySnapshot:device_id];
+		if (snapshot == nil)
+		{
+			throw std::runtime_error("Error getting custom property snapshot");
+		}
 		for (const auto &[qualifier, data] : custom_prop_qualifier_data_pair)
 		{
-			CFStringRef custom_prop_data = nullptr;
-			UInt32 the_size = sizeof(CFStringRef);
-			err = AudioObjectGetPropertyData(device_id, &prop_addr, sizeof(CFStringRef), &qualifier, &the_size, &custom_prop_data);
-			if (err)
+			NSString* custom_prop_data = snapshot[(__bridge NSString*)qualifier];
+			if (custom_prop_data == nil)
 			{
-				throw std::runtime_error("Error getting custom property value");
+				throw std::runtime_error("Custom property qualifier is missing");
 			}
-			CFComparisonResult compare_result = CFStringCompare(data, custom_prop_data, kCFCompareCaseInsensitive);
+			CFComparisonResult compare_result = CFStringCompare(data, (__bridge CFStringRef)custom_prop_data, kCFCompareCaseInsensitive);
 			if (compare_result != kCFCompareEqualTo)
 			{
 				throw std::runtime_error("Custom property data is incorrect");
 			}
-			CFRelease(custom_prop_data);
 		}
 	}
 	catch(...)
@@ -133,6 +198,16 @@ The implementation of the Objective-C bridging class, which manages
 			theKernelError = IOServiceOpen(_ioObject, mach_task_self(), 0, &_ioConnection);
 			if (theKernelError == kIOReturnSuccess)
 			{
+				// Map the driver's command queue so that commands can be enqueued
+				// without a call into the driver for each one.
+				mach_vm_address_t theAddress = 0;
+				mach_vm_size_t theSize = 0;
+				theKernelError = IOConnectMapMemory64(_ioConnection, kSimpleAudioDriverCommandQueueMemoryType, mach_task_self(), &theAddress, &theSize, kIOMapAnywhere);
+				if (theKernelError == kIOReturnSuccess && theSize >= sizeof(SimpleAudioDriverCommandQueue))
+				{
+					_commandQueue = reinterpret_cast<SimpleAudioDriverCommandQueue*>(theAddress);
+				}
+				
 #if TARGET_OS_OSX
 				OSStatus error = [self checkDeviceCustomProperties];
 				if (error)
@@ -154,6 +229,44 @@ The implementation of the Objective-C bridging class, which manages
 	return @"User client is already connected";
 }
 
+// Close the user client instance, and unmap the command queue first so the
+// driver can release it.
+- (NSString*) close
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"User client is not connected";
+	}
+	
+	kern_return_t unmapError = kIOReturnSuccess;
+	if (_commandQueue != nullptr)
+	{
+		unmapError = IOConnectUnmapMemory64(_ioConnection, kSimpleAudioDriverCommandQueueMemoryType, mach_task_self(),
+											reinterpret_cast<mach_vm_address_t>(_commandQueue));
+		_commandQueue = nullptr;
+	}
+	if (_mIOKitNotificationPort != nullptr)
+	{
+		IONotificationPortDestroy(_mIOKitNotificationPort);
+		_mIOKitNotificationPort = nullptr;
+	}
+	IOServiceClose(_ioConnection);
+	IOObjectRelease(_ioObject);
+	_ioConnection = IO_OBJECT_NULL;
+	_ioObject = IO_OBJECT_NULL;
+	
+	if (unmapError != kIOReturnSuccess)
+	{
+		return [NSString stringWithFormat:@"Closed user client, but failed to unmap the command queue, error:%u.", unmapError];
+	}
+	return @"Closed user client connection";
+}
+
+- (void) dealloc
+{
+	[self close];
+}
+
 // Instructs the user client to toggle the driver's data source,
 // which changes the generated sine tone's frequency or goes into loopback mode.
 - (NSString*)toggleDataSource
@@ -176,6 +289,54 @@ The implementation of the Objective-C bridging class, which manages
 	return @"Successfully toggle the data source";
 }
 
+// The driver calls this through the notification port when an asynchronous
+// operation finishes. The reference holds the caller's completion block.
+static void ControlOperationCompleted(void* in_refcon, IOReturn in_result, void** in_args, uint32_t in_num_args)
+{
+	void (^completion)(IOReturn) = (__bridge_transfer void (^)(IOReturn))in_refcon;
+	completion(in_result);
+}
+
+// Toggles the data source without waiting for the driver. The call returns as
+// soon as the driver has queued the operation, and the completion runs on the
+// main queue with the result.
+- (NSString*)toggleDataSourceAsync:(void (^)(NSString* result))completion
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot toggle data source since user client is not connected";
+	}
+	if (_mIOKitNotificationPort == nullptr)
+	{
+		_mIOKitNotificationPort = IONotificationPortCreate(kIOMainPortDefault);
+		if (_mIOKitNotificationPort == nullptr)
+		{
+			return @"Failed to create the notification port";
+		}
+		IONotificationPortSetDispatchQueue(_mIOKitNotificationPort, dispatch_get_main_queue());
+	}
+	
+	void (^on_result)(IOReturn) = ^(IOReturn in_result) {
+		completion(in_result == kIOReturnSuccess ? @"Successfully toggle the data source" :
+				   [NSString stringWithFormat:@"Failed to toggle data source, error:%u.", in_result]);
+	};
+	uint64_t async_reference[kOSAsyncRef64Count] = {};
+	async_reference[kIOAsyncCalloutFuncIndex] = reinterpret_cast<uint64_t>(ControlOperationCompleted);
+	async_reference[kIOAsyncCalloutRefconIndex] = reinterpret_cast<uint64_t>((__bridge_retained void*)on_result);
+	kern_return_t error = IOConnectCallAsyncScalarMethod(_ioConnection,
+														 static_cast<uint32_t>(SimpleAudioDriverExternalMethod_ToggleDataSource),
+														 IONotificationPortGetMachPort(_mIOKitNotificationPort),
+														 async_reference, kOSAsyncRef64Count,
+														 nullptr, 0, nullptr, nullptr);
+	if (error != kIOReturnSuccess)
+	{
+		// The driver didn't queue the operation, so the completion never runs.
+		CFBridgingRelease(reinterpret_cast<void*>(async_reference[kIOAsyncCalloutRefconIndex]));
+		return [NSString stringWithFormat:@"Failed to toggle data source, error:%u.", error];
+	}
+	return @"Toggling the data source";
+}
+
 // Instructs the user client to perform a configuration change, which toggles
 // the device's sample rate.
 - (NSString*)toggleRate
@@ -196,4 +357,624 @@ The implementation of the Objective-C bridging class, which manages
 	}
 	return @"Successfully toggle the device sample rate";
 }
+
+// Enqueues a change to the input volume, as a scalar value from 0.0 to 1.0.
+- (NSString*)enqueueInputVolume:(float)volume
+{
+	if (_commandQueue == nullptr)
+	{
+		return @"Cannot enqueue input volume since the command queue is not mapped";
+	}
+	
+	SimpleAudioDriverCommandSlot argument = {};
+	argument.m_argument.m_scalar = volume;
+	if (!SimpleAudioCommandQueue::Enqueue(_commandQueue, SimpleAudioDriverCommand_SetInputVolume, argument))
+	{
+		return @"Failed to enqueue input volume, the command queue is full";
+	}
+	return @"Successfully enqueued the input volume";
+}
+
+// Enqueues a change to the input data source, which selects a sine tone frequency or loopback.
+- (NSString*)enqueueDataSource:(uint32_t)dataSource
+{
+	if (_commandQueue == nullptr)
+	{
+		return @"Cannot enqueue data source since the command queue is not mapped";
+	}
+	
+	SimpleAudioDriverCommandSlot argument = {};
+	argument.m_argument.m_value = dataSource;
+	if (!SimpleAudioCommandQueue::Enqueue(_commandQueue, SimpleAudioDriverCommand_SetDataSource, argument))
+	{
+		return @"Failed to enqueue data source, the command queue is full";
+	}
+	return @"Successfully enqueued the data source";
+}
+
+// Asks the driver to apply every command enqueued so far in a single call.
+- (NSString*)ringCommandDoorbell
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot ring the command doorbell since user client is not connected";
+	}
+	
+	uint64_t numApplied = 0;
+	uint32_t outputCount = 1;
+	kern_return_t error = IOConnectCallMethod(_ioConnection,
+											  static_cast<uint64_t>(SimpleAudioDriverExternalMethod_RingCommandDoorbell),
+											  nullptr, 0, nullptr, 0, &numApplied, &outputCount, nullptr, 0);
+	if (error != kIOReturnSuccess)
+	{
+		return [NSString stringWithFormat:@"Failed to apply queued commands, error:%u.", error];
+	}
+	return [NSString stringWithFormat:@"Successfully applied %llu queued commands", numApplied];
+}
+
+// Turns on render-ahead, which synthesizes generated input on a worker queue
+// the given number of frames ahead of the HAL, or turns it off.
+- (NSString*)setRenderAhead:(BOOL)enabled marginFrames:(uint32_t)marginFrames
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot set render-ahead since user client is not connected";
+	}
+	
+	const uint64_t input[2] = { enabled ? 1ULL : 0ULL, marginFrames };
+	kern_return_t error = IOConnectCallMethod(_ioConnection,
+											  static_cast<uint64_t>(SimpleAudioDriverExternalMethod_SetRenderAhead),
+											  input, 2, nullptr, 0, nullptr, nullptr, nullptr, 0);
+	if (error != kIOReturnSuccess)
+	{
+		return [NSString stringWithFormat:@"Failed to set render-ahead, error:%u.", error];
+	}
+	return enabled ? @"Successfully enabled render-ahead" : @"Successfully disabled render-ahead";
+}
+
+// Reads back the device's statistics and formats them for display.
+- (NSString*)deviceStatistics
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot get device statistics since user client is not connected";
+	}
+	
+	SimpleAudioDriverDeviceStatistics statistics = {};
+	size_t statisticsSize = sizeof(statistics);
+	kern_return_t error = IOConnectCallStructMethod(_ioConnection,
+													static_cast<uint64_t>(SimpleAudioDriverExternalMethod_GetDeviceStatistics),
+													nullptr, 0, &statistics, &statisticsSize);
+	if (error != kIOReturnSuccess)
+	{
+		return [NSString stringWithFormat:@"Failed to get device statistics, error:%u.", error];
+	}
+	NSMutableString* summary = [NSMutableString stringWithFormat:@"Render-ahead hits:%llu misses:%llu lead:%lld min lead:%lld",
+								statistics.m_render_ahead_hits, statistics.m_render_ahead_misses,
+								statistics.m_render_ahead_lead_frames, statistics.m_render_ahead_min_lead_frames];
+	[summary appendFormat:@"\nLoopback %@, copied frames:%llu mode changes:%u",
+	 statistics.m_loopback_zero_copy ? @"zero-copy" : @"copying",
+	 statistics.m_loopback_copied_frames, statistics.m_loopback_mode_changes];
+	[summary appendFormat:@"\nRender load:%u%% peak:%u%% quality tier:%u tier changes:%u",
+	 statistics.m_render_load_percent, statistics.m_render_peak_load_percent,
+	 statistics.m_quality_tier, statistics.m_quality_tier_changes];
+	[summary appendFormat:@"\nAutomation events applied:%u late:%u",
+	 statistics.m_automation_events_applied, statistics.m_automation_events_late];
+	[summary appendFormat:@"\nTimestamp timer wakes:%llu mean lateness:%lluns max:%uns",
+	 statistics.m_zts_timer_count,
+	 statistics.m_zts_timer_count != 0 ? statistics.m_zts_timer_total_lateness_ns / statistics.m_zts_timer_count : 0,
+	 statistics.m_zts_timer_max_lateness_ns];
+	return summary;
+}
+
+// Sends the whole insert chain configuration, so the driver always sees a consistent set of stages.
+- (NSString*)sendInsertChainConfig
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot configure the insert chain since user client is not connected";
+	}
+	
+	kern_return_t error = IOConnectCallStructMethod(_ioConnection,
+													static_cast<uint64_t>(SimpleAudioDriverExternalMethod_ConfigureInsertChain),
+													&_insertChainConfig, sizeof(_insertChainConfig), nullptr, nullptr);
+	if (error != kIOReturnSuccess)
+	{
+		return [NSString stringWithFormat:@"Failed to configure the insert chain, error:%u.", error];
+	}
+	return @"Successfully configured the insert chain";
+}
+
+// Sets one parametric band of the insert chain. Use SimpleAudioDriverFilterType_Off to remove it.
+- (NSString*)setInsertBand:(uint32_t)band type:(uint32_t)type frequency:(float)frequency gainDb:(float)gainDb q:(float)q
+{
+	if (band >= kSimpleAudioDriverInsertChainMaxBands)
+	{
+		return @"Insert band index is out of range";
+	}
+	_insertChainConfig.m_bands[band] = { type, frequency, gainDb, q };
+	return [self sendInsertChainConfig];
+}
+
+- (NSString*)setDCBlockerEnabled:(BOOL)enabled
+{
+	_insertChainConfig.m_dc_blocker_enabled = enabled ? 1 : 0;
+	return [self sendInsertChainConfig];
+}
+
+- (NSString*)setLimiterEnabled:(BOOL)enabled thresholdDb:(float)thresholdDb releaseMs:(float)releaseMs
+{
+	_insertChainConfig.m_limiter_enabled = enabled ? 1 : 0;
+	_insertChainConfig.m_limiter_threshold_db = thresholdDb;
+	_insertChainConfig.m_limiter_release_ms = releaseMs;
+	return [self sendInsertChainConfig];
+}
+
+static NSString* ControlOperationName(uint16_t operation)
+{
+	switch (operation)
+	{
+		case SimpleAudioDriverControlOperation_StartIO: return @"StartIO";
+		case SimpleAudioDriverControlOperation_StopIO: return @"StopIO";
+		case SimpleAudioDriverControlOperation_PerformConfigChange: return @"PerformConfigChange";
+		case SimpleAudioDriverControlOperation_ChangeSampleRate: return @"ChangeSampleRate";
+		case SimpleAudioDriverControlOperation_StartDevice: return @"StartDevice";
+		case SimpleAudioDriverControlOperation_StopDevice: return @"StopDevice";
+		case SimpleAudioDriverControlOperation_ToggleDataSource: return @"ToggleDataSource";
+		case SimpleAudioDriverControlOperation_TestConfigChange: return @"TestConfigChange";
+		case SimpleAudioDriverControlOperation_ApplyCommands: return @"ApplyCommands";
+		case SimpleAudioDriverControlOperation_SetRenderAhead: return @"SetRenderAhead";
+		case SimpleAudioDriverControlOperation_ConfigureInsertChain: return @"ConfigureInsertChain";
+		case SimpleAudioDriverControlOperation_UserClientMethod: return @"UserClientMethod";
+		case SimpleAudioDriverControlOperation_SetIORecording: return @"SetIORecording";
+		case SimpleAudioDriverControlOperation_DrainIOTrace: return @"DrainIOTrace";
+		case SimpleAudioDriverControlOperation_SetRenderBudget: return @"SetRenderBudget";
+		case SimpleAudioDriverControlOperation_ScheduleAutomation: return @"ScheduleAutomation";
+		case SimpleAudioDriverControlOperation_ClearAutomation: return @"ClearAutomation";
+		case SimpleAudioDriverControlOperation_ConnectCable: return @"ConnectCable";
+		case SimpleAudioDriverControlOperation_DisconnectCable: return @"DisconnectCable";
+		case SimpleAudioDriverControlOperation_SetCustomProperties: return @"SetCustomProperties";
+		case SimpleAudioDriverControlOperation_SetLazyStreamMemory: return @"SetLazyStreamMemory";
+		default: return [NSString stringWithFormat:@"Operation %u", operation];
+	}
+}
+
+static constexpr size_t kNumControlOperations = SimpleAudioDriverControlOperation_SetLazyStreamMemory + 1;
+
+// Returns the value at the given percentile of an already sorted list.
+static double Percentile(const std::vector<double>& sortedValues, double percentile)
+{
+	if (sortedValues.empty())
+	{
+		return 0.0;
+	}
+	size_t index = static_cast<size_t>(percentile / 100.0 * static_cast<double>(sortedValues.size() - 1) + 0.5);
+	return sortedValues[std::min(index, sortedValues.size() - 1)];
+}
+
+// Copies the driver's control-plane trace and summarizes the queue wait and
+// run time of each operation as percentiles, in microseconds.
+- (NSString*)controlTraceSummary
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot copy the control trace since user client is not connected";
+	}
+	
+	std::vector<uint8_t> traceData(sizeof(SimpleAudioDriverControlTraceHeader) + kSimpleAudioDriverControlTraceCapacity * sizeof(SimpleAudioDriverControlTraceRecord));
+	size_t traceSize = traceData.size();
+	kern_return_t error = IOConnectCallStructMethod(_ioConnection,
+													static_cast<uint64_t>(SimpleAudioDriverExternalMethod_CopyControlTrace),
+													nullptr, 0, traceData.data(), &traceSize);
+	if (error != kIOReturnSuccess || traceSize < sizeof(SimpleAudioDriverControlTraceHeader))
+	{
+		return [NSString stringWithFormat:@"Failed to copy the control trace, error:%u.", error];
+	}
+	
+	SimpleAudioDriverControlTraceHeader header;
+	memcpy(&header, traceData.data(), sizeof(header));
+	size_t numRecords = std::min<size_t>(header.m_num_records, (traceSize - sizeof(header)) / sizeof(SimpleAudioDriverControlTraceRecord));
+	double microsecondsPerTick = static_cast<double>(header.m_timebase_numer) / static_cast<double>(header.m_timebase_denom) / 1000.0;
+	
+	// Group the records by operation.
+	std::vector<std::vector<double>> waits(kNumControlOperations);
+	std::vector<std::vector<double>> durations(kNumControlOperations);
+	for (size_t i = 0; i < numRecords; i++)
+	{
+		SimpleAudioDriverControlTraceRecord record;
+		memcpy(&record, traceData.data() + sizeof(header) + i * sizeof(record), sizeof(record));
+		if (record.m_operation >= waits.size())
+		{
+			continue;
+		}
+		waits[record.m_operation].push_back(record.m_queue_wait * microsecondsPerTick);
+		durations[record.m_operation].push_back(record.m_duration * microsecondsPerTick);
+	}
+	
+	NSMutableString* summary = [NSMutableString stringWithFormat:@"%zu of %llu control operations (us, p50/p90/p99/max)", numRecords, header.m_total_records];
+	for (uint16_t operation = 0; operation < waits.size(); operation++)
+	{
+		auto& operationWaits = waits[operation];
+		auto& operationDurations = durations[operation];
+		if (operationWaits.empty())
+		{
+			continue;
+		}
+		std::sort(operationWaits.begin(), operationWaits.end());
+		std::sort(operationDurations.begin(), operationDurations.end());
+		[summary appendFormat:@"\n%@ x%zu wait %.0f/%.0f/%.0f/%.0f run %.0f/%.0f/%.0f/%.0f",
+		 ControlOperationName(operation), operationWaits.size(),
+		 Percentile(operationWaits, 50), Percentile(operationWaits, 90), Percentile(operationWaits, 99), operationWaits.back(),
+		 Percentile(operationDurations, 50), Percentile(operationDurations, 90), Percentile(operationDurations, 99), operationDurations.back()];
+	}
+	return summary;
+}
+
+- (NSString*)setIORecording:(BOOL)enabled
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot change I/O recording since user client is not connected";
+	}
+	
+	const uint64_t scalars[] = {enabled ? 1ULL : 0ULL};
+	kern_return_t error = IOConnectCallMethod(_ioConnection,
+											  static_cast<uint64_t>(SimpleAudioDriverExternalMethod_SetIORecording),
+											  scalars, 1, nullptr, 0, nullptr, nullptr, nullptr, 0);
+	if (error != kIOReturnSuccess)
+	{
+		return [NSString stringWithFormat:@"Failed to change I/O recording, error:%u.", error];
+	}
+	return enabled ? @"Started recording I/O" : @"Stopped recording I/O";
+}
+
+// Drains everything the device has recorded since the last drain and appends it
+// to a capture file. A new file starts with a SimpleAudioDriverIOTraceFileHeader,
+// and HostTools/IOTraceReplay renders a capture offline.
+- (NSString*)drainIOTraceToFile:(NSString*)path
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot drain the I/O trace since user client is not connected";
+	}
+	
+	NSMutableData* records = [NSMutableData data];
+	std::vector<uint8_t> traceData(sizeof(SimpleAudioDriverIOTraceHeader) + kSimpleAudioDriverIOTraceMaxDrainRecords * sizeof(SimpleAudioDriverIOTraceRecord));
+	SimpleAudioDriverIOTraceHeader header = {};
+	size_t numRecords = 0;
+	
+	// Each call returns at most one structure's worth, so keep draining until the ring is empty.
+	while (true)
+	{
+		size_t traceSize = traceData.size();
+		kern_return_t error = IOConnectCallStructMethod(_ioConnection,
+														static_cast<uint64_t>(SimpleAudioDriverExternalMethod_DrainIOTrace),
+														nullptr, 0, traceData.data(), &traceSize);
+		if (error != kIOReturnSuccess || traceSize < sizeof(SimpleAudioDriverIOTraceHeader))
+		{
+			return [NSString stringWithFormat:@"Failed to drain the I/O trace, error:%u.", error];
+		}
+		
+		memcpy(&header, traceData.data(), sizeof(header));
+		size_t drained = std::min<size_t>(header.m_num_records, (traceSize - sizeof(header)) / sizeof(SimpleAudioDriverIOTraceRecord));
+		[records appendBytes:traceData.data() + sizeof(header) length:drained * sizeof(SimpleAudioDriverIOTraceRecord)];
+		numRecords += drained;
+		if (drained < kSimpleAudioDriverIOTraceMaxDrainRecords)
+		{
+			break;
+		}
+	}
+	
+	NSFileManager* fileManager = [NSFileManager defaultManager];
+	if (![fileManager fileExistsAtPath:path])
+	{
+		SimpleAudioDriverIOTraceFileHeader fileHeader = {kSimpleAudioDriverIOTraceFileMagic, kSimpleAudioDriverIOTraceFileVersion,
+														 header.m_timebase_numer, header.m_timebase_denom};
+		if (![fileManager createFileAtPath:path contents:[NSData dataWithBytes:&fileHeader length:sizeof(fileHeader)] attributes:nil])
+		{
+			return [NSString stringWithFormat:@"Failed to create %@", path];
+		}
+	}
+	
+	NSFileHandle* file = [NSFileHandle fileHandleForWritingAtPath:path];
+	if (file == nil)
+	{
+		return [NSString stringWithFormat:@"Failed to open %@", path];
+	}
+	[file seekToEndOfFile];
+	[file writeData:records];
+	[file closeFile];
+	
+	return [NSString stringWithFormat:@"Appended %zu I/O records to %@, %llu dropped so far", numRecords, path, header.m_dropped_records];
+}
+
+- (NSString*)setRenderBudget:(uint32_t)budgetPercent
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot set the render budget since user client is not connected";
+	}
+	
+	const uint64_t scalars[] = {budgetPercent};
+	kern_return_t error = IOConnectCallMethod(_ioConnection,
+											  static_cast<uint64_t>(SimpleAudioDriverExternalMethod_SetRenderBudget),
+											  scalars, 1, nullptr, 0, nullptr, nullptr, nullptr, 0);
+	if (error != kIOReturnSuccess)
+	{
+		return [NSString stringWithFormat:@"Failed to set the render budget, error:%u.", error];
+	}
+	return [NSString stringWithFormat:@"Render budget set to %u%%", budgetPercent];
+}
+
+// Schedules one automation event. Sample times are in the device's timeline,
+// which restarts from zero each time I/O starts.
+- (NSString*)scheduleAutomationEvent:(SimpleAudioDriverAutomationEvent)event
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot schedule automation since user client is not connected";
+	}
+	
+	uint64_t numScheduled = 0;
+	uint32_t outputCount = 1;
+	kern_return_t error = IOConnectCallMethod(_ioConnection,
+											  static_cast<uint64_t>(SimpleAudioDriverExternalMethod_ScheduleAutomation),
+											  nullptr, 0, &event, sizeof(event), &numScheduled, &outputCount, nullptr, 0);
+	if (error != kIOReturnSuccess || numScheduled != 1)
+	{
+		return [NSString stringWithFormat:@"Failed to schedule automation, error:%u.", error];
+	}
+	return [NSString stringWithFormat:@"Scheduled automation at sample time %llu", event.m_sample_time];
+}
+
+- (NSString*)scheduleInputVolume:(float)volume atSampleTime:(uint64_t)sampleTime
+{
+	SimpleAudioDriverAutomationEvent event = {};
+	event.m_sample_time = sampleTime;
+	event.m_parameter = SimpleAudioDriverAutomationParameter_InputVolume;
+	event.m_argument.m_scalar = volume;
+	return [self scheduleAutomationEvent:event];
+}
+
+- (NSString*)scheduleDataSource:(uint32_t)dataSource atSampleTime:(uint64_t)sampleTime
+{
+	SimpleAudioDriverAutomationEvent event = {};
+	event.m_sample_time = sampleTime;
+	event.m_parameter = SimpleAudioDriverAutomationParameter_DataSource;
+	event.m_argument.m_value = dataSource;
+	return [self scheduleAutomationEvent:event];
+}
+
+- (NSString*)clearAutomation
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot clear automation since user client is not connected";
+	}
+	
+	kern_return_t error = IOConnectCallMethod(_ioConnection,
+											  static_cast<uint64_t>(SimpleAudioDriverExternalMethod_ClearAutomation),
+											  nullptr, 0, nullptr, 0, nullptr, nullptr, nullptr, 0);
+	if (error != kIOReturnSuccess)
+	{
+		return [NSString stringWithFormat:@"Failed to clear automation, error:%u.", error];
+	}
+	return @"Cleared automation";
+}
+
+// Device indexes count from 0, in the order the driver publishes the devices.
+- (NSString*)connectCable:(NSString*)name from:(uint32_t)sourceDevice to:(uint32_t)destinationDevice latencyFrames:(uint32_t)latencyFrames
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot connect a cable since user client is not connected";
+	}
+	
+	SimpleAudioDriverCableConfig config = {};
+	if (![name getCString:config.m_name maxLength:sizeof(config.m_name) encoding:NSUTF8StringEncoding])
+	{
+		return [NSString stringWithFormat:@"Cable name %@ is too long", name];
+	}
+	config.m_source_device = sourceDevice;
+	config.m_destination_device = destinationDevice;
+	config.m_latency_frames = latencyFrames;
+	
+	uint64_t cableIndex = 0;
+	uint32_t outputCount = 1;
+	kern_return_t error = IOConnectCallMethod(_ioConnection,
+											  static_cast<uint64_t>(SimpleAudioDriverExternalMethod_ConnectCable),
+											  nullptr, 0, &config, sizeof(config), &cableIndex, &outputCount, nullptr, 0);
+	if (error != kIOReturnSuccess)
+	{
+		return [NSString stringWithFormat:@"Failed to connect cable %@, error:%u.", name, error];
+	}
+	return [NSString stringWithFormat:@"Connected cable %@ as %llu", name, cableIndex];
+}
+
+- (NSString*)disconnectCable:(uint32_t)cableIndex
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot disconnect a cable since user client is not connected";
+	}
+	
+	uint64_t scalarIn = cableIndex;
+	kern_return_t error = IOConnectCallMethod(_ioConnection,
+											  static_cast<uint64_t>(SimpleAudioDriverExternalMethod_DisconnectCable),
+											  &scalarIn, 1, nullptr, 0, nullptr, nullptr, nullptr, 0);
+	if (error != kIOReturnSuccess)
+	{
+		return [NSString stringWithFormat:@"Failed to disconnect cable %u, error:%u.", cableIndex, error];
+	}
+	return [NSString stringWithFormat:@"Disconnected cable %u", cableIndex];
+}
+
+- (NSString*)cableStatus
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot get the cable status since user client is not connected";
+	}
+	
+	std::vector<uint8_t> statusData(sizeof(SimpleAudioDriverCableStatusHeader) + kSimpleAudioDriverMaxCables * sizeof(SimpleAudioDriverCableStatus));
+	size_t statusSize = statusData.size();
+	kern_return_t error = IOConnectCallStructMethod(_ioConnection,
+													static_cast<uint64_t>(SimpleAudioDriverExternalMethod_CopyCableStatus),
+													nullptr, 0, statusData.data(), &statusSize);
+	if (error != kIOReturnSuccess || statusSize < sizeof(SimpleAudioDriverCableStatusHeader))
+	{
+		return [NSString stringWithFormat:@"Failed to get the cable status, error:%u.", error];
+	}
+	
+	SimpleAudioDriverCableStatusHeader header = {};
+	memcpy(&header, statusData.data(), sizeof(header));
+	size_t numCables = std::min<size_t>(header.m_num_cables, (statusSize - sizeof(header)) / sizeof(SimpleAudioDriverCableStatus));
+	if (numCables == 0)
+	{
+		return @"No cables connected";
+	}
+	
+	NSMutableString* summary = [NSMutableString string];
+	for (size_t index = 0; index < numCables; index++)
+	{
+		SimpleAudioDriverCableStatus status = {};
+		memcpy(&status, statusData.data() + sizeof(header) + index * sizeof(status), sizeof(status));
+		[summary appendFormat:@"%@[%u] %s: %u -> %u latency:%u carried:%llu underruns:%u overruns:%u fill:%d (%d to %d)",
+		 index > 0 ? @"\n" : @"", status.m_index, status.m_name, status.m_source_device, status.m_destination_device,
+		 status.m_latency_frames, status.m_frames_carried, status.m_underruns, status.m_overruns,
+		 status.m_fill_frames, status.m_min_fill_frames, status.m_max_fill_frames];
+	}
+	return summary;
+}
+
+// Sets qualifier and value pairs on the first device's custom property, in
+// batches of kSimpleAudioDriverCustomPropertyMaxBatch. The device republishes
+// the snapshot once per batch.
+- (NSString*)setCustomPropertyValues:(NSDictionary<NSString*, NSString*>*)values
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot set custom properties since user client is not connected";
+	}
+	
+	std::vector<SimpleAudioDriverCustomPropertyEntry> entries;
+	for (NSString* qualifier in values)
+	{
+		SimpleAudioDriverCustomPropertyEntry entry = {};
+		if (![qualifier getCString:entry.m_qualifier maxLength:sizeof(entry.m_qualifier) encoding:NSUTF8StringEncoding] ||
+			![values[qualifier] getCString:entry.m_value maxLength:sizeof(entry.m_value) encoding:NSUTF8StringEncoding])
+		{
+			return [NSString stringWithFormat:@"Custom property %@ is too long", qualifier];
+		}
+		entries.push_back(entry);
+	}
+	
+	for (size_t first = 0; first < entries.size(); first += kSimpleAudioDriverCustomPropertyMaxBatch)
+	{
+		size_t count = std::min<size_t>(kSimpleAudioDriverCustomPropertyMaxBatch, entries.size() - first);
+		kern_return_t error = IOConnectCallMethod(_ioConnection,
+												  static_cast<uint64_t>(SimpleAudioDriverExternalMethod_SetCustomProperties),
+												  nullptr, 0, &entries[first], count * sizeof(SimpleAudioDriverCustomPropertyEntry), nullptr, nullptr, nullptr, 0);
+		if (error != kIOReturnSuccess)
+		{
+			return [NSString stringWithFormat:@"Failed to set custom properties after %zu of %zu, error:%u.", first, entries.size(), error];
+		}
+	}
+	return [NSString stringWithFormat:@"Set %zu custom properties", entries.size()];
+}
+
+// Puts every device in or out of lazy mode. A device in lazy mode releases its
+// stream ring buffers once I/O has been stopped for the idle period.
+- (NSString*)setLazyStreamMemory:(BOOL)enabled idleMs:(uint32_t)idleMs
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot set lazy stream memory since user client is not connected";
+	}
+	
+	uint64_t scalarIn[2] = { enabled ? 1u : 0u, idleMs };
+	kern_return_t error = IOConnectCallMethod(_ioConnection,
+											  static_cast<uint64_t>(SimpleAudioDriverExternalMethod_SetLazyStreamMemory),
+											  scalarIn, 2, nullptr, 0, nullptr, nullptr, nullptr, 0);
+	if (error != kIOReturnSuccess)
+	{
+		return [NSString stringWithFormat:@"Failed to set lazy stream memory, error:%u.", error];
+	}
+	return enabled ? [NSString stringWithFormat:@"Lazy stream memory on, idle period %u ms", idleMs] : @"Lazy stream memory off";
+}
+
+- (NSString*)memoryUsage
+{
+	if (_ioConnection == IO_OBJECT_NULL)
+	{
+		return @"Cannot get the memory usage since user client is not connected";
+	}
+	
+	std::vector<uint8_t> usageData(sizeof(SimpleAudioDriverMemoryUsageHeader) + kSimpleAudioDriverNumDevices * sizeof(SimpleAudioDriverDeviceMemoryUsage));
+	size_t usageSize = usageData.size();
+	kern_return_t error = IOConnectCallStructMethod(_ioConnection,
+													static_cast<uint64_t>(SimpleAudioDriverExternalMethod_CopyMemoryUsage),
+													nullptr, 0, usageData.data(), &usageSize);
+	if (error != kIOReturnSuccess || usageSize < sizeof(SimpleAudioDriverMemoryUsageHeader))
+	{
+		return [NSString stringWithFormat:@"Failed to get the memory usage, error:%u.", error];
+	}
+	
+	SimpleAudioDriverMemoryUsageHeader header = {};
+	memcpy(&header, usageData.data(), sizeof(header));
+	size_t numDevices = std::min<size_t>(header.m_num_devices, (usageSize - sizeof(header)) / sizeof(SimpleAudioDriverDeviceMemoryUsage));
+	
+	NSMutableString* summary = [NSMutableString string];
+	uint64_t totalBytes = 0;
+	for (size_t index = 0; index < numDevices; index++)
+	{
+		SimpleAudioDriverDeviceMemoryUsage usage = {};
+		memcpy(&usage, usageData.data() + sizeof(header) + index * sizeof(usage), sizeof(usage));
+		[summary appendFormat:@"Device %u%@: state:%llu rings:%llu mapped:%llu commits:%u releases:%u\n",
+		 usage.m_device_index, usage.m_lazy_stream_memory ? @" (lazy)" : @"",
+		 usage.m_state_bytes, usage.m_ring_bytes, usage.m_mapped_bytes, usage.m_ring_commits, usage.m_ring_releases];
+		totalBytes += usage.m_state_bytes + usage.m_ring_bytes;
+	}
+	[summary appendFormat:@"Total:%llu bytes", totalBytes];
+	return summary;
+}
+
+// Renders the tone the device generates for a data source, starting at sample
+// time 0 in the device's stream format, in blocks of the given I/O buffer
+// size. A path ending in .raw gets headerless samples; anything else gets a WAV
+// file. Without a connection, this renders in the format the device starts in.
+- (NSString*)renderOfflineToFile:(NSString*)path dataSource:(uint32_t)dataSource volume:(float)volume seconds:(double)seconds blockFrames:(uint32_t)blockFrames
+{
+	SimpleAudioDriverDeviceStatistics statistics = {};
+	statistics.m_sample_rate = kSimpleAudioDriverDefaultSampleRate;
+	statistics.m_channels_per_frame = kSimpleAudioDriverChannelsPerFrame;
+	if (_ioConnection != IO_OBJECT_NULL)
+	{
+		size_t statisticsSize = sizeof(statistics);
+		kern_return_t error = IOConnectCallStructMethod(_ioConnection,
+														static_cast<uint64_t>(SimpleAudioDriverExternalMethod_GetDeviceStatistics),
+														nullptr, 0, &statistics, &statisticsSize);
+		if (error != kIOReturnSuccess)
+		{
+			return [NSString stringWithFormat:@"Failed to get the device's stream format, error:%u.", error];
+		}
+	}
+	
+	SimpleAudioOfflineRenderConfig config = {};
+	config.m_tone_frequency = dataSource;
+	config.m_volume = volume;
+	config.m_sample_rate = statistics.m_sample_rate;
+	config.m_num_channels = statistics.m_channels_per_frame;
+	config.m_num_frames = static_cast<uint64_t>(seconds * config.m_sample_rate);
+	config.m_block_frames = blockFrames;
+	config.m_file_type = [[path pathExtension] isEqualToString:@"raw"] ? SimpleAudioOfflineRenderFileType_Raw : SimpleAudioOfflineRenderFileType_WAV;
+	
+	SimpleAudioOfflineRenderResult result = {};
+	if (!SimpleAudioOfflineRenderer::Render(config, [path fileSystemRepresentation], &result))
+	{
+		return [NSString stringWithFormat:@"Failed to render to %@", path];
+	}
+	return [NSString stringWithFormat:@"Rendered %llu frames in %.3f s with %u threads, %.1fx real time, checksum:%016llx",
+			result.m_frames_written, result.m_render_seconds, result.m_num_threads, result.m_speedup, result.m_checksum];
+}
 @end
@@ -0,0 +1,127 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The implementation of the queue of parameter changes scheduled at exact
+             device sample times.
+*/
+
+// Self Include
+#include "SimpleAudioAutomation.h"
+
+// System Includes
+#include <DriverKit/DriverKit.h>
+#include <string.h>
+
+void SimpleAudioAutomation::Initialize()
+{
+	bzero(this, sizeof(*this));
+}
+
+uint32_t SimpleAudioAutomation::Schedule(const SimpleAudioDriverAutomationEvent* in_events, uint32_t in_num_events)
+{
+	auto write_position = m_inbox_write_position;
+	auto read_position = __atomic_load_n(&m_inbox_read_position, __ATOMIC_ACQUIRE);
+	
+	uint32_t num_scheduled = 0;
+	while (num_scheduled < in_num_events && write_position - read_position < kSimpleAudioDriverAutomationCapacity)
+	{
+		m_inbox[write_position % kSimpleAudioDriverAutomationCapacity] = in_events[num_scheduled++];
+		write_position++;
+	}
+	__atomic_store_n(&m_inbox_write_position, write_position, __ATOMIC_RELEASE);
+	return num_scheduled;
+}
+
+void SimpleAudioAutomation::Clear()
+{
+	// The I/O handler skips the inbox up to this position and empties its
+	// pending list. Events scheduled after this are published after it, so
+	// the I/O handler can't see them without also seeing the clear.
+	auto clears = static_cast<uint32_t>(__atomic_load_n(&m_clear_request, __ATOMIC_RELAXED) >> 32) + 1;
+	auto request = (static_cast<uint64_t>(clears) << 32) | m_inbox_write_position;
+	__atomic_store_n(&m_clear_request, request, __ATOMIC_RELEASE);
+}
+
+void SimpleAudioAutomation::SetHeld(bool in_held)
+{
+	// Set before scheduling, so an I/O handler that sees the events sees the hold too.
+	__atomic_store_n(&m_held, in_held, __ATOMIC_RELEASE);
+}
+
+bool SimpleAudioAutomation::IsIdle() const
+{
+	// The I/O handler publishes its pending count before its read position,
+	// so an empty inbox means the count includes everything it collected.
+	return __atomic_load_n(&m_inbox_read_position, __ATOMIC_ACQUIRE) == m_inbox_write_position &&
+		__atomic_load_n(&m_num_pending, __ATOMIC_RELAXED) == 0;
+}
+
+/// - Tag: CollectAutomation
+void SimpleAudioAutomation::Collect()
+{
+	// Read the clear request on both sides of the write position. The write
+	// position then covers every event the clear refers to, and no event
+	// scheduled after a newer clear that this pass wouldn't apply.
+	uint64_t clear_request = 0;
+	uint32_t write_position = 0;
+	do
+	{
+		clear_request = __atomic_load_n(&m_clear_request, __ATOMIC_ACQUIRE);
+		write_position = __atomic_load_n(&m_inbox_write_position, __ATOMIC_ACQUIRE);
+	} while (__atomic_load_n(&m_clear_request, __ATOMIC_ACQUIRE) != clear_request);
+
+	auto read_position = m_inbox_read_position;
+	auto num_pending = m_num_pending;
+	if (static_cast<uint32_t>(clear_request >> 32) != m_clears_applied)
+	{
+		m_clears_applied = static_cast<uint32_t>(clear_request >> 32);
+		num_pending = 0;
+		auto clear_position = static_cast<uint32_t>(clear_request);
+		if (clear_position - read_position <= kSimpleAudioDriverAutomationCapacity)
+		{
+			read_position = clear_position;
+		}
+	}
+	
+	// Held events stay in the inbox. The hold is read after the write
+	// position, so it covers every event scheduled after it was set.
+	if (__atomic_load_n(&m_held, __ATOMIC_ACQUIRE))
+	{
+		write_position = read_position;
+	}
+	
+	// Insert each new event behind any pending event due at the same time, so
+	// events for the same sample apply in the order they were scheduled.
+	while (read_position != write_position && num_pending < kSimpleAudioDriverAutomationCapacity)
+	{
+		const auto& event = m_inbox[read_position % kSimpleAudioDriverAutomationCapacity];
+		uint32_t index = num_pending;
+		while (index > 0 && m_pending[index - 1].m_sample_time <= event.m_sample_time)
+		{
+			m_pending[index] = m_pending[index - 1];
+			index--;
+		}
+		m_pending[index] = event;
+		num_pending++;
+		read_position++;
+	}
+	__atomic_store_n(&m_num_pending, num_pending, __ATOMIC_RELAXED);
+	__atomic_store_n(&m_inbox_read_position, read_position, __ATOMIC_RELEASE);
+}
+
+uint64_t SimpleAudioAutomation::NextEventTime() const
+{
+	return m_num_pending > 0 ? m_pending[m_num_pending - 1].m_sample_time : UINT64_MAX;
+}
+
+bool SimpleAudioAutomation::PopEvent(uint64_t in_sample_time, SimpleAudioDriverAutomationEvent& out_event)
+{
+	if (m_num_pending == 0 || m_pending[m_num_pending - 1].m_sample_time > in_sample_time)
+	{
+		return false;
+	}
+	out_event = m_pending[m_num_pending - 1];
+	__atomic_store_n(&m_num_pending, m_num_pending - 1, __ATOMIC_RELAXED);
+	return true;
+}
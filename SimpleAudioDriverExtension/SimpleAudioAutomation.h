@@ -0,0 +1,62 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Headers for the queue of parameter changes scheduled at exact device
+            sample times.
+*/
+
+#ifndef SimpleAudioAutomation_h
+#define SimpleAudioAutomation_h
+
+#include <stdint.h>
+#include "SimpleAudioDriverKeys.h"
+
+// The work queue schedules events into a single-producer, single-consumer
+// inbox. At the start of each input block the I/O handler moves them into its
+// own list, which stays sorted by sample time, so it can split the block at
+// each event without allocating or taking a lock.
+class SimpleAudioAutomation
+{
+public:
+	void		Initialize();
+	
+	// Runs on the work queue. Returns how many events fit in the inbox.
+	uint32_t	Schedule(const SimpleAudioDriverAutomationEvent* in_events, uint32_t in_num_events);
+	
+	// Runs on the work queue. Drops every event scheduled before this call.
+	void		Clear();
+	
+	// Runs on the work queue. While held, scheduled events wait in the inbox
+	// and the I/O handler collects none of them, though clears still apply.
+	void		SetHeld(bool in_held);
+	
+	// Runs on the work queue. True when every scheduled event has applied or
+	// been cleared.
+	bool		IsIdle() const;
+	
+	// The rest runs in the I/O handler.
+	void		Collect();
+	
+	// Returns UINT64_MAX if nothing is pending.
+	uint64_t	NextEventTime() const;
+	
+	// Takes the earliest pending event if it's due at or before the sample time.
+	bool		PopEvent(uint64_t in_sample_time, SimpleAudioDriverAutomationEvent& out_event);
+	
+private:
+	// Written by the work queue, read by the I/O handler.
+	SimpleAudioDriverAutomationEvent	m_inbox[kSimpleAudioDriverAutomationCapacity];
+	uint32_t							m_inbox_write_position;
+	uint64_t							m_clear_request; // The clear count above the inbox write position when it was made.
+	bool								m_held;
+	
+	// Owned by the I/O handler. Pending events are sorted latest first, so the
+	// next one due is always at the end. The work queue reads the count.
+	uint32_t							m_inbox_read_position;
+	uint32_t							m_clears_applied;
+	SimpleAudioDriverAutomationEvent	m_pending[kSimpleAudioDriverAutomationCapacity];
+	uint32_t							m_num_pending;
+};
+
+#endif /* SimpleAudioAutomation_h */
@@ -0,0 +1,333 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The implementation of the router that carries audio between devices
+             over named cables.
+*/
+
+// Self Include
+#include "SimpleAudioCableRouter.h"
+
+// System Includes
+#include <DriverKit/DriverKit.h>
+#include <string.h>
+
+// The user count goes up before the active flag is checked again, and both are
+// sequentially consistent, so Connect either sees the user or the I/O handler
+// sees the slot inactive. Either way a handler never uses a slot mid-setup.
+static bool AcquireCable(uint32_t* io_users, const bool* in_active)
+{
+	if (!__atomic_load_n(in_active, __ATOMIC_ACQUIRE))
+	{
+		return false;
+	}
+	__atomic_add_fetch(io_users, 1, __ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(in_active, __ATOMIC_SEQ_CST))
+	{
+		__atomic_sub_fetch(io_users, 1, __ATOMIC_RELEASE);
+		return false;
+	}
+	return true;
+}
+
+static void ReleaseCable(uint32_t* io_users)
+{
+	__atomic_sub_fetch(io_users, 1, __ATOMIC_RELEASE);
+}
+
+void SimpleAudioCableRouter::Initialize()
+{
+	bzero(this, sizeof(*this));
+	
+	struct mach_timebase_info timebase_info;
+	mach_timebase_info(&timebase_info);
+	m_timebase_numer = timebase_info.numer;
+	m_timebase_denom = timebase_info.denom;
+	m_epoch_host_time = mach_absolute_time();
+}
+
+kern_return_t SimpleAudioCableRouter::Connect(const SimpleAudioDriverCableConfig& in_config, uint32_t* out_cable_index)
+{
+	if (in_config.m_source_device >= kSimpleAudioDriverNumDevices ||
+		in_config.m_destination_device >= kSimpleAudioDriverNumDevices ||
+		in_config.m_latency_frames > kSimpleAudioDriverCableMaxLatencyFrames ||
+		strnlen(in_config.m_name, kSimpleAudioDriverCableNameLength) == 0 ||
+		strnlen(in_config.m_name, kSimpleAudioDriverCableNameLength) == kSimpleAudioDriverCableNameLength)
+	{
+		return kIOReturnBadArgument;
+	}
+	
+	uint32_t free_index = kSimpleAudioDriverMaxCables;
+	for (uint32_t i = 0; i < kSimpleAudioDriverMaxCables; i++)
+	{
+		auto index = (m_next_index + i) % kSimpleAudioDriverMaxCables;
+		if (!m_cables[index].m_active)
+		{
+			// A disconnected slot is only free once no I/O handler is still using it.
+			if (__atomic_load_n(&m_cables[index].m_users, __ATOMIC_SEQ_CST) == 0)
+			{
+				free_index = free_index < kSimpleAudioDriverMaxCables ? free_index : index;
+			}
+		}
+		else if (strncmp(m_cables[index].m_name, in_config.m_name, kSimpleAudioDriverCableNameLength) == 0)
+		{
+			return kIOReturnExclusiveAccess;
+		}
+	}
+	if (free_index == kSimpleAudioDriverMaxCables)
+	{
+		return kIOReturnNoResources;
+	}
+	
+	// Set the cable up while it's inactive, then publish it.
+	auto& cable = m_cables[free_index];
+	strlcpy(cable.m_name, in_config.m_name, sizeof(cable.m_name));
+	cable.m_source_device = in_config.m_source_device;
+	cable.m_destination_device = in_config.m_destination_device;
+	cable.m_latency_frames = in_config.m_latency_frames;
+	__atomic_store_n(&cable.m_valid_start, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&cable.m_write_end, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&cable.m_num_channels, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&cable.m_sample_rate, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&cable.m_frames_carried, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&cable.m_underruns, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&cable.m_overruns, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&cable.m_fill_frames, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&cable.m_min_fill_frames, INT32_MAX, __ATOMIC_RELAXED);
+	__atomic_store_n(&cable.m_max_fill_frames, INT32_MIN, __ATOMIC_RELAXED);
+	__atomic_store_n(&cable.m_active, true, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&m_num_inputs[cable.m_destination_device], 1, __ATOMIC_RELEASE);
+	
+	m_next_index = (free_index + 1) % kSimpleAudioDriverMaxCables;
+	*out_cable_index = free_index;
+	return kIOReturnSuccess;
+}
+
+kern_return_t SimpleAudioCableRouter::Disconnect(uint32_t in_cable_index)
+{
+	if (in_cable_index >= kSimpleAudioDriverMaxCables || !m_cables[in_cable_index].m_active)
+	{
+		return kIOReturnBadArgument;
+	}
+	
+	auto& cable = m_cables[in_cable_index];
+	__atomic_store_n(&cable.m_active, false, __ATOMIC_RELEASE);
+	__atomic_sub_fetch(&m_num_inputs[cable.m_destination_device], 1, __ATOMIC_RELEASE);
+	return kIOReturnSuccess;
+}
+
+size_t SimpleAudioCableRouter::CopyStatus(void* out_buffer, size_t in_buffer_size) const
+{
+	if (in_buffer_size < sizeof(SimpleAudioDriverCableStatusHeader))
+	{
+		return 0;
+	}
+	
+	auto header = reinterpret_cast<SimpleAudioDriverCableStatusHeader*>(out_buffer);
+	auto statuses = reinterpret_cast<SimpleAudioDriverCableStatus*>(header + 1);
+	size_t max_statuses = (in_buffer_size - sizeof(*header)) / sizeof(SimpleAudioDriverCableStatus);
+	
+	uint32_t num_cables = 0;
+	for (uint32_t i = 0; i < kSimpleAudioDriverMaxCables && num_cables < max_statuses; i++)
+	{
+		const auto& cable = m_cables[i];
+		if (!cable.m_active)
+		{
+			continue;
+		}
+		
+		auto& status = statuses[num_cables++];
+		bzero(&status, sizeof(status));
+		strlcpy(status.m_name, cable.m_name, sizeof(status.m_name));
+		status.m_index = i;
+		status.m_source_device = cable.m_source_device;
+		status.m_destination_device = cable.m_destination_device;
+		status.m_latency_frames = cable.m_latency_frames;
+		status.m_frames_carried = __atomic_load_n(&cable.m_frames_carried, __ATOMIC_RELAXED);
+		status.m_underruns = __atomic_load_n(&cable.m_underruns, __ATOMIC_RELAXED);
+		status.m_overruns = __atomic_load_n(&cable.m_overruns, __ATOMIC_RELAXED);
+		status.m_fill_frames = __atomic_load_n(&cable.m_fill_frames, __ATOMIC_RELAXED);
+		status.m_min_fill_frames = __atomic_load_n(&cable.m_min_fill_frames, __ATOMIC_RELAXED);
+		status.m_max_fill_frames = __atomic_load_n(&cable.m_max_fill_frames, __ATOMIC_RELAXED);
+	}
+	
+	header->m_num_cables = num_cables;
+	header->m_reserved = 0;
+	return sizeof(*header) + num_cables * sizeof(SimpleAudioDriverCableStatus);
+}
+
+uint64_t SimpleAudioCableRouter::TimelineFrame(uint64_t in_host_time, double in_sample_rate) const
+{
+	if (in_host_time <= m_epoch_host_time)
+	{
+		return 0;
+	}
+	double nanoseconds = static_cast<double>(in_host_time - m_epoch_host_time) * m_timebase_numer / m_timebase_denom;
+	return static_cast<uint64_t>(nanoseconds * in_sample_rate / NSEC_PER_SEC + 0.5);
+}
+
+bool SimpleAudioCableRouter::HasInputs(uint32_t in_device_index) const
+{
+	return in_device_index < kSimpleAudioDriverNumDevices && __atomic_load_n(&m_num_inputs[in_device_index], __ATOMIC_ACQUIRE) > 0;
+}
+
+/// - Tag: WriteCable
+void SimpleAudioCableRouter::Write(uint32_t in_device_index,
+								   uint64_t in_timeline_frame,
+								   const int16_t* in_ring,
+								   size_t in_ring_length,
+								   uint64_t in_ring_frame,
+								   uint32_t in_num_channels,
+								   uint32_t in_sample_rate,
+								   uint32_t in_num_frames)
+{
+	if (in_num_channels == 0 || in_num_channels > kSimpleAudioCableMaxChannels || in_ring_length == 0)
+	{
+		return;
+	}
+	
+	for (auto& cable : m_cables)
+	{
+		if (!AcquireCable(&cable.m_users, &cable.m_active))
+		{
+			continue;
+		}
+		if (cable.m_source_device != in_device_index)
+		{
+			ReleaseCable(&cable.m_users);
+			continue;
+		}
+		
+		// A gap or a restart begins a new run, so the reader can't mistake
+		// stale frames for the ones it wants.
+		if (in_timeline_frame != cable.m_write_end || in_num_channels != cable.m_num_channels || in_sample_rate != cable.m_sample_rate)
+		{
+			__atomic_store_n(&cable.m_valid_start, in_timeline_frame, __ATOMIC_RELAXED);
+			__atomic_store_n(&cable.m_num_channels, in_num_channels, __ATOMIC_RELAXED);
+			__atomic_store_n(&cable.m_sample_rate, in_sample_rate, __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_RELEASE);
+		}
+		
+		auto ring_index = (in_ring_frame * in_num_channels) % in_ring_length;
+		for (uint32_t frame = 0; frame < in_num_frames; frame++)
+		{
+			auto cable_index = ((in_timeline_frame + frame) % kSimpleAudioCableCapacityFrames) * in_num_channels;
+			for (uint32_t channel = 0; channel < in_num_channels; channel++)
+			{
+				cable.m_samples[cable_index + channel] = in_ring[ring_index];
+				if (++ring_index == in_ring_length)
+				{
+					ring_index = 0;
+				}
+			}
+		}
+		__atomic_store_n(&cable.m_write_end, in_timeline_frame + in_num_frames, __ATOMIC_RELEASE);
+		ReleaseCable(&cable.m_users);
+	}
+}
+
+/// - Tag: ReadCable
+void SimpleAudioCableRouter::Read(uint32_t in_device_index,
+								  uint64_t in_timeline_frame,
+								  int16_t* io_ring,
+								  size_t in_ring_length,
+								  uint64_t in_ring_frame,
+								  uint32_t in_num_channels,
+								  uint32_t in_sample_rate,
+								  uint32_t in_num_frames,
+								  float in_volume)
+{
+	if (in_ring_length == 0)
+	{
+		return;
+	}
+	
+	bool mixed = false;
+	for (auto& cable : m_cables)
+	{
+		if (!AcquireCable(&cable.m_users, &cable.m_active))
+		{
+			continue;
+		}
+		if (cable.m_destination_device != in_device_index)
+		{
+			ReleaseCable(&cable.m_users);
+			continue;
+		}
+		
+		// Work out which of the wanted frames the source has written and not yet lapped.
+		auto write_end = __atomic_load_n(&cable.m_write_end, __ATOMIC_ACQUIRE);
+		auto valid_start = __atomic_load_n(&cable.m_valid_start, __ATOMIC_RELAXED);
+		auto lapped_end = write_end > kSimpleAudioCableCapacityFrames ? write_end - kSimpleAudioCableCapacityFrames : 0;
+		auto readable_start = valid_start > lapped_end ? valid_start : lapped_end;
+		bool formats_match = __atomic_load_n(&cable.m_num_channels, __ATOMIC_RELAXED) == in_num_channels &&
+							 __atomic_load_n(&cable.m_sample_rate, __ATOMIC_RELAXED) == in_sample_rate;
+		
+		auto read_start = in_timeline_frame > cable.m_latency_frames ? in_timeline_frame - cable.m_latency_frames : 0;
+		auto read_end = read_start + in_num_frames;
+		
+		auto ring_index = (in_ring_frame * in_num_channels) % in_ring_length;
+		for (uint32_t frame = 0; frame < in_num_frames; frame++)
+		{
+			auto position = read_start + frame;
+			bool readable = formats_match && position >= readable_start && position < write_end;
+			auto cable_index = (position % kSimpleAudioCableCapacityFrames) * in_num_channels;
+			for (uint32_t channel = 0; channel < in_num_channels; channel++)
+			{
+				int32_t sample = readable ? static_cast<int32_t>(in_volume * cable.m_samples[cable_index + channel]) : 0;
+				if (mixed)
+				{
+					sample += io_ring[ring_index];
+					sample = sample > INT16_MAX ? INT16_MAX : (sample < INT16_MIN ? INT16_MIN : sample);
+				}
+				io_ring[ring_index] = static_cast<int16_t>(sample);
+				if (++ring_index == in_ring_length)
+				{
+					ring_index = 0;
+				}
+			}
+		}
+		mixed = true;
+		
+		// If the writer moved far enough while copying, it may have replaced
+		// frames this read had already taken.
+		auto new_write_end = __atomic_load_n(&cable.m_write_end, __ATOMIC_ACQUIRE);
+		if (new_write_end > kSimpleAudioCableCapacityFrames && new_write_end - kSimpleAudioCableCapacityFrames > read_start)
+		{
+			__atomic_add_fetch(&cable.m_overruns, 1, __ATOMIC_RELAXED);
+		}
+		if (!formats_match || read_start < readable_start || read_end > write_end)
+		{
+			__atomic_add_fetch(&cable.m_underruns, 1, __ATOMIC_RELAXED);
+		}
+		
+		auto fill = static_cast<int64_t>(write_end) - static_cast<int64_t>(read_end);
+		auto fill_frames = static_cast<int32_t>(fill > INT32_MAX ? INT32_MAX : (fill < INT32_MIN ? INT32_MIN : fill));
+		__atomic_store_n(&cable.m_fill_frames, fill_frames, __ATOMIC_RELAXED);
+		if (fill_frames < cable.m_min_fill_frames)
+		{
+			__atomic_store_n(&cable.m_min_fill_frames, fill_frames, __ATOMIC_RELAXED);
+		}
+		if (fill_frames > cable.m_max_fill_frames)
+		{
+			__atomic_store_n(&cable.m_max_fill_frames, fill_frames, __ATOMIC_RELAXED);
+		}
+		__atomic_add_fetch(&cable.m_frames_carried, in_num_frames, __ATOMIC_RELAXED);
+		ReleaseCable(&cable.m_users);
+	}
+	
+	// Every cable was disconnected after the caller checked, so leave silence.
+	if (!mixed)
+	{
+		auto ring_index = (in_ring_frame * in_num_channels) % in_ring_length;
+		for (uint32_t i = 0; i < in_num_frames * in_num_channels; i++)
+		{
+			io_ring[ring_index] = 0;
+			if (++ring_index == in_ring_length)
+			{
+				ring_index = 0;
+			}
+		}
+	}
+}
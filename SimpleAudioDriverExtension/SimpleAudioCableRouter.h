@@ -0,0 +1,113 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Headers for the router that carries audio between devices over
+            named cables.
+*/
+
+#ifndef SimpleAudioCableRouter_h
+#define SimpleAudioCableRouter_h
+
+#include <DriverKit/IOReturn.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "SimpleAudioDriverKeys.h"
+
+#define kSimpleAudioCableCapacityFrames 4096 // Must be a power of two.
+#define kSimpleAudioCableMaxChannels 2
+
+// Each cable is a single-producer, single-consumer ring indexed by position on
+// the shared timeline: the source device's I/O handler writes each output block
+// once, and the destination device's I/O handler reads each input block once,
+// straight into its input ring. The ring holds whatever was written at each
+// timeline position, so the reader only has to check that the frames it wants
+// are still inside the written window, and check again after copying that the
+// writer didn't lap it.
+//
+// Connect and Disconnect run on the work queue. A cable's configuration only
+// changes while it's inactive. An I/O handler counts itself as a user of a
+// cable before checking the active flag, and Connect only takes a slot that
+// has no users, so a slot that was just disconnected isn't reconfigured while
+// an I/O handler is still using it. Connect also takes free slots in turn,
+// which leaves a disconnected slot the longest to quiesce.
+class SimpleAudioCableRouter
+{
+public:
+	void			Initialize();
+	
+	kern_return_t	Connect(const SimpleAudioDriverCableConfig& in_config, uint32_t* out_cable_index);
+	
+	kern_return_t	Disconnect(uint32_t in_cable_index);
+	
+	// Copies a header and the status of every connected cable, and returns the
+	// number of bytes written.
+	size_t			CopyStatus(void* out_buffer, size_t in_buffer_size) const;
+	
+	// Converts a host time to a frame position on the shared timeline, which
+	// starts when the router does. It only reads what Initialize sets, so any
+	// queue may call it.
+	uint64_t		TimelineFrame(uint64_t in_host_time, double in_sample_rate) const;
+	
+	bool			HasInputs(uint32_t in_device_index) const;
+	
+	// Runs in the source device's I/O handler after the host writes a block.
+	void			Write(uint32_t in_device_index,
+						  uint64_t in_timeline_frame,
+						  const int16_t* in_ring,
+						  size_t in_ring_length,
+						  uint64_t in_ring_frame,
+						  uint32_t in_num_channels,
+						  uint32_t in_sample_rate,
+						  uint32_t in_num_frames);
+	
+	// Runs in the destination device's I/O handler, mixing every cable
+	// connected to the device into its input ring with the given gain.
+	void			Read(uint32_t in_device_index,
+						 uint64_t in_timeline_frame,
+						 int16_t* io_ring,
+						 size_t in_ring_length,
+						 uint64_t in_ring_frame,
+						 uint32_t in_num_channels,
+						 uint32_t in_sample_rate,
+						 uint32_t in_num_frames,
+						 float in_volume);
+	
+private:
+	struct Cable
+	{
+		// Owned by the work queue, and only changed while the cable is inactive.
+		char		m_name[kSimpleAudioDriverCableNameLength];
+		uint32_t	m_source_device;
+		uint32_t	m_destination_device;
+		uint32_t	m_latency_frames;
+		bool		m_active;
+		
+		// Written by the source device's I/O handler.
+		uint64_t	m_valid_start; // The first frame of the current unbroken run of writes.
+		uint64_t	m_write_end;
+		uint32_t	m_num_channels;
+		uint32_t	m_sample_rate;
+		int16_t		m_samples[kSimpleAudioCableCapacityFrames * kSimpleAudioCableMaxChannels];
+		
+		// Counted up and down by both devices' I/O handlers around each use.
+		uint32_t	m_users;
+		
+		// Written by the destination device's I/O handler.
+		uint64_t	m_frames_carried;
+		uint32_t	m_underruns;
+		uint32_t	m_overruns;
+		int32_t		m_fill_frames;
+		int32_t		m_min_fill_frames;
+		int32_t		m_max_fill_frames;
+	};
+	
+	Cable		m_cables[kSimpleAudioDriverMaxCables];
+	uint32_t	m_num_inputs[kSimpleAudioDriverNumDevices];
+	uint32_t	m_next_index;
+	uint64_t	m_epoch_host_time;
+	uint32_t	m_timebase_numer;
+	uint32_t	m_timebase_denom;
+};
+
+#endif /* SimpleAudioCableRouter_h */
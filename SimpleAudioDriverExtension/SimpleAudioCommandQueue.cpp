@@ -0,0 +1,85 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The implementation of the shared command queue.
+*/
+
+// Self Include
+#include "SimpleAudioCommandQueue.h"
+
+// System Includes
+#include <string.h>
+
+void	SimpleAudioCommandQueue::Initialize(SimpleAudioDriverCommandQueue* out_queue)
+{
+	memset(out_queue, 0, sizeof(SimpleAudioDriverCommandQueue));
+	for (uint64_t i = 0; i < kSimpleAudioDriverCommandQueueCapacity; i++)
+	{
+		out_queue->m_slots[i].m_sequence = i;
+	}
+}
+
+/// - Tag: EnqueueCommand
+bool	SimpleAudioCommandQueue::Enqueue(SimpleAudioDriverCommandQueue* io_queue, uint32_t in_command, SimpleAudioDriverCommandSlot in_argument)
+{
+	uint64_t position = __atomic_load_n(&io_queue->m_enqueue_position, __ATOMIC_RELAXED);
+	for (;;)
+	{
+		SimpleAudioDriverCommandSlot& slot = io_queue->m_slots[position & (kSimpleAudioDriverCommandQueueCapacity - 1)];
+		uint64_t sequence = __atomic_load_n(&slot.m_sequence, __ATOMIC_ACQUIRE);
+		int64_t difference = static_cast<int64_t>(sequence - position);
+		if (difference == 0)
+		{
+			// The slot is free for this lap, so try to claim the position.
+			if (__atomic_compare_exchange_n(&io_queue->m_enqueue_position, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				slot.m_command = in_command;
+				slot.m_argument = in_argument.m_argument;
+				__atomic_store_n(&slot.m_sequence, position + 1, __ATOMIC_RELEASE);
+				return true;
+			}
+		}
+		else if (difference < 0)
+		{
+			// The driver hasn't drained this slot from the previous lap, so the queue is full.
+			return false;
+		}
+		else
+		{
+			// Another producer claimed this position first.
+			position = __atomic_load_n(&io_queue->m_enqueue_position, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/// - Tag: DequeueCommands
+uint32_t	SimpleAudioCommandQueue::Dequeue(SimpleAudioDriverCommandQueue* io_queue, uint64_t* io_position, SimpleAudioDriverCommandSlot* out_commands, uint32_t in_max_commands)
+{
+	// The position in shared memory is only a mirror for the app, so the
+	// consumer never trusts it.
+	auto position = *io_position;
+	uint32_t num_commands = 0;
+	
+	while (num_commands < in_max_commands)
+	{
+		auto& slot = io_queue->m_slots[position & (kSimpleAudioDriverCommandQueueCapacity - 1)];
+		auto sequence = __atomic_load_n(&slot.m_sequence, __ATOMIC_ACQUIRE);
+		if (sequence != position + 1)
+		{
+			// The queue is empty, or the next producer hasn't published its command yet.
+			break;
+		}
+		
+		out_commands[num_commands].m_command = slot.m_command;
+		out_commands[num_commands].m_argument = slot.m_argument;
+		num_commands++;
+		
+		__atomic_store_n(&slot.m_sequence, position + kSimpleAudioDriverCommandQueueCapacity, __ATOMIC_RELEASE);
+		position++;
+	}
+	
+	*io_position = position;
+	__atomic_store_n(&io_queue->m_dequeue_position, position, __ATOMIC_RELEASE);
+	return num_commands;
+}
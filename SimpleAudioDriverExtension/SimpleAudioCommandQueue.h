@@ -0,0 +1,36 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Headers for the producer and consumer sides of the shared command queue.
+*/
+
+#ifndef SimpleAudioCommandQueue_h
+#define SimpleAudioCommandQueue_h
+
+#include "SimpleAudioDriverKeys.h"
+
+// The queue has no DriverKit dependencies, so the app enqueues with the same
+// code that the driver drains with.
+class SimpleAudioCommandQueue
+{
+public:
+	// Gives each slot to the producer whose enqueue position matches its index.
+	static void		Initialize(SimpleAudioDriverCommandQueue* out_queue);
+	
+	// Publishes one command. Any number of threads can enqueue at once. Returns
+	// false if the queue is full.
+	static bool		Enqueue(SimpleAudioDriverCommandQueue* io_queue,
+							uint32_t in_command,
+							SimpleAudioDriverCommandSlot in_argument);
+	
+	// Copies up to in_max_commands published commands out of the queue and
+	// releases their slots. There must be only one consumer, which keeps the
+	// authoritative dequeue position in io_position.
+	static uint32_t	Dequeue(SimpleAudioDriverCommandQueue* io_queue,
+							uint64_t* io_position,
+							SimpleAudioDriverCommandSlot* out_commands,
+							uint32_t in_max_commands);
+};
+
+#endif /* SimpleAudioCommandQueue_h */
@@ -0,0 +1,171 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The implementation of the trace that records how long control-plane
+             operations wait for and run on the work queue.
+*/
+
+// Self Include
+#include "SimpleAudioControlTrace.h"
+
+// System Includes
+#include <DriverKit/DriverKit.h>
+#include <string.h>
+
+void SimpleAudioControlTrace::Initialize()
+{
+	bzero(this, sizeof(*this));
+	
+	struct mach_timebase_info timebase_info;
+	mach_timebase_info(&timebase_info);
+	m_timebase_numer = timebase_info.numer;
+	m_timebase_denom = timebase_info.denom;
+}
+
+void SimpleAudioControlTrace::Record(uint16_t in_operation,
+									 uint16_t in_detail,
+									 uint64_t in_request_time,
+									 uint64_t in_begin_time,
+									 uint64_t in_end_time,
+									 kern_return_t in_result)
+{
+	auto position = __atomic_fetch_add(&m_write_position, 1, __ATOMIC_RELAXED);
+	auto& slot = m_slots[position % kSimpleAudioDriverControlTraceCapacity];
+	
+	// An odd sequence marks the slot as being written for this position, and
+	// the following even one marks it complete.
+	__atomic_store_n(&slot.m_sequence, position * 2 + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	
+	auto queue_wait = in_begin_time - in_request_time;
+	auto duration = in_end_time - in_begin_time;
+	slot.m_record.m_request_time = in_request_time;
+	slot.m_record.m_queue_wait = queue_wait > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(queue_wait);
+	slot.m_record.m_duration = duration > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(duration);
+	slot.m_record.m_operation = in_operation;
+	slot.m_record.m_detail = in_detail;
+	slot.m_record.m_result = in_result;
+	
+	__atomic_store_n(&slot.m_sequence, position * 2 + 2, __ATOMIC_RELEASE);
+}
+
+kern_return_t SimpleAudioControlTrace::DispatchSync(IODispatchQueue* in_queue,
+													uint16_t in_operation,
+													kern_return_t (^in_block)())
+{
+	__block kern_return_t ret = kIOReturnSuccess;
+	__block uint64_t begin_time = 0;
+	auto request_time = mach_absolute_time();
+	
+	in_queue->DispatchSync(^(){
+		begin_time = mach_absolute_time();
+		ret = in_block();
+	});
+	
+	Record(in_operation, 0, request_time, begin_time, mach_absolute_time(), ret);
+	NoteHopBegin(begin_time);
+	return ret;
+}
+
+void SimpleAudioControlTrace::DispatchAsync(IODispatchQueue* in_queue,
+											uint16_t in_operation,
+											kern_return_t (^in_block)(),
+											void (^in_completion)(kern_return_t in_result))
+{
+	auto request_time = mach_absolute_time();
+	
+	in_queue->DispatchAsync(^(){
+		auto begin_time = mach_absolute_time();
+		auto ret = in_block();
+		Record(in_operation, 0, request_time, begin_time, mach_absolute_time(), ret);
+		if (in_completion != nullptr)
+		{
+			in_completion(ret);
+		}
+	});
+}
+
+bool SimpleAudioControlTrace::BeginMethod(IODispatchQueue* in_method_queue)
+{
+	for (auto& method : m_methods)
+	{
+		IODispatchQueue* expected = nullptr;
+		if (__atomic_compare_exchange_n(&method.m_queue, &expected, in_method_queue, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		{
+			method.m_begin_time = 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint64_t SimpleAudioControlTrace::EndMethod(IODispatchQueue* in_method_queue)
+{
+	for (auto& method : m_methods)
+	{
+		if (__atomic_load_n(&method.m_queue, __ATOMIC_RELAXED) == in_method_queue)
+		{
+			auto begin_time = method.m_begin_time;
+			__atomic_store_n(&method.m_queue, nullptr, __ATOMIC_RELEASE);
+			return begin_time;
+		}
+	}
+	return 0;
+}
+
+void SimpleAudioControlTrace::NoteHopBegin(uint64_t in_begin_time)
+{
+	// Only the method running on the calling queue writes its slot, so the
+	// first hop's time needs no further synchronization.
+	for (auto& method : m_methods)
+	{
+		auto queue = __atomic_load_n(&method.m_queue, __ATOMIC_ACQUIRE);
+		if (queue != nullptr && method.m_begin_time == 0 && queue->OnQueue())
+		{
+			method.m_begin_time = in_begin_time;
+			return;
+		}
+	}
+}
+
+size_t SimpleAudioControlTrace::Export(void* out_buffer, size_t in_buffer_size) const
+{
+	if (in_buffer_size < sizeof(SimpleAudioDriverControlTraceHeader))
+	{
+		return 0;
+	}
+	
+	auto header = reinterpret_cast<SimpleAudioDriverControlTraceHeader*>(out_buffer);
+	auto records = reinterpret_cast<SimpleAudioDriverControlTraceRecord*>(header + 1);
+	size_t max_records = (in_buffer_size - sizeof(*header)) / sizeof(SimpleAudioDriverControlTraceRecord);
+	
+	auto end_position = __atomic_load_n(&m_write_position, __ATOMIC_ACQUIRE);
+	auto start_position = end_position > kSimpleAudioDriverControlTraceCapacity ? end_position - kSimpleAudioDriverControlTraceCapacity : 0;
+	
+	uint32_t num_records = 0;
+	for (auto position = start_position; position < end_position && num_records < max_records; position++)
+	{
+		const auto& slot = m_slots[position % kSimpleAudioDriverControlTraceCapacity];
+		auto sequence = __atomic_load_n(&slot.m_sequence, __ATOMIC_ACQUIRE);
+		if (sequence != position * 2 + 2)
+		{
+			// Still being written, or already overwritten by a newer record.
+			continue;
+		}
+		
+		records[num_records] = slot.m_record;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot.m_sequence, __ATOMIC_RELAXED) == sequence)
+		{
+			num_records++;
+		}
+	}
+	
+	header->m_num_records = num_records;
+	header->m_timebase_numer = m_timebase_numer;
+	header->m_timebase_denom = m_timebase_denom;
+	header->m_reserved = 0;
+	header->m_total_records = end_position;
+	return sizeof(*header) + num_records * sizeof(SimpleAudioDriverControlTraceRecord);
+}
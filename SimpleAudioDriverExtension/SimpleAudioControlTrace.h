@@ -0,0 +1,79 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Headers for the trace that records how long control-plane
+            operations wait for and run on the work queue.
+*/
+
+#ifndef SimpleAudioControlTrace_h
+#define SimpleAudioControlTrace_h
+
+#include <DriverKit/IODispatchQueue.h>
+#include "SimpleAudioDriverKeys.h"
+
+#define kSimpleAudioControlTraceMaxMethods 4
+
+// A fixed-size ring of control-plane trace records. Any thread can record
+// without taking a lock: each writer claims a position with an atomic
+// increment, and each slot carries a sequence number that a reader checks
+// before and after copying to skip a record that's still being written.
+class SimpleAudioControlTrace
+{
+public:
+	void			Initialize();
+	
+	void			Record(uint16_t in_operation,
+						   uint16_t in_detail,
+						   uint64_t in_request_time,
+						   uint64_t in_begin_time,
+						   uint64_t in_end_time,
+						   kern_return_t in_result);
+	
+	// Runs the block on the queue and records the hop's wait and run time.
+	kern_return_t	DispatchSync(IODispatchQueue* in_queue,
+								 uint16_t in_operation,
+								 kern_return_t (^in_block)());
+	
+	// Queues the block and returns without waiting. The completion runs on the
+	// queue after the block, with its result, once the hop is recorded.
+	void			DispatchAsync(IODispatchQueue* in_queue,
+								  uint16_t in_operation,
+								  kern_return_t (^in_block)(),
+								  void (^in_completion)(kern_return_t in_result));
+	
+	// Times a user client method from its request to the first hop it makes.
+	// The method's queue runs one method at a time, so a hop made from that
+	// queue belongs to the method that registered it. BeginMethod returns
+	// false when every method slot is taken, and EndMethod returns the first
+	// hop's begin time, or zero when the method made no hop.
+	bool			BeginMethod(IODispatchQueue* in_method_queue);
+	uint64_t		EndMethod(IODispatchQueue* in_method_queue);
+	
+	// Copies a header and the most recent records, oldest first, and returns
+	// the number of bytes written.
+	size_t			Export(void* out_buffer, size_t in_buffer_size) const;
+	
+private:
+	struct Slot
+	{
+		uint64_t								m_sequence;
+		SimpleAudioDriverControlTraceRecord		m_record;
+	};
+	
+	struct Method
+	{
+		IODispatchQueue*	m_queue;
+		uint64_t			m_begin_time;
+	};
+	
+	void		NoteHopBegin(uint64_t in_begin_time);
+	
+	Slot		m_slots[kSimpleAudioDriverControlTraceCapacity];
+	Method		m_methods[kSimpleAudioControlTraceMaxMethods];
+	uint64_t	m_write_position;
+	uint32_t	m_timebase_numer;
+	uint32_t	m_timebase_denom;
+};
+
+#endif /* SimpleAudioControlTrace_h */
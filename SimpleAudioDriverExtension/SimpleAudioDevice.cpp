@@ -10,26 +10,42 @@ The implementation of an AudioDriverKit device that generates a
 #include "SimpleAudioDevice.h"
 #include "SimpleAudioDriver.h"
 #include "SimpleAudioDriverKeys.h"
+#include "SimpleAudioInsertChain.h"
+#include "SimpleAudioControlTrace.h"
+#include "SimpleAudioIORecorder.h"
+#include "SimpleAudioAutomation.h"
+#include "SimpleAudioCableRouter.h"
+#include "SimpleAudioInputRenderer.h"
+#include "SimpleAudioPropertyStore.h"
+#include "SimpleAudioRenderAhead.h"
+#include "SimpleAudioRenderQuality.h"
 
 // AudioDriverKit Includes
 #include <AudioDriverKit/AudioDriverKit.h>
 
 // System Includes
 #include <math.h>
+#include <string.h>
 #include <DriverKit/DriverKit.h>
 
-#define kSampleRate_1 44100.0
+#define kSampleRate_1 kSimpleAudioDriverDefaultSampleRate
 #define kSampleRate_2 48000.0
 
 #define kToneGenerationBufferFrameSize 512
 
 #define kNumInputDataSources 3
 
+#define kRenderAheadDefaultMarginFrames 4096
+#define kRenderAheadIntervalsPerMargin 4
+
+#define kRenderBudgetDefaultPercent 100
+
 struct SimpleAudioDevice_IVars
 {
 	OSSharedPtr<IOUserAudioDriver>	m_driver;
 	OSSharedPtr<IODispatchQueue>	m_work_queue;
 	
+	struct mach_timebase_info	m_timebase_info;
 	uint64_t	m_zts_host_ticks_per_buffer;
 	
 	IOUserAudioStreamBasicDescription		m_stream_format;
@@ -40,14 +56,115 @@ struct SimpleAudioDevice_IVars
 	OSSharedPtr<IOUserAudioStream>			m_input_stream;
 	OSSharedPtr<IOMemoryMap>				m_input_memory_map;
 	
+	// The input stream either has its own ring, or shares the output ring for
+	// zero-copy loopback.
+	OSSharedPtr<IOBufferMemoryDescriptor>	m_output_io_ring_buffer;
+	OSSharedPtr<IOBufferMemoryDescriptor>	m_input_io_ring_buffer;
+	uint32_t								m_io_ring_size_bytes;
+	bool									m_loopback_zero_copy;
+	bool									m_loopback_mode_change_pending;
+	uint32_t								m_loopback_mode_changes;
+	
+	// The I/O handler asks for the mode to be checked again when a block would
+	// write into a shared ring, and the timestamp timer hands that to the work queue.
+	bool									m_loopback_mode_requested;
+	bool									m_loopback_mode_scheduled;
+	
+	// Control changes from the app that arrive while the input shares the
+	// output ring wait here for the input to get its own ring back.
+	IOUserAudioSelectorValue				m_deferred_data_source;
+	float									m_deferred_volume;
+	bool									m_deferred_data_source_pending;
+	bool									m_deferred_volume_pending;
+	
 	OSSharedPtr<IOUserAudioLevelControl>	m_input_volume_control;
 	OSSharedPtr<IOUserAudioSelectorControl> m_input_selector_control;
 	IOUserAudioSelectorValueDescription 	m_data_sources[kNumInputDataSources];
 	
+	// The timestamp timer has its own queue, so control operations waiting on
+	// the work queue can't delay a timestamp.
+	OSSharedPtr<IODispatchQueue>			m_zts_queue;
 	OSSharedPtr<IOTimerDispatchSource>		m_zts_timer_event_source;
 	OSSharedPtr<OSAction>					m_zts_timer_occurred_action;
-		
-	uint64_t	m_tone_sample_index;
+	uint64_t								m_zts_wake_time;
+	double									m_zts_sample_rate; // Published before the timer starts.
+	
+	OSSharedPtr<IODispatchQueue>			m_render_queue;
+	OSSharedPtr<IOTimerDispatchSource>		m_render_ahead_timer_event_source;
+	OSSharedPtr<OSAction>					m_render_ahead_timer_occurred_action;
+	uint64_t								m_render_ahead_host_ticks_per_interval;
+	
+	// The work queue owns the settings. The staging ring is allocated the
+	// first time render-ahead is turned on, and kept until the device is freed.
+	bool						m_io_running;
+	bool						m_render_ahead_enabled;
+	uint32_t					m_render_ahead_margin_frames;
+	SimpleAudioRenderAhead		m_render_ahead;
+	int16_t*					m_render_ahead_staging;
+	size_t						m_render_ahead_staging_length;
+	bool						m_render_ahead_controls_scheduled;
+	
+	SimpleAudioDriverDeviceStatistics	m_statistics;
+	
+	// The budget is written by the work queue. The rest is owned by the I/O handler.
+	double		m_render_budget_ticks_per_frame;
+	uint32_t	m_render_budget_percent;
+	SimpleAudioRenderQuality	m_render_quality;
+	
+	SimpleAudioInsertChain		m_insert_chain;
+	
+	SimpleAudioControlTrace*	m_control_trace;
+	
+	// The I/O handler keeps the last control values it saw, so the recorder
+	// captures changes the HAL makes as well as the ones the app makes. Its
+	// slots are allocated the first time recording is turned on, and kept
+	// until the device is freed.
+	SimpleAudioIORecorder		m_io_recorder;
+	SimpleAudioIORecorder::Slot*	m_io_trace_slots;
+	IOUserAudioSelectorValue	m_io_trace_last_data_source;
+	float						m_io_trace_last_volume;
+	
+	// The I/O handler renders with the effective values: the controls, until
+	// an automation event changes them. It mirrors those changes back through
+	// the work queue, which updates the controls the HAL sees.
+	SimpleAudioAutomation		m_automation;
+	IOUserAudioSelectorValue	m_observed_data_source;
+	float						m_observed_volume;
+	IOUserAudioSelectorValue	m_effective_data_source;
+	float						m_effective_volume;
+	bool						m_automation_override;
+	bool						m_automation_mirror_pending;
+	bool						m_automation_mirror_scheduled;
+	IOUserAudioSelectorValue	m_automation_mirror_data_source;
+	float						m_automation_mirror_volume;
+	
+	// The driver's cables, and where this device's sample time zero falls on
+	// their shared timeline.
+	SimpleAudioCableRouter*		m_cable_router;
+	uint32_t					m_device_index;
+	uint64_t					m_cable_timeline_offset;
+	
+	// The store is the source of truth for the custom property's pairs, and
+	// the snapshot property is republished once after a run of batches.
+	SimpleAudioPropertyStore				m_property_store;
+	OSSharedPtr<IOUserAudioCustomProperty>	m_custom_property;
+	OSSharedPtr<IOUserAudioCustomProperty>	m_snapshot_property;
+	bool									m_snapshot_publish_scheduled;
+	
+	// In lazy mode the rings are committed by StartIO and released by the idle
+	// timer. Both run on the work queue; the byte counts are read atomically.
+	bool									m_lazy_stream_memory;
+	uint32_t								m_stream_idle_ms;
+	OSSharedPtr<IOTimerDispatchSource>		m_idle_timer_event_source;
+	OSSharedPtr<OSAction>					m_idle_timer_occurred_action;
+	uint64_t								m_ring_bytes;
+	uint64_t								m_mapped_bytes;
+	uint32_t								m_ring_commits;
+	uint32_t								m_ring_releases;
+	
+	// Helper memory allocated on first use, apart from the property store's,
+	// which the store counts itself.
+	uint64_t								m_allocated_state_bytes;
 };
 
 bool SimpleAudioDevice::init(IOUserAudioDriver* in_driver,
@@ -73,9 +190,16 @@ bool SimpleAudioDevice::init(IOUserAudioDriver* in_driver,
 	
 	ivars->m_driver = OSSharedPtr(in_driver, OSRetain);
 	ivars->m_work_queue = GetWorkQueue();
+	mach_timebase_info(&ivars->m_timebase_info);
 	
+	IODispatchQueue* zts_queue = nullptr;
 	IOTimerDispatchSource* zts_timer_event_source = nullptr;
 	OSAction* zts_timer_occurred_action = nullptr;
+	IODispatchQueue* render_queue = nullptr;
+	IOTimerDispatchSource* render_ahead_timer_event_source = nullptr;
+	OSAction* render_ahead_timer_occurred_action = nullptr;
+	IOTimerDispatchSource* idle_timer_event_source = nullptr;
+	OSAction* idle_timer_occurred_action = nullptr;
 	
 	OSSharedPtr<OSString> output_stream_name = OSSharedPtr(OSString::withCString("SimpleOutputStream"), OSNoRetain);
 
@@ -89,9 +213,16 @@ bool SimpleAudioDevice::init(IOUserAudioDriver* in_driver,
 		kSimpleAudioDriverCustomPropertySelector,
 		IOUserAudioObjectPropertyScope::Global,
 		IOUserAudioObjectPropertyElementMain };
+	IOUserAudioObjectPropertyAddress snapshot_prop_addr = {
+		kSimpleAudioDriverCustomPropertySnapshotSelector,
+		IOUserAudioObjectPropertyScope::Global,
+		IOUserAudioObjectPropertyElementMain };
 	OSSharedPtr<IOUserAudioCustomProperty> custom_property = nullptr;
-	OSSharedPtr<OSString> qualifier = nullptr;
-	OSSharedPtr<OSString> data = nullptr;
+	OSSharedPtr<IOUserAudioCustomProperty> snapshot_property = nullptr;
+	SimpleAudioDriverCustomPropertyEntry default_properties[] = {
+		{ kSimpleAudioDriverCustomPropertyQualifier0, kSimpleAudioDriverCustomPropertyDataValue0 },
+		{ kSimpleAudioDriverCustomPropertyQualifier1, kSimpleAudioDriverCustomPropertyDataValue1 },
+	};
 
 	// Configure the device and add stream objects.
 	auto data_source_0 = OSSharedPtr(OSString::withCString("Sine Tone 440"), OSNoRetain);
@@ -106,7 +237,7 @@ bool SimpleAudioDevice::init(IOUserAudioDriver* in_driver,
 	double sample_rates[] = {kSampleRate_1, kSampleRate_2};
 	SetAvailableSampleRates(sample_rates, 2);
 	SetSampleRate(kSampleRate_1);
-	const auto channels_per_frame = 1;
+	const auto channels_per_frame = kSimpleAudioDriverChannelsPerFrame;
 	IOUserAudioChannelLabel input_channel_layout[channels_per_frame] = { IOUserAudioChannelLabel::Mono };
 	IOUserAudioChannelLabel output_channel_layout[channels_per_frame] = { IOUserAudioChannelLabel::Mono };
 
@@ -140,16 +271,22 @@ bool SimpleAudioDevice::init(IOUserAudioDriver* in_driver,
 														IOUserAudioCustomPropertyDataType::String,
 														IOUserAudioCustomPropertyDataType::String);
 
-	// Set the qualifier and data-value pair on the custom property.
-	qualifier = OSSharedPtr(OSString::withCString(kSimpleAudioDriverCustomPropertyQualifier0), OSNoRetain);
-	data = OSSharedPtr(OSString::withCString(kSimpleAudioDriverCustomPropertyDataValue0), OSNoRetain);
-	custom_property->SetQualifierAndDataValue(qualifier.get(), data.get());
-    
-	// Set another qualifier and data-value pair on the custom property.
-	qualifier = OSSharedPtr(OSString::withCString(kSimpleAudioDriverCustomPropertyQualifier1), OSNoRetain);
-	data = OSSharedPtr(OSString::withCString(kSimpleAudioDriverCustomPropertyDataValue1), OSNoRetain);
-	custom_property->SetQualifierAndDataValue(qualifier.get(), data.get());
+	// The snapshot property's value is every pair of the custom property,
+	// serialized into one blob.
+	snapshot_property = IOUserAudioCustomProperty::Create(in_driver,
+														  snapshot_prop_addr,
+														  false,
+														  IOUserAudioCustomPropertyDataType::String,
+														  IOUserAudioCustomPropertyDataType::PropertyList);
+	
+	// Add both properties to the device before setting the default qualifier
+	// and data-value pairs, which also schedules the first snapshot.
 	AddCustomProperty(custom_property.get());
+	AddCustomProperty(snapshot_property.get());
+	ivars->m_property_store.Initialize();
+	ivars->m_custom_property = custom_property;
+	ivars->m_snapshot_property = snapshot_property;
+	SetCustomPropertyValues(default_properties, sizeof(default_properties) / sizeof(default_properties[0]));
 
 	// Create the IOBufferMemoryDescriptor ring buffer for the input stream.
 	/// - Tag: CreateRingBufferAndMemoryDescriptor
@@ -169,12 +306,28 @@ bool SimpleAudioDevice::init(IOUserAudioDriver* in_driver,
 	ivars->m_input_stream = IOUserAudioStream::Create(in_driver, IOUserAudioStreamDirection::Input, input_io_ring_buffer.get());
 	FailIfNULL(ivars->m_input_stream.get(), error = kIOReturnNoMemory, Failure, "failed to create input stream");
 	
+	// Keep both rings so the input stream can switch between them for loopback.
+	ivars->m_output_io_ring_buffer = output_io_ring_buffer;
+	ivars->m_input_io_ring_buffer = input_io_ring_buffer;
+	ivars->m_io_ring_size_bytes = buffer_size_bytes;
+	ivars->m_ring_bytes = 2 * buffer_size_bytes;
+	ivars->m_ring_commits = 1;
+	ivars->m_stream_idle_ms = kSimpleAudioDriverDefaultStreamIdleMs;
+	
 	//	Configure stream properties: name, available formats, and current format.
 	ivars->m_output_stream->SetName(output_stream_name.get());
 	ivars->m_output_stream->SetAvailableStreamFormats(stream_formats, 2);
 	ivars->m_stream_format = stream_formats[0];
 	ivars->m_output_stream->SetCurrentStreamFormat(&ivars->m_stream_format);
 	
+	// Prepare the input insert chain for the initial format. It stays bypassed until configured.
+	ivars->m_insert_chain.Initialize();
+	ivars->m_insert_chain.Prepare(channels_per_frame, ivars->m_stream_format.mSampleRate);
+	
+	// The I/O recorder stays off until the app asks for a capture.
+	ivars->m_io_recorder.Initialize();
+	ivars->m_automation.Initialize();
+	
 	ivars->m_input_stream->SetName(input_stream_name.get());
 	ivars->m_input_stream->SetAvailableStreamFormats(stream_formats, 2);
 	ivars->m_input_stream->SetCurrentStreamFormat(&ivars->m_stream_format);
@@ -225,9 +378,21 @@ bool SimpleAudioDevice::init(IOUserAudioDriver* in_driver,
 	SetPreferredInputChannelLayout(input_channel_layout, channels_per_frame);
 	SetTransportType(IOUserAudioTransportType::Thunderbolt);
 
+	// Record control-plane operations into the driver's trace.
+	FailIfNULL(OSDynamicCast(SimpleAudioDriver, in_driver), error = kIOReturnBadArgument, Failure, "Device needs a SimpleAudioDriver");
+	ivars->m_control_trace = OSDynamicCast(SimpleAudioDriver, in_driver)->GetControlTrace();
+	
 	/// - Tag: InitZtsTimer
-	// Initialize the timer that stands in for a real interrupt.
-	error = IOTimerDispatchSource::Create(ivars->m_work_queue.get(), &zts_timer_event_source);
+	// Initialize the timer that stands in for a real interrupt, on its own queue.
+	error = IODispatchQueue::Create("SimpleAudioDeviceTimestamps", 0, 0, &zts_queue);
+	FailIfError(error, , Failure, "failed to create the ZTS queue");
+	ivars->m_zts_queue = OSSharedPtr(zts_queue, OSNoRetain);
+	
+	// The handler's QUEUENAME in SimpleAudioDevice.iig names this queue.
+	error = SetDispatchQueue("SimpleAudioDeviceTimestamps", ivars->m_zts_queue.get());
+	FailIfError(error, , Failure, "failed to set the ZTS queue");
+	
+	error = IOTimerDispatchSource::Create(ivars->m_zts_queue.get(), &zts_timer_event_source);
 	FailIfError(error, , Failure, "failed to create the ZTS timer event source");
 	ivars->m_zts_timer_event_source = OSSharedPtr(zts_timer_event_source, OSNoRetain);
 	
@@ -237,6 +402,41 @@ bool SimpleAudioDevice::init(IOUserAudioDriver* in_driver,
 	ivars->m_zts_timer_occurred_action = OSSharedPtr(zts_timer_occurred_action, OSNoRetain);
 	ivars->m_zts_timer_event_source->SetHandler(ivars->m_zts_timer_occurred_action.get());
 	
+	/// - Tag: InitRenderAhead
+	// Create the queue and timer for the render-ahead producer, which synthesizes
+	// generated input ahead of the HAL so the I/O handler only has to copy it.
+	ivars->m_render_ahead_margin_frames = kRenderAheadDefaultMarginFrames;
+	ivars->m_render_ahead.Initialize();
+	ivars->m_render_ahead.SetSampleRate(ivars->m_stream_format.mSampleRate);
+	ivars->m_render_budget_percent = kRenderBudgetDefaultPercent;
+	error = IODispatchQueue::Create("SimpleAudioDeviceRenderAhead", 0, 0, &render_queue);
+	FailIfError(error, , Failure, "failed to create the render-ahead queue");
+	ivars->m_render_queue = OSSharedPtr(render_queue, OSNoRetain);
+	
+	// As with the ZTS timer, the handler's QUEUENAME names this queue.
+	error = SetDispatchQueue("SimpleAudioDeviceRenderAhead", ivars->m_render_queue.get());
+	FailIfError(error, , Failure, "failed to set the render-ahead queue");
+	
+	error = IOTimerDispatchSource::Create(ivars->m_render_queue.get(), &render_ahead_timer_event_source);
+	FailIfError(error, , Failure, "failed to create the render-ahead timer event source");
+	ivars->m_render_ahead_timer_event_source = OSSharedPtr(render_ahead_timer_event_source, OSNoRetain);
+	
+	error = CreateActionRenderAheadTimerOccurred(sizeof(void*), &render_ahead_timer_occurred_action);
+	FailIfError(error, , Failure, "failed to create the render-ahead timer action");
+	ivars->m_render_ahead_timer_occurred_action = OSSharedPtr(render_ahead_timer_occurred_action, OSNoRetain);
+	ivars->m_render_ahead_timer_event_source->SetHandler(ivars->m_render_ahead_timer_occurred_action.get());
+	
+	/// - Tag: InitIdleTimer
+	// Create the timer that releases the stream rings of an idle device in lazy mode.
+	error = IOTimerDispatchSource::Create(ivars->m_work_queue.get(), &idle_timer_event_source);
+	FailIfError(error, , Failure, "failed to create the idle timer event source");
+	ivars->m_idle_timer_event_source = OSSharedPtr(idle_timer_event_source, OSNoRetain);
+	
+	error = CreateActionIdleTimerOccurred(sizeof(void*), &idle_timer_occurred_action);
+	FailIfError(error, , Failure, "failed to create the idle timer action");
+	ivars->m_idle_timer_occurred_action = OSSharedPtr(idle_timer_occurred_action, OSNoRetain);
+	ivars->m_idle_timer_event_source->SetHandler(ivars->m_idle_timer_occurred_action.get());
+	
 	/// - Tag: CreateRealTimeAudioCallback
 	io_operation = ^kern_return_t(IOUserAudioObjectID in_device,
 								  IOUserAudioIOOperation in_io_operation,
@@ -244,46 +444,87 @@ bool SimpleAudioDevice::init(IOUserAudioDriver* in_driver,
 								  uint64_t in_sample_time,
 								  uint64_t in_host_time)
 	{
+		/// - Tag: RecordIOOperation
+		// Each operation is recorded exactly as the HAL issued it, so a replay sees the same timing.
 		if (in_io_operation == IOUserAudioIOOperationWriteEnd)
 		{
-			// no-op, Host has written data to the output buffer
+			// Host has written data to the output buffer.
+			ivars->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_WriteEnd, in_io_buffer_frame_size, in_sample_time, in_host_time);
+			
+			/// - Tag: WriteCables
+			// Copy the block once into each cable that leaves this device.
+			if (ivars->m_cable_router != nullptr && ivars->m_output_memory_map.get() != nullptr)
+			{
+				const auto& format = ivars->m_stream_format;
+				auto output_buffer_length = ivars->m_output_memory_map->GetLength() / sizeof(int16_t);
+				auto output_buffer = reinterpret_cast<int16_t*>(ivars->m_output_memory_map->GetAddress() + ivars->m_output_memory_map->GetOffset());
+				auto timeline_frame = in_sample_time + __atomic_load_n(&ivars->m_cable_timeline_offset, __ATOMIC_ACQUIRE);
+				ivars->m_cable_router->Write(ivars->m_device_index, timeline_frame, output_buffer, output_buffer_length, in_sample_time,
+											 format.mChannelsPerFrame, static_cast<uint32_t>(format.mSampleRate), in_io_buffer_frame_size);
+			}
 		}
 		else if (in_io_operation == IOUserAudioIOOperationBeginRead)
 		{
-			// Either generate tone, or loopback data from the output buffer.
+			ivars->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_BeginRead, in_io_buffer_frame_size, in_sample_time, in_host_time);
+			
+			// Time the block against its budget, and render at the tier the last blocks allowed.
+			auto render_begin_time = mach_absolute_time();
+			auto quality_tier = ivars->m_render_quality.GetTier();
+			
+			// The data source either generates tone, or loops back data from the output buffer.
 			IOUserAudioSelectorValue tone_selector_value = 0;
 			ivars->m_input_selector_control->GetCurrentSelectedValues(&tone_selector_value, 1);
-
-			// Loopback output to input buffer.
-			if (tone_selector_value == 0)
+			auto input_volume_level = ivars->m_input_volume_control->GetScalarValue();
+			RecordControlChanges(tone_selector_value, input_volume_level, in_sample_time, in_host_time);
+			ObserveControlValues(tone_selector_value, input_volume_level);
+			
+			/// - Tag: SplitAtAutomationEvents
+			// Render the block in segments that end at each scheduled event, so
+			// every change lands on its exact frame. Without events, the whole
+			// block is one segment and can come from the render-ahead producer.
+			ivars->m_automation.Collect();
+			auto block_end = in_sample_time + in_io_buffer_frame_size;
+			auto segment_start = in_sample_time;
+			while (segment_start < block_end)
 			{
-				if ((ivars->m_input_memory_map.get() == nullptr) || (ivars->m_output_memory_map.get() == nullptr))
+				ApplyAutomationEvents(segment_start, in_sample_time, in_host_time);
+				auto next_event_time = ivars->m_automation.NextEventTime();
+				auto segment_end = next_event_time < block_end ? next_event_time : block_end;
+				auto whole_block = segment_start == in_sample_time && segment_end == block_end;
+				
+				auto error = RenderInputSegment(ivars->m_effective_data_source,
+												ivars->m_effective_volume,
+												segment_start,
+												static_cast<uint32_t>(segment_end - segment_start),
+												quality_tier >= SimpleAudioDriverQualityTier_CheapOscillator,
+												whole_block && !ivars->m_automation_override);
+				if (error != kIOReturnSuccess)
 				{
-					return kIOReturnNoMemory;
+					return error;
 				}
-				
-				auto input_volume_level = ivars->m_input_volume_control->GetScalarValue();
-
-				const auto& format = ivars->m_stream_format;
-				auto output_buffer_length = ivars->m_output_memory_map->GetLength() / sizeof(int16_t);
-				auto output_buffer = reinterpret_cast<int16_t*>(ivars->m_output_memory_map->GetAddress() + ivars->m_output_memory_map->GetOffset());
-				
-				auto input_buffer_length = ivars->m_input_memory_map->GetLength() / sizeof(int16_t);
-				auto input_buffer = reinterpret_cast<int16_t*>(ivars->m_input_memory_map->GetAddress() + ivars->m_input_memory_map->GetOffset());
-
-				for (auto i = 0; i < (format.mChannelsPerFrame * in_io_buffer_frame_size); i++)
+				segment_start = segment_end;
+			}
+			
+			/// - Tag: ProcessInsertChain
+			// Run the insert chain over the block the data source just produced.
+			// A shared ring holds the host's output, which the chain must not
+			// rewrite, so the block passes through until the device copies again.
+			if (__atomic_load_n(&ivars->m_loopback_zero_copy, __ATOMIC_RELAXED))
+			{
+				if (ivars->m_insert_chain.IsActive())
 				{
-					auto input_buffer_index = (format.mChannelsPerFrame * in_sample_time + i) % input_buffer_length;
-					auto output_buffer_index = (format.mChannelsPerFrame * in_sample_time + i) % output_buffer_length;
-					input_buffer[input_buffer_index] = input_volume_level * output_buffer[output_buffer_index];
+					__atomic_store_n(&ivars->m_loopback_mode_requested, true, __ATOMIC_RELEASE);
 				}
 			}
-			else
+			else if (ivars->m_input_memory_map.get() != nullptr)
 			{
-				// Generate tone using the selector control value as the tone frequency.
-				double frequency = static_cast<double>(tone_selector_value);
-				GenerateToneForInput(frequency, in_sample_time, in_io_buffer_frame_size);
+				auto input_buffer_length = ivars->m_input_memory_map->GetLength() / sizeof(int16_t);
+				auto input_buffer = reinterpret_cast<int16_t*>(ivars->m_input_memory_map->GetAddress() + ivars->m_input_memory_map->GetOffset());
+				ivars->m_insert_chain.Process(input_buffer, input_buffer_length, in_sample_time, in_io_buffer_frame_size,
+											  quality_tier >= SimpleAudioDriverQualityTier_BypassEqualizer);
 			}
+			
+			UpdateRenderQuality(in_io_buffer_frame_size, mach_absolute_time() - render_begin_time);
 		}
 		
 		return kIOReturnSuccess;
@@ -300,9 +541,19 @@ Failure:
 	ivars->m_output_memory_map.reset();
 	ivars->m_input_stream.reset();
 	ivars->m_input_memory_map.reset();
+	ivars->m_output_io_ring_buffer.reset();
+	ivars->m_input_io_ring_buffer.reset();
 	ivars->m_input_volume_control.reset();
 	ivars->m_zts_timer_event_source.reset();
 	ivars->m_zts_timer_occurred_action.reset();
+	ivars->m_zts_queue.reset();
+	ivars->m_render_ahead_timer_event_source.reset();
+	ivars->m_render_ahead_timer_occurred_action.reset();
+	ivars->m_render_queue.reset();
+	ivars->m_idle_timer_event_source.reset();
+	ivars->m_idle_timer_occurred_action.reset();
+	ivars->m_custom_property.reset();
+	ivars->m_snapshot_property.reset();
 	return false;
 }
 
@@ -315,11 +566,24 @@ void SimpleAudioDevice::free()
 		ivars->m_output_memory_map.reset();
 		ivars->m_input_stream.reset();
 		ivars->m_input_memory_map.reset();
+		ivars->m_output_io_ring_buffer.reset();
+		ivars->m_input_io_ring_buffer.reset();
 		ivars->m_input_volume_control.reset();
 		ivars->m_input_selector_control.reset();
 		ivars->m_zts_timer_event_source.reset();
 		ivars->m_zts_timer_occurred_action.reset();
+		ivars->m_zts_queue.reset();
+		ivars->m_render_ahead_timer_event_source.reset();
+		ivars->m_render_ahead_timer_occurred_action.reset();
+		ivars->m_render_queue.reset();
+		ivars->m_idle_timer_event_source.reset();
+		ivars->m_idle_timer_occurred_action.reset();
 		ivars->m_work_queue.reset();
+		ivars->m_custom_property.reset();
+		ivars->m_snapshot_property.reset();
+		IOSafeDeleteNULL(ivars->m_render_ahead_staging, int16_t, ivars->m_render_ahead_staging_length);
+		IOSafeDeleteNULL(ivars->m_io_trace_slots, SimpleAudioIORecorder::Slot, kSimpleAudioDriverIOTraceCapacity);
+		ivars->m_property_store.Free();
 	}
 	IOSafeDeleteNULL(ivars, SimpleAudioDevice_IVars, 1);
 	super::free();
@@ -330,11 +594,20 @@ kern_return_t SimpleAudioDevice::StartIO(IOUserAudioStartStopFlags in_flags)
 {
 	DebugMsg("Start I/O: device %u", GetObjectID());
 	
-	__block kern_return_t error = kIOReturnSuccess;
 	__block OSSharedPtr<IOMemoryDescriptor> input_iomd;
 	__block OSSharedPtr<IOMemoryDescriptor> output_iomd;
 
-	ivars->m_work_queue->DispatchSync(^(){
+	return ivars->m_control_trace->DispatchSync(ivars->m_work_queue.get(), SimpleAudioDriverControlOperation_StartIO, ^kern_return_t(){
+		// A lazy device may have released its rings while I/O was stopped, so
+		// give the streams their buffers before the HAL asks for them.
+		ivars->m_idle_timer_event_source->SetEnable(false);
+		kern_return_t error = CommitStreamMemory();
+		if (error != kIOReturnSuccess)
+		{
+			DebugMsg("Failed to commit the stream ring buffers, error %d", error);
+			return error;
+		}
+		
 		//	Tell IOUserAudioObject base class to start I/O for the device.
 		error = super::StartIO(in_flags);
 		FailIfError(error, , Failure, "Failed to start I/O");
@@ -348,19 +621,21 @@ kern_return_t SimpleAudioDevice::StartIO(IOUserAudioStartStopFlags in_flags)
 		FailIfNULL(input_iomd.get(), error = kIOReturnNoMemory, Failure, "Failed to get input stream IOMemoryDescriptor");
 		error = input_iomd->CreateMapping(0, 0, 0, 0, 0, ivars->m_input_memory_map.attach());
 		FailIf(error != kIOReturnSuccess, , Failure, "Failed to create memory map from input stream IOMemoryDescriptor");
+		__atomic_store_n(&ivars->m_mapped_bytes, ivars->m_output_memory_map->GetLength() + ivars->m_input_memory_map->GetLength(), __ATOMIC_RELAXED);
 
 		// Start the timers to send timestamps and generate sine tone on the stream I/O buffer.
 		StartTimers();
-		return;
+		ivars->m_io_running = true;
+		ivars->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_StartIO, 0, 0, mach_absolute_time());
+		return kIOReturnSuccess;
 		
 	Failure:
 		super::StopIO(in_flags);
 		ivars->m_output_memory_map.reset();
 		ivars->m_input_memory_map.reset();
-		return;
+		__atomic_store_n(&ivars->m_mapped_bytes, 0, __ATOMIC_RELAXED);
+		return error;
 	});
-
-	return error;
 }
 
 kern_return_t SimpleAudioDevice::StopIO(IOUserAudioStartStopFlags in_flags)
@@ -368,13 +643,18 @@ kern_return_t SimpleAudioDevice::StopIO(IOUserAudioStartStopFlags in_flags)
 	DebugMsg("Stop IO: device %u", GetObjectID());
 
 	// Tell the IOUserAudioObject base class to stop I/O for the device.
-	__block kern_return_t error;
-	
-	ivars->m_work_queue->DispatchSync(^(){
+	auto error = ivars->m_control_trace->DispatchSync(ivars->m_work_queue.get(), SimpleAudioDriverControlOperation_StopIO, ^kern_return_t(){
 		// Stop the timers for timestamps and sine tone generator.
 		StopTimers();
+		ivars->m_io_running = false;
+		ivars->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_StopIO, 0, 0, mach_absolute_time());
 
-		error = super::StopIO(in_flags);
+		auto ret = super::StopIO(in_flags);
+		if (ivars->m_lazy_stream_memory)
+		{
+			ScheduleStreamMemoryRelease();
+		}
+		return ret;
 	});
 
 
@@ -390,6 +670,7 @@ kern_return_t SimpleAudioDevice::StopIO(IOUserAudioStartStopFlags in_flags)
 kern_return_t SimpleAudioDevice::PerformDeviceConfigurationChange(uint64_t change_action, OSObject* in_change_info)
 {
 	DebugMsg("change action %llu", change_action);
+	auto request_time = mach_absolute_time();
 	kern_return_t ret = kIOReturnSuccess;
 	switch (change_action) {
 			// Add custom config change handlers.
@@ -413,6 +694,10 @@ kern_return_t SimpleAudioDevice::PerformDeviceConfigurationChange(uint64_t chang
 		}
 			break;
 			
+		case k_loopback_mode_config_change_action:
+			ret = ApplyLoopbackMode();
+			break;
+			
 		default:
 			ret = super::PerformDeviceConfigurationChange(change_action, in_change_info);
 			break;
@@ -420,7 +705,12 @@ kern_return_t SimpleAudioDevice::PerformDeviceConfigurationChange(uint64_t chang
 	
 	// Update the cached format.
 	ivars->m_stream_format = ivars->m_input_stream->GetCurrentStreamFormat();
+	ivars->m_insert_chain.Prepare(ivars->m_stream_format.mChannelsPerFrame, ivars->m_stream_format.mSampleRate);
+	ivars->m_render_ahead.SetSampleRate(ivars->m_stream_format.mSampleRate);
+	ivars->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_SampleRate, static_cast<uint32_t>(ivars->m_stream_format.mSampleRate), 0, mach_absolute_time());
 	
+	ivars->m_control_trace->Record(SimpleAudioDriverControlOperation_PerformConfigChange, static_cast<uint16_t>(change_action),
+								   request_time, request_time, mach_absolute_time(), ret);
 	return ret;
 }
 
@@ -435,20 +725,16 @@ kern_return_t SimpleAudioDevice::HandleChangeSampleRate(double in_sample_rate)
 	// This method runs when the HAL changes the sample rate of the device.
 	// Add custom operations here to configure hardware and return success
 	// to continue with the sample rate change.
-	return SetSampleRate(in_sample_rate);
-}
-
-inline int16_t SimpleAudioDevice::FloatToInt16(float in_sample)
-{
-	if (in_sample > 1.0f)
-	{
-		in_sample = 1.0f;
-	}
-	else if (in_sample < -1.0f)
+	auto request_time = mach_absolute_time();
+	auto ret = SetSampleRate(in_sample_rate);
+	if (ret == kIOReturnSuccess)
 	{
-		in_sample = -1.0f;
+		ivars->m_insert_chain.Prepare(ivars->m_stream_format.mChannelsPerFrame, in_sample_rate);
+		ivars->m_render_ahead.SetSampleRate(in_sample_rate);
+		ivars->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_SampleRate, static_cast<uint32_t>(in_sample_rate), 0, mach_absolute_time());
 	}
-	return static_cast<int16_t>(in_sample * 0x7fff);
+	ivars->m_control_trace->Record(SimpleAudioDriverControlOperation_ChangeSampleRate, 0, request_time, request_time, mach_absolute_time(), ret);
+	return ret;
 }
 
 kern_return_t SimpleAudioDevice::StartTimers()
@@ -464,9 +750,30 @@ kern_return_t SimpleAudioDevice::StartTimers()
 		UpdateCurrentZeroTimestamp(0, 0);
 		auto current_time = mach_absolute_time();
 
+		// Sample times restart from zero, so anything rendered ahead is stale.
+		ivars->m_render_ahead.Reset();
+		bzero(&ivars->m_statistics, sizeof(ivars->m_statistics));
+		
+		// The work queue changes the stream format, so give the handler its
+		// own copy of the rate before the timer can fire.
+		auto sample_rate = ivars->m_stream_format.mSampleRate;
+		__atomic_store(&ivars->m_zts_sample_rate, &sample_rate, __ATOMIC_RELEASE);
+		
 		// Start the timer. The first timestamp occurs when the timer goes off.
-		ivars->m_zts_timer_event_source->WakeAtTime(kIOTimerClockMachAbsoluteTime, current_time + ivars->m_zts_host_ticks_per_buffer, 0);
+		ivars->m_zts_wake_time = current_time + __atomic_load_n(&ivars->m_zts_host_ticks_per_buffer, __ATOMIC_RELAXED);
+		ivars->m_zts_timer_event_source->WakeAtTime(kIOTimerClockMachAbsoluteTime, ivars->m_zts_wake_time, 0);
 		ivars->m_zts_timer_event_source->SetEnable(true);
+		
+		// Scheduled events refer to the old sample times.
+		ivars->m_automation.Clear();
+		
+		// Every run starts at full quality.
+		ivars->m_render_quality.Initialize();
+		if (ivars->m_render_ahead_enabled && ivars->m_render_ahead_timer_event_source.get() != nullptr)
+		{
+			ivars->m_render_ahead_timer_event_source->WakeAtTime(kIOTimerClockMachAbsoluteTime, current_time, 0);
+			ivars->m_render_ahead_timer_event_source->SetEnable(true);
+		}
 	}
 	else
 	{
@@ -481,18 +788,39 @@ void	SimpleAudioDevice::StopTimers()
 	if(ivars->m_zts_timer_event_source.get() != nullptr)
 	{
 		ivars->m_zts_timer_event_source->SetEnable(false);
+		
+		// Wait out a timestamp that's already running, so the next start
+		// doesn't race it.
+		ivars->m_zts_queue->DispatchSync(^{});
+	}
+	if(ivars->m_render_ahead_timer_event_source.get() != nullptr)
+	{
+		ivars->m_render_ahead_timer_event_source->SetEnable(false);
+		
+		// Wait out a render that's already running as well, so it's finished
+		// before StopIO or a loopback mode change touches the streams.
+		ivars->m_render_queue->DispatchSync(^{});
 	}
 }
 
 void	SimpleAudioDevice::UpdateTimers()
 {
-	struct mach_timebase_info timebase_info;
-	mach_timebase_info(&timebase_info);
+	const auto& timebase_info = ivars->m_timebase_info;
 	
 	double sample_rate = ivars->m_stream_format.mSampleRate;
 	double host_ticks_per_buffer = static_cast<double>(GetZeroTimestampPeriod() * NSEC_PER_SEC) / sample_rate;
 	host_ticks_per_buffer = (host_ticks_per_buffer * static_cast<double>(timebase_info.denom)) / static_cast<double>(timebase_info.numer);
-	ivars->m_zts_host_ticks_per_buffer = static_cast<uint64_t>(host_ticks_per_buffer);
+	__atomic_store_n(&ivars->m_zts_host_ticks_per_buffer, static_cast<uint64_t>(host_ticks_per_buffer), __ATOMIC_RELAXED);
+	
+	// Wake the render-ahead producer several times per margin so it stays ahead.
+	double host_ticks_per_interval = static_cast<double>(ivars->m_render_ahead_margin_frames / kRenderAheadIntervalsPerMargin * NSEC_PER_SEC) / sample_rate;
+	host_ticks_per_interval = (host_ticks_per_interval * static_cast<double>(timebase_info.denom)) / static_cast<double>(timebase_info.numer);
+	ivars->m_render_ahead_host_ticks_per_interval = static_cast<uint64_t>(host_ticks_per_interval);
+	
+	// The I/O handler may spend this share of each frame's real time rendering it.
+	double render_budget_ticks_per_frame = static_cast<double>(NSEC_PER_SEC) / sample_rate * static_cast<double>(ivars->m_render_budget_percent) / 100.0;
+	render_budget_ticks_per_frame = (render_budget_ticks_per_frame * static_cast<double>(timebase_info.denom)) / static_cast<double>(timebase_info.numer);
+	__atomic_store(&ivars->m_render_budget_ticks_per_frame, &render_budget_ticks_per_frame, __ATOMIC_RELAXED);
 }
 
 /// - Tag: ZtsTimerOccurred
@@ -501,12 +829,25 @@ void	SimpleAudioDevice::ZtsTimerOccurred_Impl(OSAction* action, uint64_t time)
 	// Get the current time.
 	auto current_time = time;
 	
+	// Measure how late the timer woke, to show how well the queue keeps time.
+	auto now = mach_absolute_time();
+	if (now > ivars->m_zts_wake_time)
+	{
+		auto lateness_ns = (now - ivars->m_zts_wake_time) * ivars->m_timebase_info.numer / ivars->m_timebase_info.denom;
+		__atomic_add_fetch(&ivars->m_statistics.m_zts_timer_total_lateness_ns, lateness_ns, __ATOMIC_RELAXED);
+		if (lateness_ns > __atomic_load_n(&ivars->m_statistics.m_zts_timer_max_lateness_ns, __ATOMIC_RELAXED))
+		{
+			__atomic_store_n(&ivars->m_statistics.m_zts_timer_max_lateness_ns, static_cast<uint32_t>(lateness_ns < UINT32_MAX ? lateness_ns : UINT32_MAX), __ATOMIC_RELAXED);
+		}
+	}
+	__atomic_add_fetch(&ivars->m_statistics.m_zts_timer_count, 1, __ATOMIC_RELAXED);
+	
 	// Increment the timestamps...
 	uint64_t current_sample_time = 0;
 	uint64_t current_host_time = 0;
 	GetCurrentZeroTimestamp(&current_sample_time, &current_host_time);
 	
-	auto host_ticks_per_buffer = ivars->m_zts_host_ticks_per_buffer;
+	auto host_ticks_per_buffer = __atomic_load_n(&ivars->m_zts_host_ticks_per_buffer, __ATOMIC_RELAXED);
 	
 	if(current_host_time != 0)
 	{
@@ -518,68 +859,877 @@ void	SimpleAudioDevice::ZtsTimerOccurred_Impl(OSAction* action, uint64_t time)
 		// ...but not if it's the first one.
 		current_sample_time = 0;
 		current_host_time = current_time;
+		
+		// Place this run's sample time zero on the cables' shared timeline.
+		if (ivars->m_cable_router != nullptr)
+		{
+			double sample_rate = 0.0;
+			__atomic_load(&ivars->m_zts_sample_rate, &sample_rate, __ATOMIC_ACQUIRE);
+			auto timeline_offset = ivars->m_cable_router->TimelineFrame(current_host_time, sample_rate);
+			__atomic_store_n(&ivars->m_cable_timeline_offset, timeline_offset, __ATOMIC_RELEASE);
+		}
 	}
 	
 	// Update the device with the current timestamp.
 	UpdateCurrentZeroTimestamp(current_sample_time, current_host_time);
+	ivars->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_ZeroTimestamp, 0, current_sample_time, current_host_time);
+	
+	// The controls belong to the work queue, so hand automated values to it
+	// without waiting, and at most once until it has run.
+	if (__atomic_load_n(&ivars->m_automation_mirror_pending, __ATOMIC_RELAXED) &&
+		!__atomic_exchange_n(&ivars->m_automation_mirror_scheduled, true, __ATOMIC_ACQUIRE))
+	{
+		retain();
+		ivars->m_work_queue->DispatchAsync(^{
+			__atomic_store_n(&ivars->m_automation_mirror_scheduled, false, __ATOMIC_RELEASE);
+			MirrorAutomation();
+			release();
+		});
+	}
+	
+	// Likewise for a block that found the input sharing the output ring when
+	// it needed its own.
+	if (__atomic_load_n(&ivars->m_loopback_mode_requested, __ATOMIC_RELAXED) &&
+		!__atomic_exchange_n(&ivars->m_loopback_mode_scheduled, true, __ATOMIC_ACQUIRE))
+	{
+		retain();
+		ivars->m_work_queue->DispatchAsync(^{
+			__atomic_store_n(&ivars->m_loopback_mode_scheduled, false, __ATOMIC_RELEASE);
+			__atomic_store_n(&ivars->m_loopback_mode_requested, false, __ATOMIC_RELAXED);
+			UpdateLoopbackMode();
+			release();
+		});
+	}
 	
 	// Set the timer to go off in one buffer.
-	ivars->m_zts_timer_event_source->WakeAtTime(kIOTimerClockMachAbsoluteTime,
-												current_host_time + host_ticks_per_buffer, 0);
+	ivars->m_zts_wake_time = current_host_time + host_ticks_per_buffer;
+	ivars->m_zts_timer_event_source->WakeAtTime(kIOTimerClockMachAbsoluteTime, ivars->m_zts_wake_time, 0);
 }
 
-/// - Tag: GenerateToneForInput
-void SimpleAudioDevice::GenerateToneForInput(double in_tone_freq, size_t in_sample_time, size_t in_frame_size)
+/// - Tag: RenderAheadTimerOccurred
+void	SimpleAudioDevice::RenderAheadTimerOccurred_Impl(OSAction* action, uint64_t time)
 {
-	// Fill out the input buffer with a sine tone.
-	if (ivars->m_input_memory_map)
+	// The controls belong to the work queue, so when the I/O handler sees values
+	// the producer doesn't have, ask the work queue for a new snapshot.
+	if (ivars->m_render_ahead.TakeControlsRequest() &&
+		!__atomic_exchange_n(&ivars->m_render_ahead_controls_scheduled, true, __ATOMIC_ACQUIRE))
 	{
-		// Get the pointer to the I/O buffer and use stream format information
-		// to get the buffer length.
-		const auto& format = ivars->m_stream_format;
-		auto buffer_length = ivars->m_input_memory_map->GetLength() / (format.mBytesPerFrame / format.mChannelsPerFrame);
-		auto num_samples = in_frame_size;
-		auto buffer = reinterpret_cast<int16_t*>(ivars->m_input_memory_map->GetAddress() + ivars->m_input_memory_map->GetOffset());
+		retain();
+		ivars->m_work_queue->DispatchAsync(^{
+			__atomic_store_n(&ivars->m_render_ahead_controls_scheduled, false, __ATOMIC_RELEASE);
+			UpdateRenderAheadControls();
+			release();
+		});
+	}
+	
+	// This runs on the render queue, never on the I/O handler's deadline.
+	ivars->m_render_ahead.Render();
+	
+	ivars->m_render_ahead_timer_event_source->WakeAtTime(kIOTimerClockMachAbsoluteTime,
+														 time + ivars->m_render_ahead_host_ticks_per_interval, 0);
+}
 
-		// Get the volume control dB value to apply gain to the tone.
-		auto input_volume_level = ivars->m_input_volume_control->GetScalarValue();
-		
-		for(size_t i = 0; i < num_samples; i++)
+void SimpleAudioDevice::UpdateRenderAheadControls()
+{
+	// This runs on the work queue, which owns the controls.
+	IOUserAudioSelectorValue data_source = 0;
+	ivars->m_input_selector_control->GetCurrentSelectedValues(&data_source, 1);
+	ivars->m_render_ahead.SetControls(data_source, ivars->m_input_volume_control->GetScalarValue());
+}
+
+kern_return_t SimpleAudioDevice::ToggleDataSource()
+{
+	// The caller is on the work queue, and records the operation in the trace.
+	// A toggle that's still waiting on a loopback mode change counts as made.
+	IOUserAudioSelectorValue current_data_source_value = ivars->m_deferred_data_source;
+	if (!ivars->m_deferred_data_source_pending)
+	{
+		ivars->m_input_selector_control->GetCurrentSelectedValues(&current_data_source_value, 1);
+	}
+	
+	IOUserAudioSelectorValue data_source_value_to_set = current_data_source_value;
+	if (current_data_source_value == ivars->m_data_sources[0].m_value)
+	{
+		data_source_value_to_set = ivars->m_data_sources[1].m_value;
+	}
+	else if (current_data_source_value == ivars->m_data_sources[1].m_value)
+	{
+		data_source_value_to_set = ivars->m_data_sources[2].m_value;
+	}
+	else
+	{
+		data_source_value_to_set = ivars->m_data_sources[0].m_value;
+	}
+	return ChangeInputControls(&data_source_value_to_set, nullptr);
+}
+
+kern_return_t SimpleAudioDevice::SetDataSource(IOUserAudioSelectorValue in_data_source_value)
+{
+	// The caller is on the work queue, so only accept values the selector control publishes.
+	for (auto i = 0; i < kNumInputDataSources; i++)
+	{
+		if (ivars->m_data_sources[i].m_value == in_data_source_value)
 		{
-			float float_value = input_volume_level * sin(2.0 * M_PI * in_tone_freq * static_cast<double>(ivars->m_tone_sample_index) / format.mSampleRate);
-			int16_t integer_value = FloatToInt16(float_value);
-			for (auto channel_index = 0; channel_index < format.mChannelsPerFrame; channel_index++)
-			{
-				auto buffer_index = (format.mChannelsPerFrame * (in_sample_time + i) + channel_index) % buffer_length;
-				buffer[buffer_index] = integer_value;
-			}
-			ivars->m_tone_sample_index += 1;
+			return ChangeInputControls(&in_data_source_value, nullptr);
 		}
 	}
+	return kIOReturnBadArgument;
 }
 
-kern_return_t SimpleAudioDevice::ToggleDataSource()
+kern_return_t SimpleAudioDevice::SetInputVolume(float in_scalar_value)
 {
-	__block kern_return_t ret = kIOReturnSuccess;
-	GetWorkQueue()->DispatchSync(^(){
-		IOUserAudioSelectorValue current_data_source_value;
-		ivars->m_input_selector_control->GetCurrentSelectedValues(&current_data_source_value, 1);
+	if (!(in_scalar_value >= 0.0f && in_scalar_value <= 1.0f))
+	{
+		return kIOReturnBadArgument;
+	}
+	return ChangeInputControls(nullptr, &in_scalar_value);
+}
+
+/// - Tag: ChangeInputControls
+kern_return_t SimpleAudioDevice::ChangeInputControls(const IOUserAudioSelectorValue* in_data_source, const float* in_volume)
+{
+	// While the input shares the output ring, the I/O handler can't write a
+	// tone or a gain into it, so a change that needs one would be lost until
+	// the HAL switched the rings. Hold it until ApplyLoopbackMode has given
+	// the input its own ring, along with any change already held, so the
+	// changes still apply in order.
+	auto ends_zero_copy = (in_data_source != nullptr && *in_data_source != 0) || (in_volume != nullptr && *in_volume != 1.0f);
+	if (ivars->m_loopback_zero_copy && (ends_zero_copy || ivars->m_deferred_data_source_pending || ivars->m_deferred_volume_pending))
+	{
+		if (in_data_source != nullptr)
+		{
+			ivars->m_deferred_data_source = *in_data_source;
+			ivars->m_deferred_data_source_pending = true;
+		}
+		if (in_volume != nullptr)
+		{
+			ivars->m_deferred_volume = *in_volume;
+			ivars->m_deferred_volume_pending = true;
+		}
+		UpdateLoopbackMode();
+		return kIOReturnSuccess;
+	}
+	
+	auto ret = kIOReturnSuccess;
+	if (in_data_source != nullptr)
+	{
+		ret = ivars->m_input_selector_control->SetCurrentSelectedValues(in_data_source, 1);
+	}
+	if (in_volume != nullptr && ret == kIOReturnSuccess)
+	{
+		ret = ivars->m_input_volume_control->SetScalarValue(*in_volume);
+	}
+	UpdateRenderAheadControls();
+	UpdateLoopbackMode();
+	return ret;
+}
+
+void SimpleAudioDevice::ApplyDeferredChanges()
+{
+	// This runs on the work queue once the loopback mode has been settled,
+	// or once settling it has failed, so held changes apply either way.
+	ivars->m_automation.SetHeld(false);
+	if (!ivars->m_deferred_data_source_pending && !ivars->m_deferred_volume_pending)
+	{
+		return;
+	}
+	if (ivars->m_deferred_data_source_pending)
+	{
+		ivars->m_input_selector_control->SetCurrentSelectedValues(&ivars->m_deferred_data_source, 1);
+		ivars->m_deferred_data_source_pending = false;
+	}
+	if (ivars->m_deferred_volume_pending)
+	{
+		ivars->m_input_volume_control->SetScalarValue(ivars->m_deferred_volume);
+		ivars->m_deferred_volume_pending = false;
+	}
+	UpdateRenderAheadControls();
+}
+
+kern_return_t SimpleAudioDevice::SetRenderAhead(bool in_enabled, uint32_t in_margin_frames)
+{
+	// The margin has to leave room in the ring for the block the HAL is reading.
+	if (in_enabled && (in_margin_frames < kRenderAheadIntervalsPerMargin || in_margin_frames > GetZeroTimestampPeriod() / 2))
+	{
+		return kIOReturnBadArgument;
+	}
+	
+	if (ivars->m_render_ahead_timer_event_source.get() == nullptr)
+	{
+		return kIOReturnNoResources;
+	}
+	
+	// The staging ring holds one timestamp period, which leaves room for the
+	// margin and the block the HAL is reading.
+	if (in_enabled && !ivars->m_render_ahead.HasStaging())
+	{
+		auto num_channels = ivars->m_stream_format.mChannelsPerFrame;
+		auto staging_length = static_cast<size_t>(GetZeroTimestampPeriod()) * num_channels;
+		ivars->m_render_ahead_staging = IONewZero(int16_t, staging_length);
+		if (ivars->m_render_ahead_staging == nullptr)
+		{
+			return kIOReturnNoMemory;
+		}
+		ivars->m_render_ahead_staging_length = staging_length;
+		__atomic_add_fetch(&ivars->m_allocated_state_bytes, staging_length * sizeof(int16_t), __ATOMIC_RELAXED);
+		ivars->m_render_ahead.SetStaging(ivars->m_render_ahead_staging, GetZeroTimestampPeriod(), num_channels);
+	}
+	
+	ivars->m_render_ahead_timer_event_source->SetEnable(false);
+	if (in_enabled)
+	{
+		ivars->m_render_ahead_margin_frames = in_margin_frames;
+		UpdateRenderAheadControls();
+	}
+	ivars->m_render_ahead_enabled = in_enabled;
+	ivars->m_render_ahead.SetEnabled(in_enabled, ivars->m_render_ahead_margin_frames);
+	UpdateTimers();
+	
+	if (in_enabled && ivars->m_io_running)
+	{
+		ivars->m_render_ahead_timer_event_source->WakeAtTime(kIOTimerClockMachAbsoluteTime, mach_absolute_time(), 0);
+		ivars->m_render_ahead_timer_event_source->SetEnable(true);
+	}
+	return kIOReturnSuccess;
+}
+
+void SimpleAudioDevice::GetStatistics(SimpleAudioDriverDeviceStatistics* out_statistics)
+{
+	ivars->m_render_ahead.GetStatistics(out_statistics);
+	out_statistics->m_loopback_copied_frames = __atomic_load_n(&ivars->m_statistics.m_loopback_copied_frames, __ATOMIC_RELAXED);
+	out_statistics->m_loopback_zero_copy = __atomic_load_n(&ivars->m_loopback_zero_copy, __ATOMIC_RELAXED) ? 1 : 0;
+	out_statistics->m_loopback_mode_changes = __atomic_load_n(&ivars->m_loopback_mode_changes, __ATOMIC_RELAXED);
+	out_statistics->m_quality_tier = __atomic_load_n(&ivars->m_statistics.m_quality_tier, __ATOMIC_RELAXED);
+	out_statistics->m_quality_tier_changes = __atomic_load_n(&ivars->m_statistics.m_quality_tier_changes, __ATOMIC_RELAXED);
+	out_statistics->m_render_load_percent = __atomic_load_n(&ivars->m_statistics.m_render_load_percent, __ATOMIC_RELAXED);
+	out_statistics->m_render_peak_load_percent = __atomic_load_n(&ivars->m_statistics.m_render_peak_load_percent, __ATOMIC_RELAXED);
+	out_statistics->m_automation_events_applied = __atomic_load_n(&ivars->m_statistics.m_automation_events_applied, __ATOMIC_RELAXED);
+	out_statistics->m_automation_events_late = __atomic_load_n(&ivars->m_statistics.m_automation_events_late, __ATOMIC_RELAXED);
+	out_statistics->m_zts_timer_count = __atomic_load_n(&ivars->m_statistics.m_zts_timer_count, __ATOMIC_RELAXED);
+	out_statistics->m_zts_timer_total_lateness_ns = __atomic_load_n(&ivars->m_statistics.m_zts_timer_total_lateness_ns, __ATOMIC_RELAXED);
+	out_statistics->m_zts_timer_max_lateness_ns = __atomic_load_n(&ivars->m_statistics.m_zts_timer_max_lateness_ns, __ATOMIC_RELAXED);
+	out_statistics->m_channels_per_frame = ivars->m_stream_format.mChannelsPerFrame;
+	out_statistics->m_sample_rate = ivars->m_stream_format.mSampleRate;
+}
+
+kern_return_t SimpleAudioDevice::ConfigureInsertChain(const SimpleAudioDriverInsertChainConfig* in_config)
+{
+	// The chain publishes the new coefficients without blocking the I/O handler.
+	if (!ivars->m_insert_chain.Configure(*in_config))
+	{
+		return kIOReturnBadArgument;
+	}
+	UpdateLoopbackMode();
+	return kIOReturnSuccess;
+}
+
+bool SimpleAudioDevice::WantsZeroCopyLoopback()
+{
+	// Sharing the output ring only pays off when the input would be an exact
+	// copy of it: loopback selected, unity gain, matching formats, and no
+	// insert chain, which would otherwise rewrite the host's output in place.
+	// Held control changes and scheduled automation events may need a tone or
+	// a gain, so they keep the input on its own ring until they've applied.
+	if (ivars->m_deferred_data_source_pending || ivars->m_deferred_volume_pending || !ivars->m_automation.IsIdle())
+	{
+		return false;
+	}
+	
+	IOUserAudioSelectorValue data_source_value = 0;
+	ivars->m_input_selector_control->GetCurrentSelectedValues(&data_source_value, 1);
+	if (data_source_value != 0 || ivars->m_input_volume_control->GetScalarValue() != 1.0f || ivars->m_insert_chain.IsActive() ||
+		(ivars->m_cable_router != nullptr && ivars->m_cable_router->HasInputs(ivars->m_device_index)))
+	{
+		return false;
+	}
+	
+	auto input_format = ivars->m_input_stream->GetCurrentStreamFormat();
+	auto output_format = ivars->m_output_stream->GetCurrentStreamFormat();
+	return memcmp(&input_format, &output_format, sizeof(input_format)) == 0;
+}
+
+/// - Tag: UpdateLoopbackMode
+void SimpleAudioDevice::UpdateLoopbackMode()
+{
+	// Swapping a stream's buffer has to happen while the HAL has I/O stopped,
+	// so ask for a configuration change and switch in PerformDeviceConfigurationChange.
+	if (ivars->m_loopback_mode_change_pending || WantsZeroCopyLoopback() == ivars->m_loopback_zero_copy)
+	{
+		return;
+	}
+	
+	auto ret = RequestDeviceConfigurationChange(k_loopback_mode_config_change_action, nullptr);
+	if (ret == kIOReturnSuccess)
+	{
+		ivars->m_loopback_mode_change_pending = true;
+	}
+	else
+	{
+		// Without a mode change, held changes apply to the shared ring, where
+		// the I/O handler asks for the change again.
+		DebugMsg("Failed to request a loopback mode change, error %d", ret);
+		ApplyDeferredChanges();
+	}
+}
+
+kern_return_t SimpleAudioDevice::ApplyLoopbackMode()
+{
+	ivars->m_loopback_mode_change_pending = false;
+	
+	// Check again, since the controls may have changed since the request.
+	auto zero_copy = WantsZeroCopyLoopback();
+	if (zero_copy == ivars->m_loopback_zero_copy)
+	{
+		ApplyDeferredChanges();
+		return kIOReturnSuccess;
+	}
+	
+	// A lazy device that has released its rings only records the mode, and
+	// CommitStreamMemory gives the input stream the matching ring.
+	auto ret = kIOReturnSuccess;
+	if (ivars->m_output_io_ring_buffer.get() != nullptr)
+	{
+		auto ring_buffer = zero_copy ? ivars->m_output_io_ring_buffer : ivars->m_input_io_ring_buffer;
+		ret = ivars->m_input_stream->SetIOMemoryDescriptor(ring_buffer.get());
+	}
+	if (ret == kIOReturnSuccess)
+	{
+		// Both rings have the same length and are indexed by sample time, so
+		// input frame N maps to the same output frame N in either mode. StartIO
+		// maps whichever buffer the stream has when I/O resumes.
+		if (ivars->m_input_memory_map.get() != nullptr)
+		{
+			__atomic_sub_fetch(&ivars->m_mapped_bytes, ivars->m_input_memory_map->GetLength(), __ATOMIC_RELAXED);
+		}
+		ivars->m_input_memory_map.reset();
+		__atomic_store_n(&ivars->m_loopback_zero_copy, zero_copy, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&ivars->m_loopback_mode_changes, 1, __ATOMIC_RELAXED);
+	}
+	
+	// The I/O handler is stopped, so held changes apply from the first block
+	// on the input's own ring.
+	ApplyDeferredChanges();
+	return ret;
+}
+
+/// - Tag: SetIORecording
+kern_return_t SimpleAudioDevice::SetIORecording(bool in_enabled)
+{
+	if (in_enabled && ivars->m_io_trace_slots == nullptr)
+	{
+		ivars->m_io_trace_slots = IONewZero(SimpleAudioIORecorder::Slot, kSimpleAudioDriverIOTraceCapacity);
+		if (ivars->m_io_trace_slots == nullptr)
+		{
+			return kIOReturnNoMemory;
+		}
+		ivars->m_io_recorder.SetSlots(ivars->m_io_trace_slots);
+		__atomic_add_fetch(&ivars->m_allocated_state_bytes, kSimpleAudioDriverIOTraceCapacity * sizeof(SimpleAudioIORecorder::Slot), __ATOMIC_RELAXED);
+	}
+	ivars->m_io_recorder.SetEnabled(in_enabled);
+	if (in_enabled)
+	{
+		// Start the capture with the current control values, so a replay
+		// doesn't depend on changes made before it began.
+		IOUserAudioSelectorValue data_source = 0;
+		ivars->m_input_selector_control->GetCurrentSelectedValues(&data_source, 1);
+		auto volume = ivars->m_input_volume_control->GetScalarValue();
+		uint32_t volume_bits = 0;
+		memcpy(&volume_bits, &volume, sizeof(volume_bits));
 		
+		auto host_time = mach_absolute_time();
+		ivars->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_SampleRate, static_cast<uint32_t>(ivars->m_stream_format.mSampleRate), 0, host_time);
+		ivars->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_DataSource, static_cast<uint32_t>(data_source), 0, host_time);
+		ivars->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_InputVolume, volume_bits, 0, host_time);
+	}
+	return kIOReturnSuccess;
+}
+
+size_t SimpleAudioDevice::DrainIOTrace(void* out_buffer, size_t in_buffer_size)
+{
+	return ivars->m_io_recorder.Drain(out_buffer, in_buffer_size);
+}
+
+void SimpleAudioDevice::RecordControlChanges(IOUserAudioSelectorValue in_data_source,
+											 float in_volume,
+											 uint64_t in_sample_time,
+											 uint64_t in_host_time)
+{
+	// This runs in the I/O handler, and only compares until a control changes.
+	if (in_data_source != ivars->m_io_trace_last_data_source)
+	{
+		ivars->m_io_trace_last_data_source = in_data_source;
+		ivars->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_DataSource, static_cast<uint32_t>(in_data_source), in_sample_time, in_host_time);
+	}
+	if (in_volume != ivars->m_io_trace_last_volume)
+	{
+		ivars->m_io_trace_last_volume = in_volume;
+		uint32_t volume_bits = 0;
+		memcpy(&volume_bits, &in_volume, sizeof(volume_bits));
+		ivars->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_InputVolume, volume_bits, in_sample_time, in_host_time);
+	}
+}
+
+/// - Tag: UpdateRenderQuality
+void SimpleAudioDevice::UpdateRenderQuality(uint32_t in_frame_size, uint64_t in_elapsed_host_ticks)
+{
+	// This runs in the I/O handler at the end of every input block.
+	double budget_ticks_per_frame = 0.0;
+	__atomic_load(&ivars->m_render_budget_ticks_per_frame, &budget_ticks_per_frame, __ATOMIC_RELAXED);
+	double budget_ticks = budget_ticks_per_frame * in_frame_size;
+	if (budget_ticks <= 0.0)
+	{
+		return;
+	}
+	
+	auto load = static_cast<float>(static_cast<double>(in_elapsed_host_ticks) / budget_ticks);
+	if (ivars->m_render_quality.Update(load))
+	{
+		__atomic_store_n(&ivars->m_statistics.m_quality_tier, ivars->m_render_quality.GetTier(), __ATOMIC_RELAXED);
+		__atomic_add_fetch(&ivars->m_statistics.m_quality_tier_changes, 1, __ATOMIC_RELAXED);
+	}
+	
+	// StartIO clears the statistics from the work queue, so read the peak atomically too.
+	auto load_percent = static_cast<uint32_t>(load * 100.0f);
+	__atomic_store_n(&ivars->m_statistics.m_render_load_percent, static_cast<uint32_t>(ivars->m_render_quality.GetLoad() * 100.0f), __ATOMIC_RELAXED);
+	if (load_percent > __atomic_load_n(&ivars->m_statistics.m_render_peak_load_percent, __ATOMIC_RELAXED))
+	{
+		__atomic_store_n(&ivars->m_statistics.m_render_peak_load_percent, load_percent, __ATOMIC_RELAXED);
+	}
+}
+
+kern_return_t SimpleAudioDevice::SetRenderBudget(uint32_t in_budget_percent)
+{
+	// A smaller budget makes the I/O handler act as if it had less time, which
+	// exercises the quality tiers on a machine that isn't actually loaded.
+	if (in_budget_percent < 1 || in_budget_percent > 100)
+	{
+		return kIOReturnBadArgument;
+	}
+	ivars->m_render_budget_percent = in_budget_percent;
+	UpdateTimers();
+	return kIOReturnSuccess;
+}
+
+/// - Tag: RenderInputSegment
+kern_return_t SimpleAudioDevice::RenderInputSegment(IOUserAudioSelectorValue in_data_source,
+													float in_volume,
+													uint64_t in_sample_time,
+													uint32_t in_frame_size,
+													bool in_cheap_oscillator,
+													bool in_use_render_ahead)
+{
+	/// - Tag: ZeroCopyLoopback
+	// While the input stream shares the output ring, the input already holds
+	// the host's output, and any write here would change what the host
+	// played. Changes from the app and automation events wait for the input
+	// to get its own ring back, so only a control the HAL changed or a new
+	// cable gets here. That segment passes through untouched, and the work
+	// queue switches the device back to copying.
+	if (__atomic_load_n(&ivars->m_loopback_zero_copy, __ATOMIC_RELAXED))
+	{
+		if (in_data_source != 0 || in_volume != 1.0f ||
+			(ivars->m_cable_router != nullptr && ivars->m_cable_router->HasInputs(ivars->m_device_index)))
+		{
+			__atomic_store_n(&ivars->m_loopback_mode_requested, true, __ATOMIC_RELEASE);
+		}
+		return kIOReturnSuccess;
+	}
+	
+	/// - Tag: ReadCables
+	// Cables connected to this device replace its data source.
+	if (ivars->m_cable_router != nullptr && ivars->m_cable_router->HasInputs(ivars->m_device_index))
+	{
+		if (ivars->m_input_memory_map.get() == nullptr)
+		{
+			return kIOReturnNoMemory;
+		}
+		
+		const auto& format = ivars->m_stream_format;
+		auto input_buffer_length = ivars->m_input_memory_map->GetLength() / sizeof(int16_t);
+		auto input_buffer = reinterpret_cast<int16_t*>(ivars->m_input_memory_map->GetAddress() + ivars->m_input_memory_map->GetOffset());
+		auto timeline_frame = in_sample_time + __atomic_load_n(&ivars->m_cable_timeline_offset, __ATOMIC_ACQUIRE);
+		ivars->m_cable_router->Read(ivars->m_device_index, timeline_frame, input_buffer, input_buffer_length, in_sample_time,
+									format.mChannelsPerFrame, static_cast<uint32_t>(format.mSampleRate), in_frame_size, in_volume);
+		return kIOReturnSuccess;
+	}
+	
+	// Everything else renders through the same code as the replay tool, so a
+	// replay produces the samples the device did. Loopback copies the output
+	// ring, and any other data source is a tone at that frequency, unless the
+	// render-ahead producer has already synthesized the segment.
+	if ((ivars->m_input_memory_map.get() == nullptr) || (in_data_source == 0 && ivars->m_output_memory_map.get() == nullptr))
+	{
+		return kIOReturnNoMemory;
+	}
+	
+	const auto& format = ivars->m_stream_format;
+	auto input_buffer_length = ivars->m_input_memory_map->GetLength() / sizeof(int16_t);
+	auto input_buffer = reinterpret_cast<int16_t*>(ivars->m_input_memory_map->GetAddress() + ivars->m_input_memory_map->GetOffset());
+	if (in_data_source != 0 && in_use_render_ahead &&
+		ivars->m_render_ahead.Consume(in_data_source, in_volume, in_sample_time, in_frame_size, input_buffer, input_buffer_length))
+	{
+		return kIOReturnSuccess;
+	}
+	
+	// A tone doesn't read the output ring.
+	const int16_t* output_buffer = nullptr;
+	size_t output_buffer_length = 0;
+	if (ivars->m_output_memory_map.get() != nullptr)
+	{
+		output_buffer_length = ivars->m_output_memory_map->GetLength() / sizeof(int16_t);
+		output_buffer = reinterpret_cast<const int16_t*>(ivars->m_output_memory_map->GetAddress() + ivars->m_output_memory_map->GetOffset());
+	}
+	
+	SimpleAudioInputRenderer::Render(in_data_source, in_volume, format.mSampleRate, in_sample_time, in_frame_size, in_cheap_oscillator,
+									 output_buffer, output_buffer_length, input_buffer, input_buffer_length, format.mChannelsPerFrame);
+	if (in_data_source == 0)
+	{
+		__atomic_add_fetch(&ivars->m_statistics.m_loopback_copied_frames, in_frame_size, __ATOMIC_RELAXED);
+	}
+	
+	return kIOReturnSuccess;
+}
+
+void SimpleAudioDevice::ObserveControlValues(IOUserAudioSelectorValue in_data_source, float in_volume)
+{
+	// A control the HAL or the app changed since the last block overrides
+	// whatever automation set before it, so the most recent change wins.
+	if (in_data_source != ivars->m_observed_data_source)
+	{
+		ivars->m_observed_data_source = in_data_source;
+		ivars->m_effective_data_source = in_data_source;
+	}
+	if (in_volume != ivars->m_observed_volume)
+	{
+		ivars->m_observed_volume = in_volume;
+		ivars->m_effective_volume = in_volume;
+	}
+	
+	// Once the controls show the automated values, render-ahead can be used again.
+	ivars->m_automation_override = (ivars->m_effective_data_source != ivars->m_observed_data_source ||
+									ivars->m_effective_volume != ivars->m_observed_volume);
+}
+
+/// - Tag: ApplyAutomationEvents
+void SimpleAudioDevice::ApplyAutomationEvents(uint64_t in_sample_time, uint64_t in_block_sample_time, uint64_t in_host_time)
+{
+	SimpleAudioDriverAutomationEvent event;
+	bool applied = false;
+	while (ivars->m_automation.PopEvent(in_sample_time, event))
+	{
+		if (event.m_parameter == SimpleAudioDriverAutomationParameter_InputVolume)
+		{
+			ivars->m_effective_volume = event.m_argument.m_scalar;
+			ivars->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_InputVolume, event.m_argument.m_value, in_sample_time, in_host_time);
+		}
+		else if (event.m_parameter == SimpleAudioDriverAutomationParameter_DataSource)
+		{
+			ivars->m_effective_data_source = static_cast<IOUserAudioSelectorValue>(event.m_argument.m_value);
+			ivars->m_io_recorder.Record(SimpleAudioDriverIOTraceEvent_DataSource, event.m_argument.m_value, in_sample_time, in_host_time);
+		}
 		
-		IOUserAudioSelectorValue data_source_value_to_set = current_data_source_value;
-		if (current_data_source_value == ivars->m_data_sources[0].m_value)
+		// An event due before this block arrived too late to land on its frame.
+		if (event.m_sample_time < in_block_sample_time)
+		{
+			__atomic_add_fetch(&ivars->m_statistics.m_automation_events_late, 1, __ATOMIC_RELAXED);
+		}
+		__atomic_add_fetch(&ivars->m_statistics.m_automation_events_applied, 1, __ATOMIC_RELAXED);
+		applied = true;
+	}
+	
+	if (applied)
+	{
+		// Render-ahead used the old values, and the work queue should update
+		// the controls so the HAL shows the automated values.
+		ivars->m_automation_override = true;
+		ivars->m_render_ahead.Invalidate();
+		__atomic_store(&ivars->m_automation_mirror_data_source, &ivars->m_effective_data_source, __ATOMIC_RELAXED);
+		__atomic_store(&ivars->m_automation_mirror_volume, &ivars->m_effective_volume, __ATOMIC_RELAXED);
+		__atomic_store_n(&ivars->m_automation_mirror_pending, true, __ATOMIC_RELEASE);
+	}
+}
+
+/// - Tag: MirrorAutomation
+void SimpleAudioDevice::MirrorAutomation()
+{
+	// This runs on the work queue after the I/O handler has applied events.
+	if (!__atomic_exchange_n(&ivars->m_automation_mirror_pending, false, __ATOMIC_ACQUIRE))
+	{
+		return;
+	}
+	
+	IOUserAudioSelectorValue data_source = 0;
+	float volume = 0.0f;
+	__atomic_load(&ivars->m_automation_mirror_data_source, &data_source, __ATOMIC_RELAXED);
+	__atomic_load(&ivars->m_automation_mirror_volume, &volume, __ATOMIC_RELAXED);
+	ivars->m_input_selector_control->SetCurrentSelectedValues(&data_source, 1);
+	ivars->m_input_volume_control->SetScalarValue(volume);
+	UpdateRenderAheadControls();
+	UpdateLoopbackMode();
+}
+
+kern_return_t SimpleAudioDevice::ScheduleAutomation(const SimpleAudioDriverAutomationEvent* in_events,
+													uint32_t in_num_events,
+													uint32_t* out_num_scheduled)
+{
+	// Check the whole batch first, so a bad event doesn't leave part of it scheduled.
+	for (uint32_t i = 0; i < in_num_events; i++)
+	{
+		const auto& event = in_events[i];
+		if (event.m_parameter == SimpleAudioDriverAutomationParameter_InputVolume)
 		{
-			data_source_value_to_set = ivars->m_data_sources[1].m_value;
+			if (!(event.m_argument.m_scalar >= 0.0f && event.m_argument.m_scalar <= 1.0f))
+			{
+				return kIOReturnBadArgument;
+			}
 		}
-		else if (current_data_source_value == ivars->m_data_sources[1].m_value)
+		else if (event.m_parameter == SimpleAudioDriverAutomationParameter_DataSource)
 		{
-			data_source_value_to_set = ivars->m_data_sources[2].m_value;
+			bool known_data_source = false;
+			for (auto j = 0; j < kNumInputDataSources; j++)
+			{
+				known_data_source = known_data_source || ivars->m_data_sources[j].m_value == static_cast<IOUserAudioSelectorValue>(event.m_argument.m_value);
+			}
+			if (!known_data_source)
+			{
+				return kIOReturnBadArgument;
+			}
 		}
 		else
 		{
-			data_source_value_to_set = ivars->m_data_sources[0].m_value;
+			return kIOReturnBadArgument;
 		}
-		ret = ivars->m_input_selector_control->SetCurrentSelectedValues(&data_source_value_to_set, 1);
-	});
+	}
+	
+	// Like held control changes, events scheduled while the input shares the
+	// output ring wait for it to get its own ring back before they apply.
+	if (ivars->m_loopback_zero_copy)
+	{
+		ivars->m_automation.SetHeld(true);
+	}
+	*out_num_scheduled = ivars->m_automation.Schedule(in_events, in_num_events);
+	UpdateLoopbackMode();
+	return *out_num_scheduled == in_num_events ? kIOReturnSuccess : kIOReturnNoSpace;
+}
+
+kern_return_t SimpleAudioDevice::ClearAutomation()
+{
+	ivars->m_automation.Clear();
+	return kIOReturnSuccess;
+}
+
+void SimpleAudioDevice::AttachCableRouter(SimpleAudioCableRouter* in_cable_router, uint32_t in_device_index)
+{
+	ivars->m_cable_router = in_cable_router;
+	ivars->m_device_index = in_device_index;
+}
+
+void SimpleAudioDevice::CableRoutingChanged()
+{
+	// Cables into this device change what its input ring holds, so it can't share the output ring.
+	UpdateLoopbackMode();
+}
+
+/// - Tag: SetCustomPropertyValues
+kern_return_t SimpleAudioDevice::SetCustomPropertyValues(const SimpleAudioDriverCustomPropertyEntry* in_entries, uint32_t in_num_entries)
+{
+	// The HAL answers reads of the custom property from the framework's own
+	// storage, which only holds the pairs it has been given and can't be
+	// walked or serialized from here. So each changed pair still goes to
+	// SetQualifierAndDataValue, while the store answers lookups, keeps the
+	// order pairs were first set in, and builds the snapshot. A pair whose
+	// value hasn't changed is skipped, so it costs neither OSStrings nor a
+	// republish.
+	kern_return_t ret = kIOReturnSuccess;
+	bool changed = false;
+	for (uint32_t index = 0; index < in_num_entries; index++)
+	{
+		const auto& entry = in_entries[index];
+		auto current_value = ivars->m_property_store.Find(entry.m_qualifier);
+		if (current_value != nullptr && strncmp(current_value, entry.m_value, kSimpleAudioDriverCustomPropertyValueLength) == 0)
+		{
+			continue;
+		}
+		if (!ivars->m_property_store.Set(entry.m_qualifier, entry.m_value))
+		{
+			ret = ivars->m_property_store.GetCount() == kSimpleAudioDriverCustomPropertyCapacity ? kIOReturnNoSpace : kIOReturnBadArgument;
+			break;
+		}
+		auto qualifier = OSSharedPtr(OSString::withCString(entry.m_qualifier), OSNoRetain);
+		auto value = OSSharedPtr(OSString::withCString(entry.m_value), OSNoRetain);
+		ivars->m_custom_property->SetQualifierAndDataValue(qualifier.get(), value.get());
+		changed = true;
+	}
+	
+	// Publish whatever applied, even if the batch stopped early.
+	if (changed)
+	{
+		ScheduleCustomPropertySnapshot();
+	}
 	return ret;
 }
+
+void SimpleAudioDevice::ScheduleCustomPropertySnapshot()
+{
+	// This runs on the work queue. Apps tend to send pairs in several batches
+	// back to back, so publish once after the last of them instead of
+	// serializing the whole store after each.
+	if (ivars->m_snapshot_publish_scheduled)
+	{
+		return;
+	}
+	ivars->m_snapshot_publish_scheduled = true;
+	retain();
+	ivars->m_work_queue->DispatchAsync(^{
+		ivars->m_snapshot_publish_scheduled = false;
+		PublishCustomPropertySnapshot();
+		release();
+	});
+}
+
+void SimpleAudioDevice::PublishCustomPropertySnapshot()
+{
+	// A device that failed init may still have a publish scheduled.
+	if (ivars->m_snapshot_property.get() == nullptr)
+	{
+		return;
+	}
+	
+	// Size the OSData for the whole snapshot and serialize straight into it,
+	// so a publish makes one allocation and copies nothing.
+	auto snapshot_size = ivars->m_property_store.GetSerializedSize();
+	auto snapshot = OSSharedPtr(OSData::withCapacity(static_cast<uint32_t>(snapshot_size)), OSNoRetain);
+	if (snapshot.get() == nullptr || !snapshot->appendByte(0, static_cast<uint32_t>(snapshot_size)))
+	{
+		DebugMsg("Failed to allocate the custom property snapshot");
+		return;
+	}
+	ivars->m_property_store.Serialize(const_cast<void*>(snapshot->getBytesNoCopy()), snapshot_size);
+	
+	auto qualifier = OSSharedPtr(OSString::withCString(kSimpleAudioDriverCustomPropertySnapshotQualifier), OSNoRetain);
+	ivars->m_snapshot_property->SetQualifierAndDataValue(qualifier.get(), snapshot.get());
+}
+
+/// - Tag: SetLazyStreamMemory
+kern_return_t SimpleAudioDevice::SetLazyStreamMemory(bool in_enabled, uint32_t in_idle_ms)
+{
+	if (in_idle_ms > kSimpleAudioDriverMaxStreamIdleMs)
+	{
+		return kIOReturnBadArgument;
+	}
+	__atomic_store_n(&ivars->m_lazy_stream_memory, in_enabled, __ATOMIC_RELAXED);
+	ivars->m_stream_idle_ms = in_idle_ms;
+	
+	// While I/O runs, StopIO starts the idle period.
+	if (ivars->m_io_running)
+	{
+		return kIOReturnSuccess;
+	}
+	if (in_enabled)
+	{
+		ScheduleStreamMemoryRelease();
+		return kIOReturnSuccess;
+	}
+	
+	// Leaving lazy mode commits the rings again, so the device is back to
+	// holding them from now on.
+	ivars->m_idle_timer_event_source->SetEnable(false);
+	return CommitStreamMemory();
+}
+
+void SimpleAudioDevice::GetMemoryUsage(SimpleAudioDriverDeviceMemoryUsage* out_usage)
+{
+	// The counts are read atomically, so this doesn't need to wait for the work queue.
+	out_usage->m_device_index = ivars->m_device_index;
+	out_usage->m_lazy_stream_memory = __atomic_load_n(&ivars->m_lazy_stream_memory, __ATOMIC_RELAXED) ? 1 : 0;
+	out_usage->m_state_bytes = sizeof(*this) + sizeof(SimpleAudioDevice_IVars) + ivars->m_property_store.GetAllocatedBytes() +
+		__atomic_load_n(&ivars->m_allocated_state_bytes, __ATOMIC_RELAXED);
+	out_usage->m_ring_bytes = __atomic_load_n(&ivars->m_ring_bytes, __ATOMIC_RELAXED);
+	out_usage->m_mapped_bytes = __atomic_load_n(&ivars->m_mapped_bytes, __ATOMIC_RELAXED);
+	out_usage->m_ring_commits = __atomic_load_n(&ivars->m_ring_commits, __ATOMIC_RELAXED);
+	out_usage->m_ring_releases = __atomic_load_n(&ivars->m_ring_releases, __ATOMIC_RELAXED);
+}
+
+/// - Tag: CommitStreamMemory
+kern_return_t SimpleAudioDevice::CommitStreamMemory()
+{
+	// This runs on the work queue while I/O is stopped, when the streams'
+	// buffers can change.
+	if (ivars->m_output_io_ring_buffer.get() != nullptr)
+	{
+		return kIOReturnSuccess;
+	}
+	
+	OSSharedPtr<IOBufferMemoryDescriptor> output_io_ring_buffer;
+	OSSharedPtr<IOBufferMemoryDescriptor> input_io_ring_buffer;
+	auto error = IOBufferMemoryDescriptor::Create(kIOMemoryDirectionInOut, ivars->m_io_ring_size_bytes, 0, output_io_ring_buffer.attach());
+	FailIfError(error, , Failure, "Failed to create output IOBufferMemoryDescriptor");
+	
+	error = IOBufferMemoryDescriptor::Create(kIOMemoryDirectionInOut, ivars->m_io_ring_size_bytes, 0, input_io_ring_buffer.attach());
+	FailIfError(error, , Failure, "Failed to create input IOBufferMemoryDescriptor");
+	
+	error = ivars->m_output_stream->SetIOMemoryDescriptor(output_io_ring_buffer.get());
+	FailIfError(error, , Failure, "Failed to set the output stream's ring buffer");
+	
+	// The input stream takes whichever ring the loopback mode calls for. If it
+	// can't, take the output stream's ring back too, so the streams still
+	// match the device, which holds no rings.
+	error = ivars->m_input_stream->SetIOMemoryDescriptor(ivars->m_loopback_zero_copy ? output_io_ring_buffer.get() : input_io_ring_buffer.get());
+	FailIfError(error, ivars->m_output_stream->SetIOMemoryDescriptor(nullptr), Failure, "Failed to set the input stream's ring buffer");
+	
+	ivars->m_output_io_ring_buffer = output_io_ring_buffer;
+	ivars->m_input_io_ring_buffer = input_io_ring_buffer;
+	__atomic_store_n(&ivars->m_ring_bytes, 2 * static_cast<uint64_t>(ivars->m_io_ring_size_bytes), __ATOMIC_RELAXED);
+	__atomic_add_fetch(&ivars->m_ring_commits, 1, __ATOMIC_RELAXED);
+	
+Failure:
+	return error;
+}
+
+/// - Tag: ReleaseStreamMemory
+void SimpleAudioDevice::ReleaseStreamMemory()
+{
+	if (ivars->m_io_running || ivars->m_output_io_ring_buffer.get() == nullptr)
+	{
+		return;
+	}
+	
+	// Keep the rings unless both streams let go of them. If only the input
+	// stream did, give it its ring back so the streams still match the device.
+	auto input_ring = ivars->m_loopback_zero_copy ? ivars->m_output_io_ring_buffer.get() : ivars->m_input_io_ring_buffer.get();
+	auto error = ivars->m_input_stream->SetIOMemoryDescriptor(nullptr);
+	FailIfError(error, , Failure, "Failed to take the input stream's ring buffer");
+	
+	error = ivars->m_output_stream->SetIOMemoryDescriptor(nullptr);
+	FailIfError(error, ivars->m_input_stream->SetIOMemoryDescriptor(input_ring), Failure, "Failed to take the output stream's ring buffer");
+	
+	ivars->m_output_memory_map.reset();
+	ivars->m_input_memory_map.reset();
+	ivars->m_output_io_ring_buffer.reset();
+	ivars->m_input_io_ring_buffer.reset();
+	__atomic_store_n(&ivars->m_mapped_bytes, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&ivars->m_ring_bytes, 0, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&ivars->m_ring_releases, 1, __ATOMIC_RELAXED);
+	
+Failure:
+	return;
+}
+
+void SimpleAudioDevice::ScheduleStreamMemoryRelease()
+{
+	const auto& timebase_info = ivars->m_timebase_info;
+	auto idle_ticks = static_cast<uint64_t>(ivars->m_stream_idle_ms) * 1000000ULL * timebase_info.denom / timebase_info.numer;
+	ivars->m_idle_timer_event_source->WakeAtTime(kIOTimerClockMachAbsoluteTime, mach_absolute_time() + idle_ticks, 0);
+	ivars->m_idle_timer_event_source->SetEnable(true);
+}
+
+/// - Tag: IdleTimerOccurred
+void	SimpleAudioDevice::IdleTimerOccurred_Impl(OSAction* action, uint64_t time)
+{
+	// StartIO disables the timer, but check again in case it fired first.
+	ivars->m_idle_timer_event_source->SetEnable(false);
+	if (ivars->m_lazy_stream_memory)
+	{
+		ReleaseStreamMemory();
+	}
+}
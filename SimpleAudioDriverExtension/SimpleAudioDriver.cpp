@@ -13,6 +13,8 @@ The implementation of the driver, which manages communications
 #include "SimpleAudioDevice.h"
 #include "SimpleAudioDriverUserClient.h"
 #include "SimpleAudioDriverKeys.h"
+#include "SimpleAudioControlTrace.h"
+#include "SimpleAudioCableRouter.h"
 
 // System Include
 #include <AudioDriverKit/AudioDriverKit.h>
@@ -26,7 +28,11 @@ constexpr uint32_t k_zero_time_stamp_period = 32768;
 struct SimpleAudioDriver_IVars
 {
 	OSSharedPtr<IODispatchQueue>	m_work_queue;
-	OSSharedPtr<SimpleAudioDevice>	m_simple_audio_device;
+	SimpleAudioControlTrace			m_control_trace;
+	
+	// The app's controls apply to the first device. Cables can connect any of them.
+	OSSharedPtr<SimpleAudioDevice>	m_devices[kSimpleAudioDriverNumDevices];
+	SimpleAudioCableRouter			m_cable_router;
 };
 
 bool SimpleAudioDriver::init()
@@ -41,6 +47,8 @@ bool SimpleAudioDriver::init()
 	{
 		return false;
 	}
+	ivars->m_control_trace.Initialize();
+	ivars->m_cable_router.Initialize();
 	
 	return true;
 }
@@ -50,7 +58,10 @@ void SimpleAudioDriver::free()
 	if (ivars != nullptr)
 	{
 		ivars->m_work_queue.reset();
-		ivars->m_simple_audio_device.reset();
+		for (auto& device : ivars->m_devices)
+		{
+			device.reset();
+		}
 	}
 	IOSafeDeleteNULL(ivars, SimpleAudioDriver_IVars, 1);
 	super::free();
@@ -60,10 +71,8 @@ void SimpleAudioDriver::free()
 kern_return_t SimpleAudioDriver::Start_Impl(IOService* in_provider)
 {
 	bool success = false;
-	auto device_uid = OSSharedPtr(OSString::withCString(kSimpleAudioDriverDeviceUID), OSNoRetain);
 	auto model_uid = OSSharedPtr(OSString::withCString("SimpleAudioDevice-Model"), OSNoRetain);
 	auto manufacturer_uid = OSSharedPtr(OSString::withCString("Apple Inc."), OSNoRetain);
-	auto device_name = OSSharedPtr(OSString::withCString("SimpleAudioDevice"), OSNoRetain);
 	
 	kern_return_t error = Start(in_provider, SUPERDISPATCH);
 	FailIfError(error, , Failure, "Failed to start Super");
@@ -72,17 +81,38 @@ kern_return_t SimpleAudioDriver::Start_Impl(IOService* in_provider)
 	ivars->m_work_queue = GetWorkQueue();
 	FailIfError(ivars->m_work_queue.get() == nullptr, error = kIOReturnInvalid, Failure, "failed to get default work queue");
 		
-	// Allocate and configure audio devices as necessary.
-	ivars->m_simple_audio_device = OSSharedPtr(OSTypeAlloc(SimpleAudioDevice), OSNoRetain);
-	FailIfNULL(ivars->m_simple_audio_device.get(), error = kIOReturnNoMemory, Failure, "Failed to allocate SimpleAudioDevice");
-	
-	success = ivars->m_simple_audio_device->init(this, false, device_uid.get(), model_uid.get(), manufacturer_uid.get(), k_zero_time_stamp_period);
-	FailIf(success == false, error = kIOReturnNoMemory, Failure, "Failed to init SimpleAudioDevice");
-	
-	ivars->m_simple_audio_device->SetName(device_name.get());
-	
-	// Add the device object to the driver.
-	AddObject(ivars->m_simple_audio_device.get());
+	// Allocate and configure audio devices as necessary. Every device after the
+	// first appends its number to the UID and name.
+	for (uint32_t device_index = 0; device_index < kSimpleAudioDriverNumDevices; device_index++)
+	{
+		char device_uid_string[64];
+		char device_name_string[64];
+		if (device_index == 0)
+		{
+			snprintf(device_uid_string, sizeof(device_uid_string), "%s", kSimpleAudioDriverDeviceUID);
+			snprintf(device_name_string, sizeof(device_name_string), "SimpleAudioDevice");
+		}
+		else
+		{
+			snprintf(device_uid_string, sizeof(device_uid_string), "%s-%u", kSimpleAudioDriverDeviceUID, device_index + 1);
+			snprintf(device_name_string, sizeof(device_name_string), "SimpleAudioDevice %u", device_index + 1);
+		}
+		auto device_uid = OSSharedPtr(OSString::withCString(device_uid_string), OSNoRetain);
+		auto device_name = OSSharedPtr(OSString::withCString(device_name_string), OSNoRetain);
+		auto& device = ivars->m_devices[device_index];
+		
+		device = OSSharedPtr(OSTypeAlloc(SimpleAudioDevice), OSNoRetain);
+		FailIfNULL(device.get(), error = kIOReturnNoMemory, Failure, "Failed to allocate SimpleAudioDevice");
+		
+		success = device->init(this, false, device_uid.get(), model_uid.get(), manufacturer_uid.get(), k_zero_time_stamp_period);
+		FailIf(success == false, error = kIOReturnNoMemory, Failure, "Failed to init SimpleAudioDevice");
+		
+		device->SetName(device_name.get());
+		device->AttachCableRouter(&ivars->m_cable_router, device_index);
+		
+		// Add the device object to the driver.
+		AddObject(device.get());
+	}
 			
 	// Register the service.
 	error = RegisterService();
@@ -96,9 +126,14 @@ Failure:
 
 kern_return_t	SimpleAudioDriver::Stop_Impl(IOService* in_provider)
 {
+	// Let queued control operations finish while the devices still exist.
+	DrainControlOperations();
 	auto ret = Stop(in_provider, SUPERDISPATCH);
 	ivars->m_work_queue.reset();
-	ivars->m_simple_audio_device.reset();
+	for (auto& device : ivars->m_devices)
+	{
+		device.reset();
+	}
 	return ret;
 }
 
@@ -130,17 +165,16 @@ Failure:
 
 kern_return_t SimpleAudioDriver::StartDevice(IOUserAudioObjectID in_object_id, IOUserAudioStartStopFlags in_flags)
 {
-	if (in_object_id != ivars->m_simple_audio_device->GetObjectID())
+	if (FindDevice(in_object_id) == nullptr)
 	{
 		DebugMsg("SimpleAudioDriver::StartDevice - unknown object id %u", in_object_id);
 		return kIOReturnBadArgument;
 	}
 	
-	__block kern_return_t ret;
-	ivars->m_work_queue->DispatchSync(^(){
+	auto ret = ivars->m_control_trace.DispatchSync(ivars->m_work_queue.get(), SimpleAudioDriverControlOperation_StartDevice, ^kern_return_t(){
 		// Tell the superclass to start the device and the update the timer
 		// to generate timestamps.
-		ret = super::StartDevice(in_object_id, in_flags);
+		return super::StartDevice(in_object_id, in_flags);
 	});
 	if (ret == kIOReturnSuccess)
 	{
@@ -151,16 +185,15 @@ kern_return_t SimpleAudioDriver::StartDevice(IOUserAudioObjectID in_object_id, I
 
 kern_return_t SimpleAudioDriver::StopDevice(IOUserAudioObjectID in_object_id, IOUserAudioStartStopFlags in_flags)
 {
-	if (in_object_id != ivars->m_simple_audio_device->GetObjectID())
+	if (FindDevice(in_object_id) == nullptr)
 	{
 		DebugMsg("SimpleAudioDriver::StopDevice - unknown object id %u", in_object_id);
 		return kIOReturnBadArgument;
 	}
 	
 	// Tell the superclass to stop device and stop timestamps.
-	__block kern_return_t ret;
-	ivars->m_work_queue->DispatchSync(^(){
-		ret = super::StopDevice(in_object_id, in_flags);
+	auto ret = ivars->m_control_trace.DispatchSync(ivars->m_work_queue.get(), SimpleAudioDriverControlOperation_StopDevice, ^kern_return_t(){
+		return super::StopDevice(in_object_id, in_flags);
 	});
 	
 	if (ret == kIOReturnSuccess)
@@ -170,18 +203,271 @@ kern_return_t SimpleAudioDriver::StopDevice(IOUserAudioObjectID in_object_id, IO
 	return ret;
 }
 
-kern_return_t SimpleAudioDriver::HandleToggleDataSource()
+kern_return_t SimpleAudioDriver::HandleToggleDataSource(SimpleAudioControlCompletion in_completion)
 {
-	__block kern_return_t ret = kIOReturnSuccess;
-	ivars->m_work_queue->DispatchSync(^(){
-		ret = ivars->m_simple_audio_device->ToggleDataSource();
-	});
-	return ret;
+	// The device toggles in place, so this is the only hop onto the work queue.
+	return RunControlOperation(SimpleAudioDriverControlOperation_ToggleDataSource, ^kern_return_t(){
+		return ivars->m_devices[0]->ToggleDataSource();
+	}, in_completion);
 }
 
 /// - Tag: HandleTestConfigChange
 kern_return_t SimpleAudioDriver::HandleTestConfigChange()
 {
 	auto change_info = OSSharedPtr(OSString::withCString("Toggle Sample Rate"), OSNoRetain);
-	return ivars->m_simple_audio_device->RequestDeviceConfigurationChange(k_custom_config_change_action, change_info.get());
+	auto request_time = mach_absolute_time();
+	auto ret = ivars->m_devices[0]->RequestDeviceConfigurationChange(k_custom_config_change_action, change_info.get());
+	ivars->m_control_trace.Record(SimpleAudioDriverControlOperation_TestConfigChange, 0, request_time, request_time, mach_absolute_time(), ret);
+	return ret;
+}
+
+/// - Tag: HandleCommands
+kern_return_t SimpleAudioDriver::HandleCommands(const SimpleAudioDriverCommandSlot* in_commands,
+												uint32_t in_num_commands,
+												uint32_t* out_num_applied)
+{
+	__block uint32_t num_applied = 0;
+	
+	// Apply the whole batch with a single hop onto the work queue.
+	auto ret = ivars->m_control_trace.DispatchSync(ivars->m_work_queue.get(), SimpleAudioDriverControlOperation_ApplyCommands, ^kern_return_t(){
+		kern_return_t batch_ret = kIOReturnSuccess;
+		auto device = ivars->m_devices[0].get();
+		for (uint32_t i = 0; i < in_num_commands; i++)
+		{
+			const auto& command = in_commands[i];
+			kern_return_t command_ret = kIOReturnSuccess;
+			switch (command.m_command)
+			{
+				case SimpleAudioDriverCommand_SetInputVolume:
+					command_ret = device->SetInputVolume(command.m_argument.m_scalar);
+					break;
+					
+				case SimpleAudioDriverCommand_SetDataSource:
+					command_ret = device->SetDataSource(command.m_argument.m_value);
+					break;
+					
+				case SimpleAudioDriverCommand_ToggleDataSource:
+					command_ret = device->ToggleDataSource();
+					break;
+					
+				default:
+					command_ret = kIOReturnBadArgument;
+					break;
+			}
+			
+			if (command_ret == kIOReturnSuccess)
+			{
+				num_applied++;
+			}
+			else
+			{
+				// Keep going so that one bad command doesn't stall the rest of the batch.
+				DebugMsg("Failed to apply command %u, error %d", command.m_command, command_ret);
+				batch_ret = command_ret;
+			}
+		}
+		return batch_ret;
+	});
+	
+	if (out_num_applied != nullptr)
+	{
+		*out_num_applied = num_applied;
+	}
+	return ret;
+}
+
+kern_return_t SimpleAudioDriver::HandleSetRenderAhead(bool in_enabled, uint32_t in_margin_frames, SimpleAudioControlCompletion in_completion)
+{
+	return RunControlOperation(SimpleAudioDriverControlOperation_SetRenderAhead, ^kern_return_t(){
+		return ivars->m_devices[0]->SetRenderAhead(in_enabled, in_margin_frames);
+	}, in_completion);
+}
+
+kern_return_t SimpleAudioDriver::HandleGetDeviceStatistics(SimpleAudioDriverDeviceStatistics* out_statistics)
+{
+	// The counters are read atomically, so this doesn't need to wait for the work queue.
+	ivars->m_devices[0]->GetStatistics(out_statistics);
+	return kIOReturnSuccess;
+}
+
+kern_return_t SimpleAudioDriver::HandleConfigureInsertChain(const SimpleAudioDriverInsertChainConfig* in_config)
+{
+	return ivars->m_control_trace.DispatchSync(ivars->m_work_queue.get(), SimpleAudioDriverControlOperation_ConfigureInsertChain, ^kern_return_t(){
+		return ivars->m_devices[0]->ConfigureInsertChain(in_config);
+	});
+}
+
+kern_return_t SimpleAudioDriver::HandleSetIORecording(bool in_enabled, SimpleAudioControlCompletion in_completion)
+{
+	return RunControlOperation(SimpleAudioDriverControlOperation_SetIORecording, ^kern_return_t(){
+		return ivars->m_devices[0]->SetIORecording(in_enabled);
+	}, in_completion);
+}
+
+kern_return_t SimpleAudioDriver::HandleDrainIOTrace(void* out_buffer, size_t in_buffer_size, size_t* out_size)
+{
+	// Drains run on the work queue, which makes it the recorder's only reader.
+	return ivars->m_control_trace.DispatchSync(ivars->m_work_queue.get(), SimpleAudioDriverControlOperation_DrainIOTrace, ^kern_return_t(){
+		*out_size = ivars->m_devices[0]->DrainIOTrace(out_buffer, in_buffer_size);
+		return *out_size > 0 ? kIOReturnSuccess : kIOReturnNoSpace;
+	});
+}
+
+kern_return_t SimpleAudioDriver::HandleSetRenderBudget(uint32_t in_budget_percent, SimpleAudioControlCompletion in_completion)
+{
+	return RunControlOperation(SimpleAudioDriverControlOperation_SetRenderBudget, ^kern_return_t(){
+		return ivars->m_devices[0]->SetRenderBudget(in_budget_percent);
+	}, in_completion);
+}
+
+kern_return_t SimpleAudioDriver::HandleScheduleAutomation(const SimpleAudioDriverAutomationEvent* in_events,
+														 uint32_t in_num_events,
+														 uint32_t* out_num_scheduled)
+{
+	// The work queue is the automation inbox's only producer.
+	return ivars->m_control_trace.DispatchSync(ivars->m_work_queue.get(), SimpleAudioDriverControlOperation_ScheduleAutomation, ^kern_return_t(){
+		return ivars->m_devices[0]->ScheduleAutomation(in_events, in_num_events, out_num_scheduled);
+	});
+}
+
+kern_return_t SimpleAudioDriver::HandleClearAutomation(SimpleAudioControlCompletion in_completion)
+{
+	return RunControlOperation(SimpleAudioDriverControlOperation_ClearAutomation, ^kern_return_t(){
+		return ivars->m_devices[0]->ClearAutomation();
+	}, in_completion);
+}
+
+kern_return_t SimpleAudioDriver::HandleConnectCable(const SimpleAudioDriverCableConfig* in_config, uint32_t* out_cable_index)
+{
+	// The router checks the configuration too, but this indexes the devices
+	// itself, so check the index it uses here rather than rely on that.
+	auto destination_device = in_config->m_destination_device;
+	if (destination_device >= kSimpleAudioDriverNumDevices)
+	{
+		return kIOReturnBadArgument;
+	}
+	
+	return ivars->m_control_trace.DispatchSync(ivars->m_work_queue.get(), SimpleAudioDriverControlOperation_ConnectCable, ^kern_return_t(){
+		auto ret = ivars->m_cable_router.Connect(*in_config, out_cable_index);
+		if (ret == kIOReturnSuccess)
+		{
+			ivars->m_devices[destination_device]->CableRoutingChanged();
+		}
+		return ret;
+	});
+}
+
+kern_return_t SimpleAudioDriver::HandleDisconnectCable(uint32_t in_cable_index, SimpleAudioControlCompletion in_completion)
+{
+	return RunControlOperation(SimpleAudioDriverControlOperation_DisconnectCable, ^kern_return_t(){
+		auto ret = ivars->m_cable_router.Disconnect(in_cable_index);
+		if (ret == kIOReturnSuccess)
+		{
+			for (auto& device : ivars->m_devices)
+			{
+				device->CableRoutingChanged();
+			}
+		}
+		return ret;
+	}, in_completion);
+}
+
+kern_return_t SimpleAudioDriver::HandleCopyCableStatus(void* out_buffer, size_t in_buffer_size, size_t* out_size)
+{
+	// The counters are read atomically, so this doesn't need to wait for the work queue.
+	*out_size = ivars->m_cable_router.CopyStatus(out_buffer, in_buffer_size);
+	return *out_size > 0 ? kIOReturnSuccess : kIOReturnNoSpace;
+}
+
+kern_return_t SimpleAudioDriver::HandleSetCustomProperties(const SimpleAudioDriverCustomPropertyEntry* in_entries, uint32_t in_num_entries)
+{
+	return ivars->m_control_trace.DispatchSync(ivars->m_work_queue.get(), SimpleAudioDriverControlOperation_SetCustomProperties, ^kern_return_t(){
+		return ivars->m_devices[0]->SetCustomPropertyValues(in_entries, in_num_entries);
+	});
+}
+
+kern_return_t SimpleAudioDriver::HandleSetLazyStreamMemory(bool in_enabled, uint32_t in_idle_ms, SimpleAudioControlCompletion in_completion)
+{
+	return RunControlOperation(SimpleAudioDriverControlOperation_SetLazyStreamMemory, ^kern_return_t(){
+		// Every device takes the same mode, so devices nobody uses all shrink.
+		for (auto& device : ivars->m_devices)
+		{
+			auto ret = device->SetLazyStreamMemory(in_enabled, in_idle_ms);
+			if (ret != kIOReturnSuccess)
+			{
+				return ret;
+			}
+		}
+		return kIOReturnSuccess;
+	}, in_completion);
+}
+
+kern_return_t SimpleAudioDriver::HandleCopyMemoryUsage(void* out_buffer, size_t in_buffer_size, size_t* out_size)
+{
+	// The counts are read atomically, so this doesn't need to wait for the work queue.
+	SimpleAudioDriverMemoryUsageHeader header = {};
+	header.m_num_devices = kSimpleAudioDriverNumDevices;
+	auto size = sizeof(header) + kSimpleAudioDriverNumDevices * sizeof(SimpleAudioDriverDeviceMemoryUsage);
+	if (in_buffer_size < size)
+	{
+		*out_size = 0;
+		return kIOReturnNoSpace;
+	}
+	
+	auto bytes = static_cast<uint8_t*>(out_buffer);
+	memcpy(bytes, &header, sizeof(header));
+	for (uint32_t device_index = 0; device_index < kSimpleAudioDriverNumDevices; device_index++)
+	{
+		SimpleAudioDriverDeviceMemoryUsage usage = {};
+		ivars->m_devices[device_index]->GetMemoryUsage(&usage);
+		memcpy(bytes + sizeof(header) + device_index * sizeof(usage), &usage, sizeof(usage));
+	}
+	*out_size = size;
+	return kIOReturnSuccess;
+}
+
+kern_return_t SimpleAudioDriver::RunControlOperation(uint16_t in_operation,
+													  kern_return_t (^in_block)(),
+													  SimpleAudioControlCompletion in_completion)
+{
+	if (in_completion == nullptr)
+	{
+		return ivars->m_control_trace.DispatchSync(ivars->m_work_queue.get(), in_operation, in_block);
+	}
+	
+	// The queued block uses the driver's state, so keep the driver until it
+	// has reported its result.
+	retain();
+	ivars->m_control_trace.DispatchAsync(ivars->m_work_queue.get(), in_operation, in_block, ^(kern_return_t in_result){
+		in_completion(in_result);
+		release();
+	});
+	return kIOReturnSuccess;
+}
+
+void SimpleAudioDriver::DrainControlOperations()
+{
+	// The work queue is serial and each operation completes on it, so an
+	// empty block runs after every operation queued before it has completed.
+	if (ivars->m_work_queue.get() != nullptr)
+	{
+		ivars->m_work_queue->DispatchSync(^{});
+	}
+}
+
+SimpleAudioDevice* SimpleAudioDriver::FindDevice(IOUserAudioObjectID in_object_id)
+{
+	for (auto& device : ivars->m_devices)
+	{
+		if (device.get() != nullptr && device->GetObjectID() == in_object_id)
+		{
+			return device.get();
+		}
+	}
+	return nullptr;
+}
+
+SimpleAudioControlTrace* SimpleAudioDriver::GetControlTrace()
+{
+	return &ivars->m_control_trace;
 }
@@ -8,8 +8,13 @@ The constants for identifiers that both the user client and the driver use.
 #ifndef SimpleAudioDriverKeys_h
 #define SimpleAudioDriverKeys_h
 
+#include <stdint.h>
+
 #define kSimpleAudioDriverClassName "SimpleAudioDriver"
 #define kSimpleAudioDriverDeviceUID "SimpleAudioDevice-UID"
+#define kSimpleAudioDriverNumDevices 2 // Devices after the first append their number to the UID.
+#define kSimpleAudioDriverDefaultSampleRate 44100.0 // The format a device starts in; the app renders offline in it when no device is connected.
+#define kSimpleAudioDriverChannelsPerFrame 1 // Every device stream is mono.
 
 #define kSimpleAudioDriverCustomPropertySelector 'sadc'
 #define kSimpleAudioDriverCustomPropertyQualifier0 "Qualifier-0"
@@ -22,7 +27,345 @@ enum SimpleAudioDriverExternalMethod
     SimpleAudioDriverExternalMethod_Open, // No arguments.
     SimpleAudioDriverExternalMethod_Close, // No arguments.
     SimpleAudioDriverExternalMethod_ToggleDataSource, // No argument. This switches between data source selection.
-    SimpleAudioDriverExternalMethod_TestConfigChange // No arguments. This switches between sample rates and exercises the config change mechanism.
+    SimpleAudioDriverExternalMethod_TestConfigChange, // No arguments. This switches between sample rates and exercises the config change mechanism.
+    SimpleAudioDriverExternalMethod_RingCommandDoorbell, // No arguments. Drains the shared command queue; returns the number of commands applied.
+    SimpleAudioDriverExternalMethod_SetRenderAhead, // Scalar inputs are the enable flag and the safety margin in frames.
+    SimpleAudioDriverExternalMethod_GetDeviceStatistics, // Structure output is a SimpleAudioDriverDeviceStatistics.
+    SimpleAudioDriverExternalMethod_ConfigureInsertChain, // Structure input is a SimpleAudioDriverInsertChainConfig.
+    SimpleAudioDriverExternalMethod_CopyControlTrace, // Structure output is a SimpleAudioDriverControlTraceHeader followed by its records.
+    SimpleAudioDriverExternalMethod_SetIORecording, // Scalar input is the enable flag. Enabling clears the recording.
+    SimpleAudioDriverExternalMethod_DrainIOTrace, // Structure output is a SimpleAudioDriverIOTraceHeader followed by the records drained.
+    SimpleAudioDriverExternalMethod_SetRenderBudget, // Scalar input is the percentage of each block's real-time budget the I/O handler may use, from 1 to 100.
+    SimpleAudioDriverExternalMethod_ScheduleAutomation, // Structure input is an array of SimpleAudioDriverAutomationEvent. Scalar output is the number scheduled.
+    SimpleAudioDriverExternalMethod_ClearAutomation, // Drops every scheduled event that hasn't applied yet.
+    SimpleAudioDriverExternalMethod_ConnectCable, // Structure input is a SimpleAudioDriverCableConfig. Scalar output is the cable index.
+    SimpleAudioDriverExternalMethod_DisconnectCable, // Scalar input is the cable index.
+    SimpleAudioDriverExternalMethod_CopyCableStatus, // Structure output is a SimpleAudioDriverCableStatusHeader followed by one status per connected cable.
+    SimpleAudioDriverExternalMethod_SetCustomProperties, // Structure input is an array of up to kSimpleAudioDriverCustomPropertyMaxBatch SimpleAudioDriverCustomPropertyEntry.
+    SimpleAudioDriverExternalMethod_SetLazyStreamMemory, // Scalar inputs are the enable flag and the idle period in milliseconds.
+    SimpleAudioDriverExternalMethod_CopyMemoryUsage // Structure output is a SimpleAudioDriverMemoryUsageHeader followed by one usage per device.
+};
+
+// The command queue is a bounded lock-free ring in memory shared between the app
+// and the driver. The app maps it with IOConnectMapMemory64 using this memory
+// type, enqueues any number of commands from any thread without a system call,
+// and then rings the doorbell once so the driver drains the whole batch on its
+// work queue.
+#define kSimpleAudioDriverCommandQueueMemoryType 0
+#define kSimpleAudioDriverCommandQueueCapacity 256 // Must be a power of two.
+
+enum SimpleAudioDriverCommand
+{
+    SimpleAudioDriverCommand_SetInputVolume, // Argument is the scalar volume, from 0.0 to 1.0.
+    SimpleAudioDriverCommand_SetDataSource, // Argument is the data-source selector value.
+    SimpleAudioDriverCommand_ToggleDataSource, // No argument.
+};
+
+// A producer owns a slot when m_sequence equals its enqueue position, and
+// publishes the command by storing the position plus one. The driver releases
+// the slot for the next lap by storing the position plus the capacity.
+struct SimpleAudioDriverCommandSlot
+{
+    uint64_t m_sequence;
+    uint32_t m_command;
+    union
+    {
+        float    m_scalar;
+        uint32_t m_value;
+    } m_argument;
+};
+
+// The enqueue and dequeue positions sit on separate cache lines so that
+// producers and the driver don't contend on the same line.
+struct SimpleAudioDriverCommandQueue
+{
+    uint64_t                     m_enqueue_position;
+    uint8_t                      m_padding_0[56];
+    uint64_t                     m_dequeue_position;
+    uint8_t                      m_padding_1[56];
+    SimpleAudioDriverCommandSlot m_slots[kSimpleAudioDriverCommandQueueCapacity];
+};
+
+// Counters that the device keeps for the app to read back.
+struct SimpleAudioDriverDeviceStatistics
+{
+    uint64_t m_render_ahead_hits; // Input blocks the render-ahead producer already synthesized.
+    uint64_t m_render_ahead_misses; // Input blocks synthesized inside the I/O handler instead.
+    int64_t  m_render_ahead_lead_frames; // How far the producer was ahead at the last input block.
+    int64_t  m_render_ahead_min_lead_frames; // The smallest lead seen since I/O started.
+    uint64_t m_loopback_copied_frames; // Frames the loopback path copied from output to input.
+    uint32_t m_loopback_zero_copy; // Nonzero while both streams share one ring buffer.
+    uint32_t m_loopback_mode_changes; // How many times the loopback mode has switched.
+    uint32_t m_quality_tier; // The SimpleAudioDriverQualityTier the I/O handler is rendering at.
+    uint32_t m_quality_tier_changes; // How many times the tier has changed since I/O started.
+    uint32_t m_render_load_percent; // The smoothed share of the budget an input block takes.
+    uint32_t m_render_peak_load_percent; // The largest share of the budget a single input block took.
+    uint32_t m_automation_events_applied; // Scheduled events applied since I/O started.
+    uint32_t m_automation_events_late; // Events that arrived after their sample time and applied at the start of the next block.
+    uint64_t m_zts_timer_count; // Timestamp timer wakes since I/O started.
+    uint64_t m_zts_timer_total_lateness_ns; // How late the timer woke, summed over those wakes.
+    uint32_t m_zts_timer_max_lateness_ns; // The latest a single wake has been.
+    uint32_t m_channels_per_frame; // The device's current stream format.
+    double m_sample_rate;
+};
+
+// The insert chain processes the input stream after the data source: a DC
+// blocker, a bank of parametric biquad bands, and then a peak limiter.
+#define kSimpleAudioDriverInsertChainMaxBands 8
+
+enum SimpleAudioDriverFilterType
+{
+    SimpleAudioDriverFilterType_Off,
+    SimpleAudioDriverFilterType_Peak,
+    SimpleAudioDriverFilterType_LowShelf,
+    SimpleAudioDriverFilterType_HighShelf,
+    SimpleAudioDriverFilterType_LowPass,
+    SimpleAudioDriverFilterType_HighPass,
+};
+
+struct SimpleAudioDriverInsertBand
+{
+    uint32_t m_type; // A SimpleAudioDriverFilterType.
+    float    m_frequency; // In Hz, below the Nyquist frequency.
+    float    m_gain_db; // Only used by the peak and shelf types.
+    float    m_q;
+};
+
+struct SimpleAudioDriverInsertChainConfig
+{
+    uint32_t                    m_dc_blocker_enabled;
+    uint32_t                    m_limiter_enabled;
+    float                       m_limiter_threshold_db;
+    float                       m_limiter_release_ms;
+    SimpleAudioDriverInsertBand m_bands[kSimpleAudioDriverInsertChainMaxBands];
+};
+
+// The driver records the queue wait and run time of every control-plane
+// operation into a fixed-size trace that the app can copy out and summarize.
+#define kSimpleAudioDriverControlTraceCapacity 128
+
+enum SimpleAudioDriverControlOperation
+{
+    SimpleAudioDriverControlOperation_StartIO,
+    SimpleAudioDriverControlOperation_StopIO,
+    SimpleAudioDriverControlOperation_PerformConfigChange,
+    SimpleAudioDriverControlOperation_ChangeSampleRate,
+    SimpleAudioDriverControlOperation_StartDevice,
+    SimpleAudioDriverControlOperation_StopDevice,
+    SimpleAudioDriverControlOperation_ToggleDataSource,
+    SimpleAudioDriverControlOperation_TestConfigChange,
+    SimpleAudioDriverControlOperation_ApplyCommands,
+    SimpleAudioDriverControlOperation_SetRenderAhead,
+    SimpleAudioDriverControlOperation_ConfigureInsertChain,
+    SimpleAudioDriverControlOperation_UserClientMethod,
+    SimpleAudioDriverControlOperation_SetIORecording,
+    SimpleAudioDriverControlOperation_DrainIOTrace,
+    SimpleAudioDriverControlOperation_SetRenderBudget,
+    SimpleAudioDriverControlOperation_ScheduleAutomation,
+    SimpleAudioDriverControlOperation_ClearAutomation,
+    SimpleAudioDriverControlOperation_ConnectCable,
+    SimpleAudioDriverControlOperation_DisconnectCable,
+    SimpleAudioDriverControlOperation_SetCustomProperties,
+    SimpleAudioDriverControlOperation_SetLazyStreamMemory,
+};
+
+struct SimpleAudioDriverControlTraceRecord
+{
+    uint64_t m_request_time; // Host time when the operation was requested.
+    uint32_t m_queue_wait; // Host ticks spent waiting for the work queue.
+    uint32_t m_duration; // Host ticks the operation ran on the queue.
+    uint16_t m_operation; // A SimpleAudioDriverControlOperation.
+    uint16_t m_detail; // The selector, for user client methods.
+    int32_t  m_result;
+};
+
+struct SimpleAudioDriverControlTraceHeader
+{
+    uint32_t m_num_records; // The number of records that follow, oldest first.
+    uint32_t m_timebase_numer; // Converts host ticks to nanoseconds.
+    uint32_t m_timebase_denom;
+    uint32_t m_reserved;
+    uint64_t m_total_records; // Every record written since the driver started.
+};
+
+// When recording is on, the device logs every I/O operation, zero timestamp,
+// and control change into a preallocated ring that the app drains, so a
+// capture of real HAL traffic can be replayed offline.
+#define kSimpleAudioDriverIOTraceCapacity 4096
+#define kSimpleAudioDriverIOTraceMaxDrainRecords 160
+
+enum SimpleAudioDriverIOTraceEvent
+{
+    SimpleAudioDriverIOTraceEvent_WriteEnd, // Value is the I/O buffer frame size.
+    SimpleAudioDriverIOTraceEvent_BeginRead, // Value is the I/O buffer frame size.
+    SimpleAudioDriverIOTraceEvent_ZeroTimestamp, // No value.
+    SimpleAudioDriverIOTraceEvent_StartIO, // No value.
+    SimpleAudioDriverIOTraceEvent_StopIO, // No value.
+    SimpleAudioDriverIOTraceEvent_DataSource, // Value is the data-source selector value.
+    SimpleAudioDriverIOTraceEvent_InputVolume, // Value is the bits of the scalar volume.
+    SimpleAudioDriverIOTraceEvent_SampleRate, // Value is the sample rate in Hz.
+};
+
+struct SimpleAudioDriverIOTraceRecord
+{
+    uint64_t m_sample_time;
+    uint64_t m_host_time;
+    uint32_t m_event; // A SimpleAudioDriverIOTraceEvent.
+    uint32_t m_value;
+};
+
+struct SimpleAudioDriverIOTraceHeader
+{
+    uint32_t m_num_records; // The number of records that follow, oldest first.
+    uint32_t m_timebase_numer; // Converts host ticks to nanoseconds.
+    uint32_t m_timebase_denom;
+    uint32_t m_reserved;
+    uint64_t m_dropped_records; // Records overwritten before they were drained.
+};
+
+// The app appends drained records to a capture file that starts with this
+// header, and the host replay tool reads the file back.
+#define kSimpleAudioDriverIOTraceFileMagic 0x5341494F // 'SAIO'
+#define kSimpleAudioDriverIOTraceFileVersion 1
+
+struct SimpleAudioDriverIOTraceFileHeader
+{
+    uint32_t m_magic;
+    uint32_t m_version;
+    uint32_t m_timebase_numer; // Converts host ticks to nanoseconds.
+    uint32_t m_timebase_denom;
+};
+
+// The I/O handler times each input block against its real-time budget and
+// steps down to cheaper rendering when the smoothed load gets too high, then
+// steps back up once the load has stayed low for a while.
+enum SimpleAudioDriverQualityTier
+{
+    SimpleAudioDriverQualityTier_Full, // Everything runs.
+    SimpleAudioDriverQualityTier_BypassEqualizer, // The insert chain skips its parametric bands.
+    SimpleAudioDriverQualityTier_CheapOscillator, // The tone also comes from a recurrence instead of calling sin per sample.
+};
+
+// Automation events change a parameter at an exact device sample time. The
+// I/O handler splits its block at each event, so the change lands on that
+// frame whatever the buffer size. Sample times restart with I/O, so starting
+// I/O clears anything still scheduled.
+#define kSimpleAudioDriverAutomationCapacity 64
+
+enum SimpleAudioDriverAutomationParameter
+{
+    SimpleAudioDriverAutomationParameter_InputVolume, // Scalar argument from 0 to 1.
+    SimpleAudioDriverAutomationParameter_DataSource, // Value argument is a data-source selector value, which also routes loopback.
+};
+
+struct SimpleAudioDriverAutomationEvent
+{
+    uint64_t m_sample_time;
+    uint32_t m_parameter; // A SimpleAudioDriverAutomationParameter.
+    union
+    {
+        float    m_scalar;
+        uint32_t m_value;
+    } m_argument;
+};
+
+// A cable carries one device's output into another device's input inside the
+// driver, so apps can chain without a round trip through the HAL. Cables are
+// aligned to a timeline that all devices share, and the destination reads
+// latency frames behind the source. A device with any cables connected to it
+// takes its input from them, mixed, instead of from its data source.
+#define kSimpleAudioDriverMaxCables 32
+#define kSimpleAudioDriverCableNameLength 32
+#define kSimpleAudioDriverCableMaxLatencyFrames 2048
+
+struct SimpleAudioDriverCableConfig
+{
+    char     m_name[kSimpleAudioDriverCableNameLength]; // Unique, and NUL-terminated.
+    uint32_t m_source_device; // Device indexes, from 0 to kSimpleAudioDriverNumDevices - 1.
+    uint32_t m_destination_device;
+    uint32_t m_latency_frames;
+    uint32_t m_reserved;
+};
+
+struct SimpleAudioDriverCableStatus
+{
+    char     m_name[kSimpleAudioDriverCableNameLength];
+    uint32_t m_index;
+    uint32_t m_source_device;
+    uint32_t m_destination_device;
+    uint32_t m_latency_frames;
+    uint64_t m_frames_carried; // Frames the destination has read.
+    uint32_t m_underruns; // Reads that reached past what the source had written.
+    uint32_t m_overruns; // Reads the source overwrote before they finished.
+    int32_t  m_fill_frames; // Frames the source had written beyond the last read.
+    int32_t  m_min_fill_frames;
+    int32_t  m_max_fill_frames;
+    uint32_t m_reserved;
+};
+
+struct SimpleAudioDriverCableStatusHeader
+{
+    uint32_t m_num_cables; // The number of statuses that follow.
+    uint32_t m_reserved;
+};
+
+// The custom property store holds qualifier and value pairs for the 'sadc'
+// property in a hash table, so the driver can look up and update any of them in
+// constant time. The 'sads' property has one qualifier, and its value is a
+// snapshot of every pair in one blob, so the app can read them all with a
+// single call instead of one per qualifier. The driver republishes it once
+// after a run of changes, so it can briefly trail a batch that just returned.
+#define kSimpleAudioDriverCustomPropertySnapshotSelector 'sads'
+#define kSimpleAudioDriverCustomPropertySnapshotQualifier "Snapshot"
+#define kSimpleAudioDriverCustomPropertyCapacity 1024
+#define kSimpleAudioDriverCustomPropertyQualifierLength 64
+#define kSimpleAudioDriverCustomPropertyValueLength 128
+#define kSimpleAudioDriverCustomPropertyMaxBatch 16
+
+struct SimpleAudioDriverCustomPropertyEntry
+{
+    char m_qualifier[kSimpleAudioDriverCustomPropertyQualifierLength]; // NUL-terminated.
+    char m_value[kSimpleAudioDriverCustomPropertyValueLength]; // NUL-terminated.
+};
+
+// The snapshot is a SimpleAudioDriverCustomPropertySnapshotHeader followed by
+// the pairs in the order they were first set. Each pair is a
+// SimpleAudioDriverCustomPropertyRecord followed by the qualifier and then the
+// value, without terminators or padding.
+struct SimpleAudioDriverCustomPropertySnapshotHeader
+{
+    uint32_t m_num_entries;
+    uint32_t m_reserved;
+};
+
+struct SimpleAudioDriverCustomPropertyRecord
+{
+    uint16_t m_qualifier_length;
+    uint16_t m_value_length;
+};
+
+// In lazy mode a device commits its stream ring buffers when I/O starts, and
+// releases them and their mappings once I/O has been stopped for the idle
+// period, so a device nobody is using only keeps its fixed state. The mode and
+// period apply to every device.
+#define kSimpleAudioDriverDefaultStreamIdleMs 5000
+#define kSimpleAudioDriverMaxStreamIdleMs 600000
+
+struct SimpleAudioDriverDeviceMemoryUsage
+{
+    uint32_t m_device_index;
+    uint32_t m_lazy_stream_memory; // Nonzero while the device is in lazy mode.
+    uint64_t m_state_bytes; // The device's own state, including helper memory allocated on first use. It's kept in either mode.
+    uint64_t m_ring_bytes; // Stream ring buffer memory currently committed.
+    uint64_t m_mapped_bytes; // Ring memory the driver currently has mapped.
+    uint32_t m_ring_commits; // How many times the rings have been allocated.
+    uint32_t m_ring_releases; // How many times an idle device has released them.
+};
+
+struct SimpleAudioDriverMemoryUsageHeader
+{
+    uint32_t m_num_devices; // The number of usages that follow, one per device.
+    uint32_t m_reserved;
 };
 
 #endif /* SimpleAudioDriverKeys_h */
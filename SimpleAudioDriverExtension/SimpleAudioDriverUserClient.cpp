@@ -10,15 +10,24 @@ The implementation of the user client, which connects to and
 #include "SimpleAudioDriverUserClient.h"
 #include "SimpleAudioDriver.h"
 #include "SimpleAudioDriverKeys.h"
+#include "SimpleAudioControlTrace.h"
+#include "SimpleAudioCommandQueue.h"
 
 //	System Includes
 #include <DriverKit/DriverKit.h>
 #include <DriverKit/OSSharedPtr.h>
 #include <AudioDriverKit/AudioDriverKit.h>
 
+constexpr uint32_t k_command_batch_size = 16;
+
 struct SimpleAudioDriverUserClient_IVars
 {
 	OSSharedPtr<SimpleAudioDriver>	m_provider = nullptr;
+	OSSharedPtr<IODispatchQueue>	m_method_queue;
+	
+	OSSharedPtr<IOBufferMemoryDescriptor>	m_command_queue_buffer;
+	SimpleAudioDriverCommandQueue*			m_command_queue;
+	uint64_t								m_command_dequeue_position;
 };
 
 bool	SimpleAudioDriverUserClient::init()
@@ -42,6 +51,9 @@ void	SimpleAudioDriverUserClient::free()
 	if (ivars != nullptr)
 	{
 		ivars->m_provider.reset();
+		ivars->m_method_queue.reset();
+		ivars->m_command_queue_buffer.reset();
+		ivars->m_command_queue = nullptr;
 	}
 	IOSafeDeleteNULL(ivars, SimpleAudioDriverUserClient_IVars, 1);
 	super::free();
@@ -56,16 +68,55 @@ kern_return_t	SimpleAudioDriverUserClient::Start_Impl(IOService* in_provider)
 	FailIfError(ret, , Failure, "Failed to start super!");
 	
 	ivars->m_provider = OSSharedPtr(OSDynamicCast(SimpleAudioDriver, in_provider), OSRetain);
+	
+	// External methods run on the default queue. The control trace uses it to
+	// find the hops each method makes onto the work queue.
+	IODispatchQueue* method_queue = nullptr;
+	ret = CopyDispatchQueue(kIOServiceDefaultQueueName, &method_queue);
+	FailIfError(ret, , Failure, "Failed to copy the default queue");
+	ivars->m_method_queue = OSSharedPtr(method_queue, OSNoRetain);
+	
+	ret = CreateCommandQueue();
+	FailIfError(ret, , Failure, "Failed to create the command queue");
 
 	return kIOReturnSuccess;
 	
 Failure:
 	ivars->m_provider.reset();
+	ivars->m_method_queue.reset();
+	ivars->m_command_queue_buffer.reset();
+	ivars->m_command_queue = nullptr;
+	return ret;
+}
+
+/// - Tag: CreateCommandQueue
+kern_return_t	SimpleAudioDriverUserClient::CreateCommandQueue()
+{
+	IOAddressSegment range = {};
+	kern_return_t ret = IOBufferMemoryDescriptor::Create(kIOMemoryDirectionInOut, sizeof(SimpleAudioDriverCommandQueue), 0, ivars->m_command_queue_buffer.attach());
+	FailIfError(ret, , Failure, "Failed to create command queue IOBufferMemoryDescriptor");
+	
+	ret = ivars->m_command_queue_buffer->SetLength(sizeof(SimpleAudioDriverCommandQueue));
+	FailIfError(ret, , Failure, "Failed to set command queue length");
+	
+	ret = ivars->m_command_queue_buffer->GetAddressRange(&range);
+	FailIfError(ret, , Failure, "Failed to get command queue address");
+	
+	ivars->m_command_queue = reinterpret_cast<SimpleAudioDriverCommandQueue*>(range.address);
+	SimpleAudioCommandQueue::Initialize(ivars->m_command_queue);
+	ivars->m_command_dequeue_position = 0;
+	
+Failure:
 	return ret;
 }
 
 kern_return_t	SimpleAudioDriverUserClient::Stop_Impl(IOService* in_provider)
 {
+	// Deliver every completion the app is still waiting for before stopping.
+	if (ivars->m_provider.get() != nullptr)
+	{
+		ivars->m_provider->DrainControlOperations();
+	}
 	return Stop(in_provider, SUPERDISPATCH);
 }
 
@@ -85,6 +136,13 @@ kern_return_t	SimpleAudioDriverUserClient::ExternalMethod(uint64_t in_selector,
 	{
 		return kIOReturnNotAttached;
 	}
+	
+	// The request is stamped before the method dispatches to the work queue,
+	// and the work begins when its first hop does, so the record shows the
+	// method's wait for the queue.
+	auto control_trace = ivars->m_provider->GetControlTrace();
+	auto request_time = mach_absolute_time();
+	bool timed = control_trace->BeginMethod(ivars->m_method_queue.get());
 		
 	switch(static_cast<SimpleAudioDriverExternalMethod>(in_selector))
 	{
@@ -102,7 +160,9 @@ kern_return_t	SimpleAudioDriverUserClient::ExternalMethod(uint64_t in_selector,
 
 		case SimpleAudioDriverExternalMethod_ToggleDataSource:
 		{
-			ret = ivars->m_provider->HandleToggleDataSource();
+			ret = RunControlMethod(in_arguments, ^kern_return_t(SimpleAudioControlCompletion in_completion){
+				return ivars->m_provider->HandleToggleDataSource(in_completion);
+			});
 			break;
 		}
 			
@@ -111,10 +171,335 @@ kern_return_t	SimpleAudioDriverUserClient::ExternalMethod(uint64_t in_selector,
 			ret = ivars->m_provider->HandleTestConfigChange();
 			break;
 		}
+			
+		case SimpleAudioDriverExternalMethod_RingCommandDoorbell:
+		{
+			FailIfNULL(ivars->m_command_queue, ret = kIOReturnNotReady, Failure, "Command queue isn't available");
+			
+			// Copy the commands out of shared memory before handing them to the
+			// driver, so the app can't change them while they're being applied.
+			// A small batch at a time keeps the copy off most of the stack, and
+			// stopping after one queue's worth keeps a busy producer from
+			// holding the doorbell forever. A batch with a bad command doesn't
+			// stop the drain; the first error is reported once it's done.
+			SimpleAudioDriverCommandSlot commands[k_command_batch_size];
+			uint32_t num_drained = 0;
+			uint32_t num_applied = 0;
+			while (num_drained < kSimpleAudioDriverCommandQueueCapacity)
+			{
+				uint32_t num_commands = SimpleAudioCommandQueue::Dequeue(ivars->m_command_queue, &ivars->m_command_dequeue_position,
+																		  commands, k_command_batch_size);
+				if (num_commands == 0)
+				{
+					break;
+				}
+				num_drained += num_commands;
+				
+				uint32_t num_batch_applied = 0;
+				auto batch_ret = ivars->m_provider->HandleCommands(commands, num_commands, &num_batch_applied);
+				num_applied += num_batch_applied;
+				if (ret == kIOReturnSuccess)
+				{
+					ret = batch_ret;
+				}
+				if (num_commands < k_command_batch_size)
+				{
+					break;
+				}
+			}
+			
+			if (in_arguments != nullptr && in_arguments->scalarOutput != nullptr && in_arguments->scalarOutputCount >= 1)
+			{
+				in_arguments->scalarOutput[0] = num_applied;
+				in_arguments->scalarOutputCount = 1;
+			}
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_SetRenderAhead:
+		{
+			FailIf(in_arguments == nullptr || in_arguments->scalarInput == nullptr || in_arguments->scalarInputCount < 2,
+				   ret = kIOReturnBadArgument, Failure, "Render-ahead needs an enable flag and a margin");
+			ret = RunControlMethod(in_arguments, ^kern_return_t(SimpleAudioControlCompletion in_completion){
+				return ivars->m_provider->HandleSetRenderAhead(in_arguments->scalarInput[0] != 0,
+															   static_cast<uint32_t>(in_arguments->scalarInput[1]),
+															   in_completion);
+			});
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_GetDeviceStatistics:
+		{
+			FailIfNULL(in_arguments, ret = kIOReturnBadArgument, Failure, "No arguments for device statistics");
+			SimpleAudioDriverDeviceStatistics statistics = {};
+			ret = ivars->m_provider->HandleGetDeviceStatistics(&statistics);
+			FailIfError(ret, , Failure, "Failed to get device statistics");
+			in_arguments->structureOutput = OSData::withBytes(&statistics, sizeof(statistics));
+			FailIfNULL(in_arguments->structureOutput, ret = kIOReturnNoMemory, Failure, "Failed to allocate device statistics");
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_ConfigureInsertChain:
+		{
+			FailIf(in_arguments == nullptr || in_arguments->structureInput == nullptr ||
+				   in_arguments->structureInput->getLength() != sizeof(SimpleAudioDriverInsertChainConfig),
+				   ret = kIOReturnBadArgument, Failure, "Insert chain needs a SimpleAudioDriverInsertChainConfig");
+			SimpleAudioDriverInsertChainConfig config = {};
+			memcpy(&config, in_arguments->structureInput->getBytesNoCopy(), sizeof(config));
+			ret = ivars->m_provider->HandleConfigureInsertChain(&config);
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_CopyControlTrace:
+		{
+			FailIfNULL(in_arguments, ret = kIOReturnBadArgument, Failure, "No arguments for the control trace");
+			ret = CopyStructureOutput(in_arguments, sizeof(SimpleAudioDriverControlTraceHeader) + kSimpleAudioDriverControlTraceCapacity * sizeof(SimpleAudioDriverControlTraceRecord),
+									  ^kern_return_t(void* out_buffer, size_t in_buffer_size, size_t* out_size){
+				*out_size = ivars->m_provider->GetControlTrace()->Export(out_buffer, in_buffer_size);
+				return kIOReturnSuccess;
+			});
+			FailIfError(ret, , Failure, "Failed to copy the control trace");
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_SetIORecording:
+		{
+			FailIf(in_arguments == nullptr || in_arguments->scalarInput == nullptr || in_arguments->scalarInputCount < 1,
+				   ret = kIOReturnBadArgument, Failure, "I/O recording needs an enable flag");
+			ret = RunControlMethod(in_arguments, ^kern_return_t(SimpleAudioControlCompletion in_completion){
+				return ivars->m_provider->HandleSetIORecording(in_arguments->scalarInput[0] != 0, in_completion);
+			});
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_DrainIOTrace:
+		{
+			FailIfNULL(in_arguments, ret = kIOReturnBadArgument, Failure, "No arguments for the I/O trace");
+			ret = CopyStructureOutput(in_arguments, sizeof(SimpleAudioDriverIOTraceHeader) + kSimpleAudioDriverIOTraceMaxDrainRecords * sizeof(SimpleAudioDriverIOTraceRecord),
+									  ^kern_return_t(void* out_buffer, size_t in_buffer_size, size_t* out_size){
+				return ivars->m_provider->HandleDrainIOTrace(out_buffer, in_buffer_size, out_size);
+			});
+			FailIfError(ret, , Failure, "Failed to drain the I/O trace");
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_SetRenderBudget:
+		{
+			FailIf(in_arguments == nullptr || in_arguments->scalarInput == nullptr || in_arguments->scalarInputCount < 1,
+				   ret = kIOReturnBadArgument, Failure, "Render budget needs a percentage");
+			ret = RunControlMethod(in_arguments, ^kern_return_t(SimpleAudioControlCompletion in_completion){
+				return ivars->m_provider->HandleSetRenderBudget(static_cast<uint32_t>(in_arguments->scalarInput[0]), in_completion);
+			});
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_ScheduleAutomation:
+		{
+			FailIf(in_arguments == nullptr || in_arguments->structureInput == nullptr ||
+				   in_arguments->structureInput->getLength() == 0 ||
+				   in_arguments->structureInput->getLength() % sizeof(SimpleAudioDriverAutomationEvent) != 0 ||
+				   in_arguments->structureInput->getLength() > kSimpleAudioDriverAutomationCapacity * sizeof(SimpleAudioDriverAutomationEvent),
+				   ret = kIOReturnBadArgument, Failure, "Automation needs an array of SimpleAudioDriverAutomationEvent");
+			
+			// Copy the events so the app can't change them while they're being scheduled.
+			SimpleAudioDriverAutomationEvent events[kSimpleAudioDriverAutomationCapacity];
+			uint32_t num_events = static_cast<uint32_t>(in_arguments->structureInput->getLength() / sizeof(SimpleAudioDriverAutomationEvent));
+			uint32_t num_scheduled = 0;
+			memcpy(events, in_arguments->structureInput->getBytesNoCopy(), num_events * sizeof(SimpleAudioDriverAutomationEvent));
+			ret = ivars->m_provider->HandleScheduleAutomation(events, num_events, &num_scheduled);
+			
+			if (in_arguments->scalarOutput != nullptr && in_arguments->scalarOutputCount >= 1)
+			{
+				in_arguments->scalarOutput[0] = num_scheduled;
+				in_arguments->scalarOutputCount = 1;
+			}
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_ClearAutomation:
+		{
+			ret = RunControlMethod(in_arguments, ^kern_return_t(SimpleAudioControlCompletion in_completion){
+				return ivars->m_provider->HandleClearAutomation(in_completion);
+			});
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_ConnectCable:
+		{
+			FailIf(in_arguments == nullptr || in_arguments->structureInput == nullptr ||
+				   in_arguments->structureInput->getLength() != sizeof(SimpleAudioDriverCableConfig),
+				   ret = kIOReturnBadArgument, Failure, "Connecting a cable needs a SimpleAudioDriverCableConfig");
+			
+			// Copy the configuration so the app can't change it while it's being checked.
+			SimpleAudioDriverCableConfig config;
+			uint32_t cable_index = 0;
+			memcpy(&config, in_arguments->structureInput->getBytesNoCopy(), sizeof(config));
+			config.m_name[kSimpleAudioDriverCableNameLength - 1] = '\0';
+			ret = ivars->m_provider->HandleConnectCable(&config, &cable_index);
+			FailIfError(ret, , Failure, "Failed to connect the cable");
+			
+			if (in_arguments->scalarOutput != nullptr && in_arguments->scalarOutputCount >= 1)
+			{
+				in_arguments->scalarOutput[0] = cable_index;
+				in_arguments->scalarOutputCount = 1;
+			}
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_DisconnectCable:
+		{
+			FailIf(in_arguments == nullptr || in_arguments->scalarInput == nullptr || in_arguments->scalarInputCount < 1,
+				   ret = kIOReturnBadArgument, Failure, "Disconnecting a cable needs its index");
+			ret = RunControlMethod(in_arguments, ^kern_return_t(SimpleAudioControlCompletion in_completion){
+				return ivars->m_provider->HandleDisconnectCable(static_cast<uint32_t>(in_arguments->scalarInput[0]), in_completion);
+			});
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_CopyCableStatus:
+		{
+			FailIfNULL(in_arguments, ret = kIOReturnBadArgument, Failure, "No arguments for the cable status");
+			ret = CopyStructureOutput(in_arguments, sizeof(SimpleAudioDriverCableStatusHeader) + kSimpleAudioDriverMaxCables * sizeof(SimpleAudioDriverCableStatus),
+									  ^kern_return_t(void* out_buffer, size_t in_buffer_size, size_t* out_size){
+				return ivars->m_provider->HandleCopyCableStatus(out_buffer, in_buffer_size, out_size);
+			});
+			FailIfError(ret, , Failure, "Failed to copy the cable status");
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_SetLazyStreamMemory:
+		{
+			FailIf(in_arguments == nullptr || in_arguments->scalarInput == nullptr || in_arguments->scalarInputCount < 2,
+				   ret = kIOReturnBadArgument, Failure, "Lazy stream memory needs an enable flag and an idle period");
+			FailIf(in_arguments->scalarInput[1] > kSimpleAudioDriverMaxStreamIdleMs,
+				   ret = kIOReturnBadArgument, Failure, "The idle period is too long");
+			ret = RunControlMethod(in_arguments, ^kern_return_t(SimpleAudioControlCompletion in_completion){
+				return ivars->m_provider->HandleSetLazyStreamMemory(in_arguments->scalarInput[0] != 0,
+																	static_cast<uint32_t>(in_arguments->scalarInput[1]),
+																	in_completion);
+			});
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_CopyMemoryUsage:
+		{
+			FailIfNULL(in_arguments, ret = kIOReturnBadArgument, Failure, "No arguments for the memory usage");
+			uint8_t usage_buffer[sizeof(SimpleAudioDriverMemoryUsageHeader) + kSimpleAudioDriverNumDevices * sizeof(SimpleAudioDriverDeviceMemoryUsage)];
+			size_t usage_size = 0;
+			ret = ivars->m_provider->HandleCopyMemoryUsage(usage_buffer, sizeof(usage_buffer), &usage_size);
+			FailIfError(ret, , Failure, "Failed to copy the memory usage");
+			in_arguments->structureOutput = OSData::withBytes(usage_buffer, usage_size);
+			FailIfNULL(in_arguments->structureOutput, ret = kIOReturnNoMemory, Failure, "Failed to allocate the memory usage");
+			break;
+		}
+			
+		case SimpleAudioDriverExternalMethod_SetCustomProperties:
+		{
+			FailIf(in_arguments == nullptr || in_arguments->structureInput == nullptr ||
+				   in_arguments->structureInput->getLength() == 0 ||
+				   in_arguments->structureInput->getLength() % sizeof(SimpleAudioDriverCustomPropertyEntry) != 0 ||
+				   in_arguments->structureInput->getLength() > kSimpleAudioDriverCustomPropertyMaxBatch * sizeof(SimpleAudioDriverCustomPropertyEntry),
+				   ret = kIOReturnBadArgument, Failure, "Custom properties need an array of SimpleAudioDriverCustomPropertyEntry");
+			
+			// Copy the entries so the app can't change them while they're being
+			// stored, onto the heap since a full batch is 3 KB. The store rejects
+			// any string that doesn't end inside its field.
+			uint32_t num_entries = static_cast<uint32_t>(in_arguments->structureInput->getLength() / sizeof(SimpleAudioDriverCustomPropertyEntry));
+			auto entries = IONewZero(SimpleAudioDriverCustomPropertyEntry, num_entries);
+			FailIfNULL(entries, ret = kIOReturnNoMemory, Failure, "Failed to allocate the custom property entries");
+			memcpy(entries, in_arguments->structureInput->getBytesNoCopy(), num_entries * sizeof(SimpleAudioDriverCustomPropertyEntry));
+			ret = ivars->m_provider->HandleSetCustomProperties(entries, num_entries);
+			IOSafeDeleteNULL(entries, SimpleAudioDriverCustomPropertyEntry, num_entries);
+			break;
+		}
 
 		default:
 			ret = super::ExternalMethod(in_selector, in_arguments, in_dispatch, in_target, in_reference);
 	};
 	
+Failure:
+	uint64_t begin_time = timed ? control_trace->EndMethod(ivars->m_method_queue.get()) : 0;
+	control_trace->Record(SimpleAudioDriverControlOperation_UserClientMethod, static_cast<uint16_t>(in_selector),
+						  request_time, begin_time != 0 ? begin_time : request_time, mach_absolute_time(), ret);
+	return ret;
+}
+
+/// - Tag: RunControlMethod
+kern_return_t SimpleAudioDriverUserClient::RunControlMethod(IOUserClientMethodArguments* in_arguments,
+															kern_return_t (^in_method)(SimpleAudioControlCompletion in_completion))
+{
+	// Without an async reference, the app waits in the call for the result.
+	OSAction* action = in_arguments != nullptr ? in_arguments->completion : nullptr;
+	if (action == nullptr)
+	{
+		return in_method(nullptr);
+	}
+	
+	// Hold the user client and the app's completion until the work queue
+	// reports the result. If the operation isn't queued, the app gets the
+	// error from the call instead.
+	retain();
+	action->retain();
+	auto ret = in_method(^(kern_return_t in_result){
+		IOUserClientAsyncArgumentsArray async_data = {};
+		AsyncCompletion(action, in_result, async_data, 0);
+		action->release();
+		release();
+	});
+	if (ret != kIOReturnSuccess)
+	{
+		action->release();
+		release();
+	}
+	return ret;
+}
+
+kern_return_t SimpleAudioDriverUserClient::CopyStructureOutput(IOUserClientMethodArguments* in_arguments,
+															   size_t in_capacity,
+															   kern_return_t (^in_copy)(void* out_buffer, size_t in_buffer_size, size_t* out_size))
+{
+	size_t size = 0;
+	auto buffer = IOMallocZero(in_capacity);
+	if (buffer == nullptr)
+	{
+		return kIOReturnNoMemory;
+	}
+	
+	auto ret = in_copy(buffer, in_capacity, &size);
+	if (ret == kIOReturnSuccess)
+	{
+		in_arguments->structureOutput = OSData::withBytes(buffer, size);
+		if (in_arguments->structureOutput == nullptr)
+		{
+			ret = kIOReturnNoMemory;
+		}
+	}
+	IOFree(buffer, in_capacity);
+	return ret;
+}
+
+kern_return_t	SimpleAudioDriverUserClient::CopyClientMemoryForType_Impl(uint64_t in_type,
+																		  uint64_t* out_options,
+																		  IOMemoryDescriptor** out_memory)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	
+	switch (in_type)
+	{
+		case kSimpleAudioDriverCommandQueueMemoryType:
+		{
+			FailIfNULL(ivars->m_command_queue_buffer.get(), ret = kIOReturnNotReady, Failure, "Command queue isn't available");
+			ivars->m_command_queue_buffer->retain();
+			*out_memory = ivars->m_command_queue_buffer.get();
+			*out_options = 0;
+			break;
+		}
+			
+		default:
+			ret = CopyClientMemoryForType(in_type, out_options, out_memory, SUPERDISPATCH);
+			break;
+	}
+	
+Failure:
 	return ret;
 }
@@ -0,0 +1,139 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The implementation of the recorder that captures the device's real-time
+             I/O traffic for offline replay.
+*/
+
+// Self Include
+#include "SimpleAudioIORecorder.h"
+
+// System Includes
+#include <DriverKit/DriverKit.h>
+#include <string.h>
+
+void SimpleAudioIORecorder::Initialize()
+{
+	bzero(this, sizeof(*this));
+	
+	struct mach_timebase_info timebase_info;
+	mach_timebase_info(&timebase_info);
+	m_timebase_numer = timebase_info.numer;
+	m_timebase_denom = timebase_info.denom;
+}
+
+void SimpleAudioIORecorder::SetSlots(Slot* in_slots)
+{
+	m_slots = in_slots;
+}
+
+void SimpleAudioIORecorder::SetEnabled(bool in_enabled)
+{
+	// Without slots there's nowhere to record.
+	if (in_enabled && m_slots == nullptr)
+	{
+		return;
+	}
+	
+	if (in_enabled)
+	{
+		// Start the recording at the current write position.
+		__atomic_store_n(&m_enabled, false, __ATOMIC_RELAXED);
+		m_read_position = __atomic_load_n(&m_write_position, __ATOMIC_ACQUIRE);
+		m_dropped_records = 0;
+	}
+	__atomic_store_n(&m_enabled, in_enabled, __ATOMIC_RELEASE);
+}
+
+bool SimpleAudioIORecorder::IsEnabled() const
+{
+	return __atomic_load_n(&m_enabled, __ATOMIC_RELAXED);
+}
+
+void SimpleAudioIORecorder::Record(uint32_t in_event, uint32_t in_value, uint64_t in_sample_time, uint64_t in_host_time)
+{
+	// Acquire, so a writer on another queue sees the slots that were set
+	// before recording was enabled.
+	if (!__atomic_load_n(&m_enabled, __ATOMIC_ACQUIRE))
+	{
+		return;
+	}
+	
+	auto position = __atomic_fetch_add(&m_write_position, 1, __ATOMIC_RELAXED);
+	auto& slot = m_slots[position % kSimpleAudioDriverIOTraceCapacity];
+	
+	// An odd sequence marks the slot as being written for this position, and
+	// the following even one marks it complete.
+	__atomic_store_n(&slot.m_sequence, position * 2 + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	
+	slot.m_record.m_sample_time = in_sample_time;
+	slot.m_record.m_host_time = in_host_time;
+	slot.m_record.m_event = in_event;
+	slot.m_record.m_value = in_value;
+	
+	__atomic_store_n(&slot.m_sequence, position * 2 + 2, __ATOMIC_RELEASE);
+}
+
+size_t SimpleAudioIORecorder::Drain(void* out_buffer, size_t in_buffer_size)
+{
+	if (in_buffer_size < sizeof(SimpleAudioDriverIOTraceHeader))
+	{
+		return 0;
+	}
+	
+	auto header = reinterpret_cast<SimpleAudioDriverIOTraceHeader*>(out_buffer);
+	auto records = reinterpret_cast<SimpleAudioDriverIOTraceRecord*>(header + 1);
+	size_t max_records = (in_buffer_size - sizeof(*header)) / sizeof(SimpleAudioDriverIOTraceRecord);
+	
+	// Skip whatever the writers have already lapped. Nothing has been
+	// written before there are slots.
+	auto end_position = m_slots != nullptr ? __atomic_load_n(&m_write_position, __ATOMIC_ACQUIRE) : m_read_position;
+	if (end_position - m_read_position > kSimpleAudioDriverIOTraceCapacity)
+	{
+		m_dropped_records += end_position - kSimpleAudioDriverIOTraceCapacity - m_read_position;
+		m_read_position = end_position - kSimpleAudioDriverIOTraceCapacity;
+	}
+	
+	uint32_t num_records = 0;
+	while (m_read_position < end_position && num_records < max_records)
+	{
+		const auto& slot = m_slots[m_read_position % kSimpleAudioDriverIOTraceCapacity];
+		auto expected_sequence = m_read_position * 2 + 2;
+		auto sequence = __atomic_load_n(&slot.m_sequence, __ATOMIC_ACQUIRE);
+		if (sequence < expected_sequence)
+		{
+			// The writer that claimed this position hasn't finished, so stop
+			// here and pick it up on the next drain to keep the order.
+			break;
+		}
+		
+		if (sequence == expected_sequence)
+		{
+			records[num_records] = slot.m_record;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&slot.m_sequence, __ATOMIC_RELAXED) == expected_sequence)
+			{
+				num_records++;
+			}
+			else
+			{
+				m_dropped_records++;
+			}
+		}
+		else
+		{
+			// A writer lapped the reader while it was draining.
+			m_dropped_records++;
+		}
+		m_read_position++;
+	}
+	
+	header->m_num_records = num_records;
+	header->m_timebase_numer = m_timebase_numer;
+	header->m_timebase_denom = m_timebase_denom;
+	header->m_reserved = 0;
+	header->m_dropped_records = m_dropped_records;
+	return sizeof(*header) + num_records * sizeof(SimpleAudioDriverIOTraceRecord);
+}
@@ -0,0 +1,63 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Headers for the recorder that captures the device's real-time I/O
+            traffic for offline replay.
+*/
+
+#ifndef SimpleAudioIORecorder_h
+#define SimpleAudioIORecorder_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "SimpleAudioDriverKeys.h"
+
+// A fixed-size ring of I/O trace records. The I/O handler, the timestamp
+// timer, and the work queue record into it without taking a lock, the same
+// way the control trace does. Unlike the control trace, it's drained: the work
+// queue is the only reader, and it keeps a read position so each record is
+// delivered once and records the writers lap before they're read are counted.
+//
+// The owner allocates the slots, kSimpleAudioDriverIOTraceCapacity of them,
+// the first time it enables recording, and keeps them until it's freed.
+class SimpleAudioIORecorder
+{
+public:
+	struct Slot
+	{
+		uint64_t							m_sequence;
+		SimpleAudioDriverIOTraceRecord		m_record;
+	};
+	
+	void		Initialize();
+	
+	// Runs on the work queue, before recording is first enabled.
+	void		SetSlots(Slot* in_slots);
+	
+	// Runs on the work queue. Enabling discards anything recorded before.
+	void		SetEnabled(bool in_enabled);
+	
+	bool		IsEnabled() const;
+	
+	// Does nothing unless recording is enabled.
+	void		Record(uint32_t in_event, uint32_t in_value, uint64_t in_sample_time, uint64_t in_host_time);
+	
+	// Runs on the work queue. Copies a header and the records written since
+	// the last drain, oldest first, and returns the number of bytes written.
+	size_t		Drain(void* out_buffer, size_t in_buffer_size);
+	
+private:
+	// Shared by every writer and the reader.
+	Slot*		m_slots;
+	uint64_t	m_write_position;
+	bool		m_enabled;
+	
+	// Owned by the work queue.
+	uint64_t	m_read_position;
+	uint64_t	m_dropped_records;
+	uint32_t	m_timebase_numer;
+	uint32_t	m_timebase_denom;
+};
+
+#endif /* SimpleAudioIORecorder_h */
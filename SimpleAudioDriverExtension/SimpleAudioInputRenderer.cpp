@@ -0,0 +1,55 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The implementation of the input renderer, which produces a segment of
+             the input stream from the data source and volume.
+*/
+
+// Self Include
+#include "SimpleAudioInputRenderer.h"
+
+// Local Includes
+#include "SimpleAudioToneGenerator.h"
+
+/// - Tag: RenderInput
+void SimpleAudioInputRenderer::Render(uint32_t in_data_source,
+									  float in_volume,
+									  double in_sample_rate,
+									  uint64_t in_sample_time,
+									  size_t in_num_frames,
+									  bool in_cheap_oscillator,
+									  const int16_t* in_output_ring,
+									  size_t in_output_ring_length,
+									  int16_t* io_input_ring,
+									  size_t in_input_ring_length,
+									  uint32_t in_num_channels)
+{
+	if (in_data_source == 0)
+	{
+		RenderLoopback(in_volume, in_sample_time, in_num_frames, in_output_ring, in_output_ring_length,
+					   io_input_ring, in_input_ring_length, in_num_channels);
+	}
+	else
+	{
+		SimpleAudioToneGenerator::Render(static_cast<double>(in_data_source), in_volume, in_sample_rate, in_sample_time, in_num_frames,
+										 in_cheap_oscillator, io_input_ring, in_input_ring_length, in_sample_time, in_num_channels);
+	}
+}
+
+void SimpleAudioInputRenderer::RenderLoopback(float in_volume,
+											  uint64_t in_sample_time,
+											  size_t in_num_frames,
+											  const int16_t* in_output_ring,
+											  size_t in_output_ring_length,
+											  int16_t* io_input_ring,
+											  size_t in_input_ring_length,
+											  uint32_t in_num_channels)
+{
+	for (size_t i = 0; i < in_num_channels * in_num_frames; i++)
+	{
+		auto input_index = (in_num_channels * in_sample_time + i) % in_input_ring_length;
+		auto output_index = (in_num_channels * in_sample_time + i) % in_output_ring_length;
+		io_input_ring[input_index] = in_volume * in_output_ring[output_index];
+	}
+}
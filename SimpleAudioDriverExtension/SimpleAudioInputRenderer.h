@@ -0,0 +1,49 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Headers for the input renderer, which produces a segment of the input
+            stream from the data source and volume.
+*/
+
+#ifndef SimpleAudioInputRenderer_h
+#define SimpleAudioInputRenderer_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The part of the device's render path that doesn't depend on DriverKit: the
+// I/O handler calls it for every segment it renders itself, and the host
+// replay tool calls it for every segment in a capture, so a replay produces
+// the samples the device did for the same controls and block times.
+//
+// Both rings are interleaved and indexed by sample time, the way the HAL lays
+// out the stream buffers.
+class SimpleAudioInputRenderer
+{
+public:
+	// Data source 0 is loopback and copies the output ring scaled by the
+	// volume. Any other data source is a tone at that frequency.
+	static void		Render(uint32_t in_data_source,
+						   float in_volume,
+						   double in_sample_rate,
+						   uint64_t in_sample_time,
+						   size_t in_num_frames,
+						   bool in_cheap_oscillator,
+						   const int16_t* in_output_ring,
+						   size_t in_output_ring_length,
+						   int16_t* io_input_ring,
+						   size_t in_input_ring_length,
+						   uint32_t in_num_channels);
+	
+	static void		RenderLoopback(float in_volume,
+								   uint64_t in_sample_time,
+								   size_t in_num_frames,
+								   const int16_t* in_output_ring,
+								   size_t in_output_ring_length,
+								   int16_t* io_input_ring,
+								   size_t in_input_ring_length,
+								   uint32_t in_num_channels);
+};
+
+#endif /* SimpleAudioInputRenderer_h */
@@ -0,0 +1,359 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The implementation of the insert chain that processes the input
+             stream after the data source.
+*/
+
+// Self Include
+#include "SimpleAudioInsertChain.h"
+
+// System Includes
+#include <math.h>
+#include <string.h>
+
+#define kDCBlockerCutoffHz 10.0
+
+// Samples convert to and from floats with the same scale both ways, so a
+// sample the chain doesn't change comes back exactly.
+#define kInt16Scale 32768.0f
+
+static inline SimpleAudioFloat4 SplatFloat4(float in_value)
+{
+	return SimpleAudioFloat4{in_value, in_value, in_value, in_value};
+}
+
+void SimpleAudioInsertChain::Initialize()
+{
+	bzero(this, sizeof(*this));
+	m_back_slot = 0;
+	m_middle_slot = 1;
+	m_front_slot = 2;
+	m_limiter_gain = 1.0f;
+}
+
+void SimpleAudioInsertChain::Prepare(uint32_t in_num_channels, double in_sample_rate)
+{
+	m_num_channels = in_num_channels;
+	m_sample_rate = in_sample_rate;
+
+	// The filter state belongs to the old rate, so have the I/O handler clear it.
+	m_state_generation++;
+	Publish();
+}
+
+bool SimpleAudioInsertChain::Configure(const SimpleAudioDriverInsertChainConfig& in_config)
+{
+	// Validate the whole configuration before touching the current one. The
+	// lanes can't hold every channel of a wide format, so only allow turning
+	// everything off.
+	auto enables_anything = in_config.m_dc_blocker_enabled != 0 || in_config.m_limiter_enabled != 0;
+	for (auto i = 0; i < kSimpleAudioDriverInsertChainMaxBands; i++)
+	{
+		enables_anything = enables_anything || in_config.m_bands[i].m_type != SimpleAudioDriverFilterType_Off;
+	}
+	if (enables_anything && m_num_channels > kSimpleAudioInsertChainMaxChannels)
+	{
+		return false;
+	}
+	
+	auto previous_config = m_config;
+	m_config = in_config;
+	Coefficients coefficients = {};
+	if (!ComputeCoefficients(coefficients))
+	{
+		m_config = previous_config;
+		return false;
+	}
+
+	Publish();
+	return true;
+}
+
+bool SimpleAudioInsertChain::IsActive() const
+{
+	return __atomic_load_n(&m_active, __ATOMIC_RELAXED);
+}
+
+bool SimpleAudioInsertChain::ComputeCoefficients(Coefficients& out_coefficients) const
+{
+	out_coefficients.m_num_channels = m_num_channels;
+	out_coefficients.m_num_bands = 0;
+	out_coefficients.m_dc_blocker_enabled = false;
+	out_coefficients.m_limiter_enabled = false;
+	out_coefficients.m_state_generation = m_state_generation;
+	if (m_sample_rate <= 0.0 || m_num_channels > kSimpleAudioInsertChainMaxChannels)
+	{
+		return true;
+	}
+	const auto nyquist = m_sample_rate / 2.0;
+
+	// Compute the biquads from the Audio EQ Cookbook formulas, normalized by a0,
+	// and compact the enabled bands to the front.
+	for (auto i = 0; i < kSimpleAudioDriverInsertChainMaxBands; i++)
+	{
+		const auto& band = m_config.m_bands[i];
+		if (band.m_type == SimpleAudioDriverFilterType_Off)
+		{
+			continue;
+		}
+		if (!(band.m_frequency > 0.0f && band.m_frequency < nyquist) || !(band.m_q > 0.0f) || !(fabsf(band.m_gain_db) <= 48.0f))
+		{
+			return false;
+		}
+
+		double a = pow(10.0, band.m_gain_db / 40.0);
+		double w0 = 2.0 * M_PI * band.m_frequency / m_sample_rate;
+		double cos_w0 = cos(w0);
+		double alpha = sin(w0) / (2.0 * band.m_q);
+		double two_sqrt_a_alpha = 2.0 * sqrt(a) * alpha;
+		double b0 = 1.0, b1 = 0.0, b2 = 0.0, a0 = 1.0, a1 = 0.0, a2 = 0.0;
+
+		switch (band.m_type)
+		{
+			case SimpleAudioDriverFilterType_Peak:
+				b0 = 1.0 + alpha * a;
+				b1 = -2.0 * cos_w0;
+				b2 = 1.0 - alpha * a;
+				a0 = 1.0 + alpha / a;
+				a1 = -2.0 * cos_w0;
+				a2 = 1.0 - alpha / a;
+				break;
+
+			case SimpleAudioDriverFilterType_LowShelf:
+				b0 = a * ((a + 1.0) - (a - 1.0) * cos_w0 + two_sqrt_a_alpha);
+				b1 = 2.0 * a * ((a - 1.0) - (a + 1.0) * cos_w0);
+				b2 = a * ((a + 1.0) - (a - 1.0) * cos_w0 - two_sqrt_a_alpha);
+				a0 = (a + 1.0) + (a - 1.0) * cos_w0 + two_sqrt_a_alpha;
+				a1 = -2.0 * ((a - 1.0) + (a + 1.0) * cos_w0);
+				a2 = (a + 1.0) + (a - 1.0) * cos_w0 - two_sqrt_a_alpha;
+				break;
+
+			case SimpleAudioDriverFilterType_HighShelf:
+				b0 = a * ((a + 1.0) + (a - 1.0) * cos_w0 + two_sqrt_a_alpha);
+				b1 = -2.0 * a * ((a - 1.0) + (a + 1.0) * cos_w0);
+				b2 = a * ((a + 1.0) + (a - 1.0) * cos_w0 - two_sqrt_a_alpha);
+				a0 = (a + 1.0) - (a - 1.0) * cos_w0 + two_sqrt_a_alpha;
+				a1 = 2.0 * ((a - 1.0) - (a + 1.0) * cos_w0);
+				a2 = (a + 1.0) - (a - 1.0) * cos_w0 - two_sqrt_a_alpha;
+				break;
+
+			case SimpleAudioDriverFilterType_LowPass:
+				b0 = (1.0 - cos_w0) / 2.0;
+				b1 = 1.0 - cos_w0;
+				b2 = (1.0 - cos_w0) / 2.0;
+				a0 = 1.0 + alpha;
+				a1 = -2.0 * cos_w0;
+				a2 = 1.0 - alpha;
+				break;
+
+			case SimpleAudioDriverFilterType_HighPass:
+				b0 = (1.0 + cos_w0) / 2.0;
+				b1 = -(1.0 + cos_w0);
+				b2 = (1.0 + cos_w0) / 2.0;
+				a0 = 1.0 + alpha;
+				a1 = -2.0 * cos_w0;
+				a2 = 1.0 - alpha;
+				break;
+
+			default:
+				return false;
+		}
+
+		auto index = out_coefficients.m_num_bands++;
+		out_coefficients.m_b0[index] = static_cast<float>(b0 / a0);
+		out_coefficients.m_b1[index] = static_cast<float>(b1 / a0);
+		out_coefficients.m_b2[index] = static_cast<float>(b2 / a0);
+		out_coefficients.m_a1[index] = static_cast<float>(a1 / a0);
+		out_coefficients.m_a2[index] = static_cast<float>(a2 / a0);
+	}
+
+	out_coefficients.m_dc_blocker_enabled = m_config.m_dc_blocker_enabled != 0;
+	out_coefficients.m_dc_blocker_pole = static_cast<float>(1.0 - (2.0 * M_PI * kDCBlockerCutoffHz / m_sample_rate));
+
+	out_coefficients.m_limiter_enabled = m_config.m_limiter_enabled != 0;
+	if (out_coefficients.m_limiter_enabled)
+	{
+		if (!(m_config.m_limiter_threshold_db <= 0.0f) || !(m_config.m_limiter_release_ms > 0.0f))
+		{
+			return false;
+		}
+		out_coefficients.m_limiter_threshold = static_cast<float>(pow(10.0, m_config.m_limiter_threshold_db / 20.0));
+		out_coefficients.m_limiter_release = static_cast<float>(1.0 - exp(-1000.0 / (m_config.m_limiter_release_ms * m_sample_rate)));
+	}
+	return true;
+}
+
+void SimpleAudioInsertChain::Publish()
+{
+	// A configuration that the new format makes invalid, such as a band above
+	// the new Nyquist frequency, leaves the chain bypassed rather than running
+	// the old coefficients with the new format.
+	auto& coefficients = m_slots[m_back_slot];
+	if (!ComputeCoefficients(coefficients))
+	{
+		coefficients.m_num_bands = 0;
+		coefficients.m_dc_blocker_enabled = false;
+		coefficients.m_limiter_enabled = false;
+	}
+
+	// Swap the filled slot into the middle, marked fresh, and take whichever
+	// slot was there as the next one to fill.
+	m_back_slot = __atomic_exchange_n(&m_middle_slot, m_back_slot | k_slot_fresh, __ATOMIC_ACQ_REL) & k_slot_mask;
+
+	bool active = coefficients.m_num_bands > 0 || coefficients.m_dc_blocker_enabled || coefficients.m_limiter_enabled;
+	__atomic_store_n(&m_active, active, __ATOMIC_RELAXED);
+}
+
+/// - Tag: ProcessInsertChain
+void SimpleAudioInsertChain::Process(int16_t* io_buffer, size_t in_buffer_length, uint64_t in_sample_time, uint32_t in_frame_size, bool in_bypass_bands)
+{
+	// Take the newest coefficients if the work queue left a fresh slot.
+	if (__atomic_load_n(&m_middle_slot, __ATOMIC_ACQUIRE) & k_slot_fresh)
+	{
+		m_front_slot = __atomic_exchange_n(&m_middle_slot, m_front_slot, __ATOMIC_ACQ_REL) & k_slot_mask;
+	}
+	const auto& coefficients = m_slots[m_front_slot];
+
+	if (coefficients.m_state_generation != m_applied_state_generation)
+	{
+		bzero(m_biquad_z1, sizeof(m_biquad_z1));
+		bzero(m_biquad_z2, sizeof(m_biquad_z2));
+		bzero(m_dc_blocker_x1, sizeof(m_dc_blocker_x1));
+		bzero(m_dc_blocker_y1, sizeof(m_dc_blocker_y1));
+		m_limiter_gain = 1.0f;
+		m_applied_state_generation = coefficients.m_state_generation;
+	}
+	
+	// Bands that were bypassed resume from silence rather than from stale state.
+	if (m_bands_bypassed && !in_bypass_bands)
+	{
+		bzero(m_biquad_z1, sizeof(m_biquad_z1));
+		bzero(m_biquad_z2, sizeof(m_biquad_z2));
+	}
+	m_bands_bypassed = in_bypass_bands;
+
+	const auto num_channels = coefficients.m_num_channels;
+	const auto num_bands = in_bypass_bands ? 0 : coefficients.m_num_bands;
+	if (num_channels == 0 || num_channels > kSimpleAudioInsertChainMaxChannels || in_buffer_length == 0 ||
+		(num_bands == 0 && !coefficients.m_dc_blocker_enabled && !coefficients.m_limiter_enabled))
+	{
+		return;
+	}
+
+	// Work through the block in chunks that fit the scratch buffer, converting
+	// the interleaved ring samples into lanes and back.
+	const auto scale_in = 1.0f / kInt16Scale;
+	auto buffer_index = (num_channels * in_sample_time) % in_buffer_length;
+	for (uint32_t offset = 0; offset < in_frame_size; offset += kSimpleAudioInsertChainChunkFrames)
+	{
+		auto num_frames = in_frame_size - offset < kSimpleAudioInsertChainChunkFrames ? in_frame_size - offset : kSimpleAudioInsertChainChunkFrames;
+		auto chunk_index = buffer_index;
+
+		bzero(m_scratch, sizeof(m_scratch[0]) * num_frames);
+		for (uint32_t frame = 0; frame < num_frames; frame++)
+		{
+			for (uint32_t channel = 0; channel < num_channels; channel++)
+			{
+				m_scratch[frame][channel / kSimpleAudioInsertChainLanes][channel % kSimpleAudioInsertChainLanes] = io_buffer[buffer_index] * scale_in;
+				if (++buffer_index == in_buffer_length)
+				{
+					buffer_index = 0;
+				}
+			}
+		}
+
+		ProcessChunk(coefficients, num_bands, num_frames);
+
+		for (uint32_t frame = 0; frame < num_frames; frame++)
+		{
+			for (uint32_t channel = 0; channel < num_channels; channel++)
+			{
+				float sample = m_scratch[frame][channel / kSimpleAudioInsertChainLanes][channel % kSimpleAudioInsertChainLanes] * kInt16Scale;
+				sample = sample > 32767.0f ? 32767.0f : (sample < -32768.0f ? -32768.0f : sample);
+				io_buffer[chunk_index] = static_cast<int16_t>(sample);
+				if (++chunk_index == in_buffer_length)
+				{
+					chunk_index = 0;
+				}
+			}
+		}
+	}
+}
+
+void SimpleAudioInsertChain::ProcessChunk(const Coefficients& in_coefficients, uint32_t in_num_bands, uint32_t in_num_frames)
+{
+	const auto num_groups = (in_coefficients.m_num_channels + kSimpleAudioInsertChainLanes - 1) / kSimpleAudioInsertChainLanes;
+
+	if (in_coefficients.m_dc_blocker_enabled)
+	{
+		const auto pole = SplatFloat4(in_coefficients.m_dc_blocker_pole);
+		for (uint32_t group = 0; group < num_groups; group++)
+		{
+			auto x1 = m_dc_blocker_x1[group];
+			auto y1 = m_dc_blocker_y1[group];
+			for (uint32_t frame = 0; frame < in_num_frames; frame++)
+			{
+				auto x = m_scratch[frame][group];
+				y1 = x - x1 + pole * y1;
+				x1 = x;
+				m_scratch[frame][group] = y1;
+			}
+			m_dc_blocker_x1[group] = x1;
+			m_dc_blocker_y1[group] = y1;
+		}
+	}
+
+	// Transposed direct form II keeps only two state values per band and lane.
+	for (uint32_t band = 0; band < in_num_bands; band++)
+	{
+		const auto b0 = SplatFloat4(in_coefficients.m_b0[band]);
+		const auto b1 = SplatFloat4(in_coefficients.m_b1[band]);
+		const auto b2 = SplatFloat4(in_coefficients.m_b2[band]);
+		const auto a1 = SplatFloat4(in_coefficients.m_a1[band]);
+		const auto a2 = SplatFloat4(in_coefficients.m_a2[band]);
+		for (uint32_t group = 0; group < num_groups; group++)
+		{
+			auto z1 = m_biquad_z1[band][group];
+			auto z2 = m_biquad_z2[band][group];
+			for (uint32_t frame = 0; frame < in_num_frames; frame++)
+			{
+				auto x = m_scratch[frame][group];
+				auto y = b0 * x + z1;
+				z1 = b1 * x - a1 * y + z2;
+				z2 = b2 * x - a2 * y;
+				m_scratch[frame][group] = y;
+			}
+			m_biquad_z1[band][group] = z1;
+			m_biquad_z2[band][group] = z2;
+		}
+	}
+
+	// The limiter links all channels to one gain, so it attacks instantly on
+	// the loudest channel and releases exponentially.
+	if (in_coefficients.m_limiter_enabled)
+	{
+		const auto threshold = in_coefficients.m_limiter_threshold;
+		const auto release = in_coefficients.m_limiter_release;
+		auto gain = m_limiter_gain;
+		for (uint32_t frame = 0; frame < in_num_frames; frame++)
+		{
+			float peak = 0.0f;
+			for (uint32_t group = 0; group < num_groups; group++)
+			{
+				for (auto lane = 0; lane < kSimpleAudioInsertChainLanes; lane++)
+				{
+					peak = fmaxf(peak, fabsf(m_scratch[frame][group][lane]));
+				}
+			}
+			float target = peak > threshold ? threshold / peak : 1.0f;
+			gain = target < gain ? target : gain + (target - gain) * release;
+			for (uint32_t group = 0; group < num_groups; group++)
+			{
+				m_scratch[frame][group] *= gain;
+			}
+		}
+		m_limiter_gain = gain;
+	}
+}
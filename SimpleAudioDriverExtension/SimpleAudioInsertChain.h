@@ -0,0 +1,103 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Headers for the insert chain that processes the input stream after
+            the data source.
+*/
+
+#ifndef SimpleAudioInsertChain_h
+#define SimpleAudioInsertChain_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "SimpleAudioDriverKeys.h"
+
+#define kSimpleAudioInsertChainMaxChannels 16
+#define kSimpleAudioInsertChainLanes 4
+#define kSimpleAudioInsertChainMaxLaneGroups (kSimpleAudioInsertChainMaxChannels / kSimpleAudioInsertChainLanes)
+#define kSimpleAudioInsertChainChunkFrames 64
+
+// Four channels of one frame, processed together. GCC-style vectors build with
+// both clang and GCC, so the host tools can benchmark the chain.
+typedef float SimpleAudioFloat4 __attribute__((vector_size(kSimpleAudioInsertChainLanes * sizeof(float))));
+
+// The insert chain runs a DC blocker, up to eight transposed direct form II
+// biquads, and a linked peak limiter over the input ring. Channels are packed
+// into vector lanes so each biquad processes four channels per instruction.
+// A format with more channels than the lanes hold bypasses the chain.
+//
+// Configure and Prepare run on the work queue. They compute coefficients into
+// a private slot of a triple buffer and publish it with an atomic exchange, so
+// Process, which runs in the I/O handler, never waits on a lock and never sees
+// a half-written set of coefficients.
+class SimpleAudioInsertChain
+{
+public:
+	void		Initialize();
+
+	void		Prepare(uint32_t in_num_channels, double in_sample_rate);
+
+	bool		Configure(const SimpleAudioDriverInsertChainConfig& in_config);
+
+	// True if Process would change the samples.
+	bool		IsActive() const;
+
+	// When the I/O handler is short of time it can bypass the parametric bands
+	// and keep only the DC blocker and the limiter.
+	void		Process(int16_t* io_buffer, size_t in_buffer_length, uint64_t in_sample_time, uint32_t in_frame_size, bool in_bypass_bands);
+
+private:
+	struct Coefficients
+	{
+		uint32_t	m_num_channels;
+		uint32_t	m_num_bands;
+		float		m_b0[kSimpleAudioDriverInsertChainMaxBands];
+		float		m_b1[kSimpleAudioDriverInsertChainMaxBands];
+		float		m_b2[kSimpleAudioDriverInsertChainMaxBands];
+		float		m_a1[kSimpleAudioDriverInsertChainMaxBands];
+		float		m_a2[kSimpleAudioDriverInsertChainMaxBands];
+		bool		m_dc_blocker_enabled;
+		float		m_dc_blocker_pole;
+		bool		m_limiter_enabled;
+		float		m_limiter_threshold;
+		float		m_limiter_release;
+		uint32_t	m_state_generation;
+	};
+
+	bool		ComputeCoefficients(Coefficients& out_coefficients) const;
+
+	void		Publish();
+
+	void		ProcessChunk(const Coefficients& in_coefficients, uint32_t in_num_bands, uint32_t in_num_frames);
+
+	// The slot index in the low bits, and a flag that the writer sets when it
+	// leaves a new slot in the middle position for the reader.
+	static constexpr uint32_t	k_slot_mask = 0x3;
+	static constexpr uint32_t	k_slot_fresh = 0x4;
+
+	// Owned by the work queue.
+	SimpleAudioDriverInsertChainConfig	m_config;
+	uint32_t							m_num_channels;
+	double								m_sample_rate;
+	uint32_t							m_back_slot;
+	uint32_t							m_state_generation;
+
+	// Shared between the work queue and the I/O handler.
+	Coefficients						m_slots[3];
+	uint32_t							m_middle_slot;
+	bool								m_active;
+
+	// Owned by the I/O handler.
+	uint32_t							m_front_slot;
+	uint32_t							m_applied_state_generation;
+	bool								m_bands_bypassed;
+	SimpleAudioFloat4					m_biquad_z1[kSimpleAudioDriverInsertChainMaxBands][kSimpleAudioInsertChainMaxLaneGroups];
+	SimpleAudioFloat4					m_biquad_z2[kSimpleAudioDriverInsertChainMaxBands][kSimpleAudioInsertChainMaxLaneGroups];
+	SimpleAudioFloat4					m_dc_blocker_x1[kSimpleAudioInsertChainMaxLaneGroups];
+	SimpleAudioFloat4					m_dc_blocker_y1[kSimpleAudioInsertChainMaxLaneGroups];
+	float								m_limiter_gain;
+	SimpleAudioFloat4					m_scratch[kSimpleAudioInsertChainChunkFrames][kSimpleAudioInsertChainMaxLaneGroups];
+};
+
+#endif /* SimpleAudioInsertChain_h */
@@ -0,0 +1,172 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The implementation of the store that indexes the custom property's
+             qualifier and value pairs.
+*/
+
+// Self Include
+#include "SimpleAudioPropertyStore.h"
+
+// System Includes
+#include <DriverKit/DriverKit.h>
+#include <string.h>
+
+void SimpleAudioPropertyStore::Initialize()
+{
+	bzero(this, sizeof(*this));
+	m_serialized_size = sizeof(SimpleAudioDriverCustomPropertySnapshotHeader);
+}
+
+void SimpleAudioPropertyStore::Free()
+{
+	for (uint32_t chunk = 0; chunk < m_num_chunks; chunk++)
+	{
+		IOSafeDeleteNULL(m_chunks[chunk], Entry, kSimpleAudioPropertyStoreChunkEntries);
+	}
+	__atomic_store_n(&m_num_chunks, 0, __ATOMIC_RELAXED);
+	m_count = 0;
+}
+
+SimpleAudioPropertyStore::Entry& SimpleAudioPropertyStore::GetEntry(uint32_t in_index) const
+{
+	return m_chunks[in_index / kSimpleAudioPropertyStoreChunkEntries][in_index % kSimpleAudioPropertyStoreChunkEntries];
+}
+
+uint32_t SimpleAudioPropertyStore::Hash(const char* in_string, size_t in_length)
+{
+	// FNV-1a.
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < in_length; i++)
+	{
+		hash ^= static_cast<uint8_t>(in_string[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+uint32_t SimpleAudioPropertyStore::FindSlot(const char* in_qualifier, size_t in_length, uint32_t in_hash) const
+{
+	// The table is at most half full, so there's always an empty slot to stop at.
+	auto slot = in_hash & (kSimpleAudioPropertyStoreTableSize - 1);
+	while (m_slots[slot] != 0)
+	{
+		const auto& entry = GetEntry(m_slots[slot] - 1);
+		if (entry.m_hash == in_hash && entry.m_qualifier_length == in_length && memcmp(entry.m_qualifier, in_qualifier, in_length) == 0)
+		{
+			break;
+		}
+		slot = (slot + 1) & (kSimpleAudioPropertyStoreTableSize - 1);
+	}
+	return slot;
+}
+
+/// - Tag: SetCustomPropertyValue
+bool SimpleAudioPropertyStore::Set(const char* in_qualifier, const char* in_value)
+{
+	if (in_qualifier == nullptr || in_value == nullptr)
+	{
+		return false;
+	}
+	auto qualifier_length = strnlen(in_qualifier, kSimpleAudioDriverCustomPropertyQualifierLength);
+	auto value_length = strnlen(in_value, kSimpleAudioDriverCustomPropertyValueLength);
+	if (qualifier_length == 0 ||
+		qualifier_length == kSimpleAudioDriverCustomPropertyQualifierLength ||
+		value_length == kSimpleAudioDriverCustomPropertyValueLength)
+	{
+		return false;
+	}
+
+	auto hash = Hash(in_qualifier, qualifier_length);
+	auto slot = FindSlot(in_qualifier, qualifier_length, hash);
+	Entry* entry = nullptr;
+	if (m_slots[slot] != 0)
+	{
+		entry = &GetEntry(m_slots[slot] - 1);
+		m_serialized_size -= entry->m_value_length;
+	}
+	else
+	{
+		if (m_count == kSimpleAudioDriverCustomPropertyCapacity)
+		{
+			return false;
+		}
+		// Allocate the next chunk once the last one is full.
+		if (m_count == m_num_chunks * kSimpleAudioPropertyStoreChunkEntries)
+		{
+			m_chunks[m_num_chunks] = IONewZero(Entry, kSimpleAudioPropertyStoreChunkEntries);
+			if (m_chunks[m_num_chunks] == nullptr)
+			{
+				return false;
+			}
+			__atomic_store_n(&m_num_chunks, m_num_chunks + 1, __ATOMIC_RELAXED);
+		}
+		entry = &GetEntry(m_count);
+		entry->m_hash = hash;
+		entry->m_qualifier_length = static_cast<uint16_t>(qualifier_length);
+		memcpy(entry->m_qualifier, in_qualifier, qualifier_length);
+		entry->m_qualifier[qualifier_length] = '\0';
+		m_slots[slot] = static_cast<uint16_t>(++m_count);
+		m_serialized_size += sizeof(SimpleAudioDriverCustomPropertyRecord) + qualifier_length;
+	}
+
+	entry->m_value_length = static_cast<uint16_t>(value_length);
+	memcpy(entry->m_value, in_value, value_length);
+	entry->m_value[value_length] = '\0';
+	m_serialized_size += value_length;
+	return true;
+}
+
+const char* SimpleAudioPropertyStore::Find(const char* in_qualifier) const
+{
+	if (in_qualifier == nullptr)
+	{
+		return nullptr;
+	}
+	auto qualifier_length = strnlen(in_qualifier, kSimpleAudioDriverCustomPropertyQualifierLength);
+	auto slot = FindSlot(in_qualifier, qualifier_length, Hash(in_qualifier, qualifier_length));
+	return m_slots[slot] != 0 ? GetEntry(m_slots[slot] - 1).m_value : nullptr;
+}
+
+uint32_t SimpleAudioPropertyStore::GetCount() const
+{
+	return m_count;
+}
+
+size_t SimpleAudioPropertyStore::GetSerializedSize() const
+{
+	return m_serialized_size;
+}
+
+/// - Tag: SerializeCustomProperties
+size_t SimpleAudioPropertyStore::Serialize(void* out_buffer, size_t in_buffer_size) const
+{
+	if (out_buffer == nullptr || in_buffer_size < m_serialized_size)
+	{
+		return 0;
+	}
+
+	auto bytes = static_cast<uint8_t*>(out_buffer);
+	SimpleAudioDriverCustomPropertySnapshotHeader header = {};
+	header.m_num_entries = m_count;
+	memcpy(bytes, &header, sizeof(header));
+	size_t offset = sizeof(header);
+	for (uint32_t index = 0; index < m_count; index++)
+	{
+		const auto& entry = GetEntry(index);
+		SimpleAudioDriverCustomPropertyRecord record = { entry.m_qualifier_length, entry.m_value_length };
+		memcpy(bytes + offset, &record, sizeof(record));
+		offset += sizeof(record);
+		memcpy(bytes + offset, entry.m_qualifier, entry.m_qualifier_length);
+		offset += entry.m_qualifier_length;
+		memcpy(bytes + offset, entry.m_value, entry.m_value_length);
+		offset += entry.m_value_length;
+	}
+	return offset;
+}
+
+size_t SimpleAudioPropertyStore::GetAllocatedBytes() const
+{
+	return __atomic_load_n(&m_num_chunks, __ATOMIC_RELAXED) * kSimpleAudioPropertyStoreChunkEntries * sizeof(Entry);
+}
@@ -0,0 +1,82 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Headers for the store that indexes the custom property's qualifier and
+            value pairs.
+*/
+
+#ifndef SimpleAudioPropertyStore_h
+#define SimpleAudioPropertyStore_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "SimpleAudioDriverKeys.h"
+
+#define kSimpleAudioPropertyStoreTableSize (2 * kSimpleAudioDriverCustomPropertyCapacity) // Must be a power of two.
+#define kSimpleAudioPropertyStoreChunkEntries 64 // Must divide the capacity.
+
+// An open-addressed hash table of qualifier and value pairs, with linear
+// probing. The table never holds more than half its size, so a lookup or an
+// update touches only a slot or two. Pairs are never removed, and the store
+// keeps the order they were first set in, so Serialize walks the pairs
+// directly instead of scanning the table. The pairs are allocated a chunk at
+// a time as they're added, so a store with a few pairs stays small.
+//
+// The store has no locks; the device only uses it on the work queue.
+class SimpleAudioPropertyStore
+{
+public:
+	void			Initialize();
+	
+	// Frees the pairs. Initialize the store again before using it.
+	void			Free();
+
+	// Adds the pair, or replaces the value if the qualifier is already in the
+	// store. Fails if either string is too long, the store is full, or the
+	// pair's chunk can't be allocated.
+	bool			Set(const char* in_qualifier, const char* in_value);
+
+	// Returns the value, or null if the qualifier isn't in the store.
+	const char*		Find(const char* in_qualifier) const;
+
+	uint32_t		GetCount() const;
+
+	// The number of bytes Serialize writes.
+	size_t			GetSerializedSize() const;
+
+	// Writes the snapshot described in SimpleAudioDriverKeys.h, and returns
+	// the number of bytes written, or 0 if the buffer is too small.
+	size_t			Serialize(void* out_buffer, size_t in_buffer_size) const;
+	
+	// The bytes allocated for pairs. This is read atomically, so any queue
+	// may call it.
+	size_t			GetAllocatedBytes() const;
+
+private:
+	struct Entry
+	{
+		uint32_t	m_hash;
+		uint16_t	m_qualifier_length;
+		uint16_t	m_value_length;
+		char		m_qualifier[kSimpleAudioDriverCustomPropertyQualifierLength];
+		char		m_value[kSimpleAudioDriverCustomPropertyValueLength];
+	};
+
+	static uint32_t	Hash(const char* in_string, size_t in_length);
+	
+	Entry&			GetEntry(uint32_t in_index) const;
+
+	// Returns the slot index of the qualifier, or of the empty slot where it
+	// would go.
+	uint32_t		FindSlot(const char* in_qualifier, size_t in_length, uint32_t in_hash) const;
+
+	// Each slot holds an entry index plus one, or 0 when empty.
+	uint16_t		m_slots[kSimpleAudioPropertyStoreTableSize];
+	Entry*			m_chunks[kSimpleAudioDriverCustomPropertyCapacity / kSimpleAudioPropertyStoreChunkEntries];
+	uint32_t		m_num_chunks;
+	uint32_t		m_count;
+	size_t			m_serialized_size;
+};
+
+#endif /* SimpleAudioPropertyStore_h */
@@ -0,0 +1,240 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The implementation of the render-ahead producer.
+*/
+
+// Self Include
+#include "SimpleAudioRenderAhead.h"
+
+// Local Includes
+#include "SimpleAudioToneGenerator.h"
+
+// System Includes
+#include <string.h>
+
+#define kRenderAheadGenerationShift 48
+#define kRenderAheadPositionMask ((1ULL << kRenderAheadGenerationShift) - 1)
+
+void SimpleAudioRenderAhead::Initialize()
+{
+	memset(this, 0, sizeof(*this));
+	m_min_lead_frames = INT64_MAX;
+}
+
+void SimpleAudioRenderAhead::SetStaging(int16_t* in_staging, uint32_t in_staging_frames, uint32_t in_num_channels)
+{
+	// The producer and the I/O handler only look at the staging ring while
+	// render-ahead is on, so it's set before the first enable.
+	m_staging = in_staging;
+	m_staging_frames = in_staging_frames;
+	m_num_channels = in_num_channels;
+}
+
+bool SimpleAudioRenderAhead::HasStaging() const
+{
+	return m_staging != nullptr;
+}
+
+bool SimpleAudioRenderAhead::SetEnabled(bool in_enabled, uint32_t in_margin_frames)
+{
+	if (in_enabled)
+	{
+		if (m_staging == nullptr || in_margin_frames == 0 || in_margin_frames >= m_staging_frames)
+		{
+			return false;
+		}
+		__atomic_store_n(&m_margin_frames, in_margin_frames, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&m_enabled, in_enabled, __ATOMIC_RELEASE);
+	Invalidate();
+	return true;
+}
+
+void SimpleAudioRenderAhead::SetSampleRate(double in_sample_rate)
+{
+	__atomic_store(&m_sample_rate, &in_sample_rate, __ATOMIC_RELAXED);
+	Invalidate();
+}
+
+void SimpleAudioRenderAhead::SetControls(uint32_t in_data_source, float in_volume)
+{
+	// Store the snapshot before bumping the generation, so a producer that
+	// rendered with the old snapshot can't publish after this returns.
+	auto controls = PackControls(in_data_source, in_volume);
+	if (__atomic_exchange_n(&m_controls, controls, __ATOMIC_RELEASE) != controls)
+	{
+		Invalidate();
+	}
+}
+
+void SimpleAudioRenderAhead::Reset()
+{
+	Invalidate();
+	__atomic_store_n(&m_read_position, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&m_hits, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&m_misses, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&m_lead_frames, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&m_min_lead_frames, INT64_MAX, __ATOMIC_RELAXED);
+}
+
+void SimpleAudioRenderAhead::Invalidate()
+{
+	auto state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+	uint64_t new_state = 0;
+	do
+	{
+		new_state = ((state >> kRenderAheadGenerationShift) + 1) << kRenderAheadGenerationShift;
+	}
+	while (!__atomic_compare_exchange_n(&m_state, &state, new_state, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void SimpleAudioRenderAhead::GetStatistics(SimpleAudioDriverDeviceStatistics* out_statistics) const
+{
+	out_statistics->m_render_ahead_hits = __atomic_load_n(&m_hits, __ATOMIC_RELAXED);
+	out_statistics->m_render_ahead_misses = __atomic_load_n(&m_misses, __ATOMIC_RELAXED);
+	out_statistics->m_render_ahead_lead_frames = __atomic_load_n(&m_lead_frames, __ATOMIC_RELAXED);
+	out_statistics->m_render_ahead_min_lead_frames = __atomic_load_n(&m_min_lead_frames, __ATOMIC_RELAXED);
+}
+
+/// - Tag: RenderAhead
+void SimpleAudioRenderAhead::Render()
+{
+	if (!__atomic_load_n(&m_enabled, __ATOMIC_ACQUIRE))
+	{
+		return;
+	}
+	
+	// Load the state before the snapshot, so a snapshot that changes after
+	// this point also makes the publish below fail.
+	auto state = __atomic_load_n(&m_state, __ATOMIC_ACQUIRE);
+	auto controls = __atomic_load_n(&m_controls, __ATOMIC_ACQUIRE);
+	auto data_source = static_cast<uint32_t>(controls >> 32);
+	if (data_source == 0)
+	{
+		// Loopback depends on output the host hasn't written yet.
+		return;
+	}
+	
+	// A region belongs to one snapshot. A new generation starts a new region.
+	auto rendered_until = state & kRenderAheadPositionMask;
+	if (rendered_until == 0)
+	{
+		__atomic_store_n(&m_region_controls, controls, __ATOMIC_RELAXED);
+	}
+	else if (__atomic_load_n(&m_region_controls, __ATOMIC_RELAXED) != controls)
+	{
+		return;
+	}
+	
+	auto read_position = __atomic_load_n(&m_read_position, __ATOMIC_ACQUIRE);
+	auto render_start = rendered_until > read_position ? rendered_until : read_position;
+	auto render_end = read_position + __atomic_load_n(&m_margin_frames, __ATOMIC_RELAXED);
+	if (render_start >= render_end)
+	{
+		return;
+	}
+	
+	uint32_t volume_bits = static_cast<uint32_t>(controls);
+	float volume = 0.0f;
+	memcpy(&volume, &volume_bits, sizeof(volume));
+	double sample_rate = 0.0;
+	__atomic_load(&m_sample_rate, &sample_rate, __ATOMIC_RELAXED);
+	
+	// Only this queue writes the staging ring, and only past the published
+	// region, which the I/O handler is the only one to read.
+	SimpleAudioToneGenerator::Render(static_cast<double>(data_source), volume, sample_rate, render_start, render_end - render_start, false,
+									 m_staging, static_cast<size_t>(m_staging_frames) * m_num_channels, render_start, m_num_channels);
+	
+	// Publish the new region. If anything invalidated the state meanwhile,
+	// drop it; the I/O handler renders those blocks itself.
+	auto new_state = (state & ~kRenderAheadPositionMask) | render_end;
+	__atomic_compare_exchange_n(&m_state, &state, new_state, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+bool SimpleAudioRenderAhead::TakeControlsRequest()
+{
+	if (!__atomic_load_n(&m_controls_requested, __ATOMIC_RELAXED))
+	{
+		return false;
+	}
+	return __atomic_exchange_n(&m_controls_requested, false, __ATOMIC_ACQUIRE);
+}
+
+/// - Tag: ConsumeRenderedInput
+bool SimpleAudioRenderAhead::Consume(uint32_t in_data_source,
+									 float in_volume,
+									 uint64_t in_sample_time,
+									 uint32_t in_frame_size,
+									 int16_t* io_ring,
+									 size_t in_ring_length)
+{
+	// This runs in the I/O handler, so it only checks, counts, and copies.
+	if (!__atomic_load_n(&m_enabled, __ATOMIC_ACQUIRE))
+	{
+		return false;
+	}
+	
+	auto block_end = in_sample_time + in_frame_size;
+	__atomic_store_n(&m_read_position, block_end, __ATOMIC_RELEASE);
+	
+	// A control change the snapshot doesn't have yet, including one the HAL
+	// made directly, needs the work queue to take a new snapshot.
+	auto controls = PackControls(in_data_source, in_volume);
+	if (controls != __atomic_load_n(&m_controls, __ATOMIC_ACQUIRE))
+	{
+		__atomic_store_n(&m_controls_requested, true, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&m_misses, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+	
+	// A new generation has no region yet, which says nothing about the lead.
+	auto state = __atomic_load_n(&m_state, __ATOMIC_ACQUIRE);
+	if ((state & kRenderAheadPositionMask) == 0)
+	{
+		__atomic_add_fetch(&m_misses, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+	auto lead = static_cast<int64_t>(state & kRenderAheadPositionMask) - static_cast<int64_t>(block_end);
+	__atomic_store_n(&m_lead_frames, lead, __ATOMIC_RELAXED);
+	if (lead < __atomic_load_n(&m_min_lead_frames, __ATOMIC_RELAXED))
+	{
+		__atomic_store_n(&m_min_lead_frames, lead, __ATOMIC_RELAXED);
+	}
+	
+	// The producer may be writing past the region up to one margin ahead of the
+	// read position, so the block and the margin must not wrap onto each other.
+	if (lead < 0 || __atomic_load_n(&m_region_controls, __ATOMIC_RELAXED) != controls ||
+		in_frame_size + __atomic_load_n(&m_margin_frames, __ATOMIC_RELAXED) > m_staging_frames)
+	{
+		__atomic_add_fetch(&m_misses, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+	
+	size_t staging_length = static_cast<size_t>(m_staging_frames) * m_num_channels;
+	uint64_t first_sample = in_sample_time * m_num_channels;
+	for (size_t i = 0; i < static_cast<size_t>(in_frame_size) * m_num_channels; i++)
+	{
+		io_ring[(first_sample + i) % in_ring_length] = m_staging[(first_sample + i) % staging_length];
+	}
+	
+	// If the region was invalidated while copying, the producer may have
+	// started a new one over these frames, so render the block instead.
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if ((__atomic_load_n(&m_state, __ATOMIC_RELAXED) >> kRenderAheadGenerationShift) != (state >> kRenderAheadGenerationShift))
+	{
+		__atomic_add_fetch(&m_misses, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+	
+	__atomic_add_fetch(&m_hits, 1, __ATOMIC_RELAXED);
+	return true;
+}
+
+uint64_t SimpleAudioRenderAhead::PackControls(uint32_t in_data_source, float in_volume)
+{
+	uint32_t volume_bits = 0;
+	memcpy(&volume_bits, &in_volume, sizeof(volume_bits));
+	return (static_cast<uint64_t>(in_data_source) << 32) | volume_bits;
+}
@@ -0,0 +1,94 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Headers for the render-ahead producer, which synthesizes generated input
+            ahead of the HAL into a private staging ring.
+*/
+
+#ifndef SimpleAudioRenderAhead_h
+#define SimpleAudioRenderAhead_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "SimpleAudioDriverKeys.h"
+
+// The producer renders into a staging ring that only it writes, indexed by
+// sample time, and publishes how far it got. The I/O handler copies a block
+// out of the staging ring into the input ring when the published region
+// covers it, so the input ring only ever has one writer.
+//
+// The published state packs a generation count above the end of the region.
+// Anything that makes the region stale bumps the generation, which makes the
+// producer's next publish fail and lets the I/O handler detect a region that
+// changed while it was copying.
+//
+// The producer renders with control values the work queue snapshots, never
+// with the controls themselves. When the I/O handler sees values the snapshot
+// doesn't have yet, such as a change the HAL made directly, it asks for a new
+// snapshot and renders the block itself.
+class SimpleAudioRenderAhead
+{
+public:
+	void		Initialize();
+	
+	// The rest of the configuration runs on the work queue. The staging ring
+	// holds in_staging_frames frames and must outlive the producer.
+	void		SetStaging(int16_t* in_staging, uint32_t in_staging_frames, uint32_t in_num_channels);
+	
+	bool		HasStaging() const;
+	
+	// The margin plus the largest I/O block has to fit in the staging ring.
+	bool		SetEnabled(bool in_enabled, uint32_t in_margin_frames);
+	
+	void		SetSampleRate(double in_sample_rate);
+	
+	void		SetControls(uint32_t in_data_source, float in_volume);
+	
+	// Sample times restart from zero, so drop the region and the statistics.
+	void		Reset();
+	
+	void		Invalidate();
+	
+	void		GetStatistics(SimpleAudioDriverDeviceStatistics* out_statistics) const;
+	
+	// Runs on the render queue.
+	void		Render();
+	
+	// Runs on the render queue. Returns true once after the I/O handler asked
+	// for a new snapshot of the controls.
+	bool		TakeControlsRequest();
+	
+	// Runs in the I/O handler. Copies the block into the input ring and
+	// returns true if the producer already rendered it with these values.
+	bool		Consume(uint32_t in_data_source,
+						float in_volume,
+						uint64_t in_sample_time,
+						uint32_t in_frame_size,
+						int16_t* io_ring,
+						size_t in_ring_length);
+	
+private:
+	static uint64_t	PackControls(uint32_t in_data_source, float in_volume);
+	
+	int16_t*	m_staging;
+	uint32_t	m_staging_frames;
+	uint32_t	m_num_channels;
+	double		m_sample_rate;
+	
+	bool		m_enabled;
+	uint32_t	m_margin_frames;
+	uint64_t	m_controls; // The work queue's snapshot, data source above the volume's bits.
+	bool		m_controls_requested;
+	
+	uint64_t	m_state;
+	uint64_t	m_region_controls; // The snapshot the current generation's region was rendered with.
+	uint64_t	m_read_position;
+	
+	uint64_t	m_hits;
+	uint64_t	m_misses;
+	int64_t		m_lead_frames;
+	int64_t		m_min_lead_frames;
+};
+
+#endif /* SimpleAudioRenderAhead_h */
@@ -0,0 +1,60 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The implementation of the governor that picks the quality tier the I/O
+             handler renders at from the load of recent blocks.
+*/
+
+// Self Include
+#include "SimpleAudioRenderQuality.h"
+
+// System Includes
+#include <string.h>
+
+void SimpleAudioRenderQuality::Initialize()
+{
+	memset(this, 0, sizeof(*this));
+	m_tier = SimpleAudioDriverQualityTier_Full;
+}
+
+/// - Tag: UpdateRenderQualityTier
+bool SimpleAudioRenderQuality::Update(float in_load)
+{
+	m_load += kRenderLoadSmoothing * (in_load - m_load);
+	
+	auto tier = m_tier;
+	if (m_settle_blocks > 0)
+	{
+		m_settle_blocks--;
+	}
+	m_recover_blocks = m_load < kQualityStepUpLoad ? m_recover_blocks + 1 : 0;
+	
+	if (m_load > kQualityStepDownLoad && tier < SimpleAudioDriverQualityTier_CheapOscillator && m_settle_blocks == 0)
+	{
+		tier++;
+	}
+	else if (tier > SimpleAudioDriverQualityTier_Full && m_recover_blocks >= kQualityRecoverBlocks)
+	{
+		tier--;
+	}
+	
+	if (tier == m_tier)
+	{
+		return false;
+	}
+	m_tier = tier;
+	m_settle_blocks = kQualitySettleBlocks;
+	m_recover_blocks = 0;
+	return true;
+}
+
+uint32_t SimpleAudioRenderQuality::GetTier() const
+{
+	return m_tier;
+}
+
+float SimpleAudioRenderQuality::GetLoad() const
+{
+	return m_load;
+}
@@ -0,0 +1,49 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Headers for the governor that picks the quality tier the I/O handler
+            renders at from the load of recent blocks.
+*/
+
+#ifndef SimpleAudioRenderQuality_h
+#define SimpleAudioRenderQuality_h
+
+#include <stdint.h>
+#include "SimpleAudioDriverKeys.h"
+
+// The governor smooths its load over roughly eight blocks. It steps down a
+// quality tier when the smoothed load passes the upper threshold, waiting a few
+// blocks between steps so the average can catch up, and steps back up only
+// after the load has stayed under the lower threshold for a few seconds.
+#define kRenderLoadSmoothing 0.125f
+#define kQualityStepDownLoad 0.6f
+#define kQualityStepUpLoad 0.3f
+#define kQualitySettleBlocks 8
+#define kQualityRecoverBlocks 256
+
+// Only the I/O handler uses the governor, so it needs no synchronization. It
+// has no DriverKit dependencies, so the host tools can drive it with a
+// simulated load.
+class SimpleAudioRenderQuality
+{
+public:
+	// Starts at full quality with no load.
+	void		Initialize();
+	
+	// Takes the share of its budget the last block used, and returns true
+	// when the tier for the next block changed.
+	bool		Update(float in_load);
+	
+	uint32_t	GetTier() const;
+	
+	float		GetLoad() const;
+	
+private:
+	uint32_t	m_tier;
+	float		m_load;
+	uint32_t	m_settle_blocks;
+	uint32_t	m_recover_blocks;
+};
+
+#endif /* SimpleAudioRenderQuality_h */
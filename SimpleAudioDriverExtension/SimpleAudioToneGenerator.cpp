@@ -0,0 +1,81 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The implementation of the tone generator behind the input stream's
+             data sources.
+*/
+
+// Self Include
+#include "SimpleAudioToneGenerator.h"
+
+// System Includes
+#include <math.h>
+
+int16_t SimpleAudioToneGenerator::FloatToInt16(float in_sample)
+{
+	if (in_sample > 1.0f)
+	{
+		in_sample = 1.0f;
+	}
+	else if (in_sample < -1.0f)
+	{
+		in_sample = -1.0f;
+	}
+	return static_cast<int16_t>(in_sample * 0x7fff);
+}
+
+/// - Tag: RenderTone
+void SimpleAudioToneGenerator::Render(double in_tone_freq,
+									  float in_volume,
+									  double in_sample_rate,
+									  uint64_t in_sample_time,
+									  size_t in_num_frames,
+									  bool in_cheap_oscillator,
+									  int16_t* io_ring,
+									  size_t in_ring_length,
+									  uint64_t in_ring_frame,
+									  uint32_t in_num_channels)
+{
+	if (in_ring_length == 0 || in_num_channels == 0)
+	{
+		return;
+	}
+
+	double phase_step = 2.0 * M_PI * in_tone_freq / in_sample_rate;
+	double phasor_sin = 0.0;
+	double phasor_cos = 0.0;
+	double step_sin = 0.0;
+	double step_cos = 0.0;
+	if (in_cheap_oscillator)
+	{
+		double phase = 2.0 * M_PI * in_tone_freq * static_cast<double>(in_sample_time) / in_sample_rate;
+		phasor_sin = sin(phase);
+		phasor_cos = cos(phase);
+		step_sin = sin(phase_step);
+		step_cos = cos(phase_step);
+	}
+
+	for (size_t i = 0; i < in_num_frames; i++)
+	{
+		double tone_value = 0.0;
+		if (in_cheap_oscillator)
+		{
+			tone_value = phasor_sin;
+			double next_sin = phasor_sin * step_cos + phasor_cos * step_sin;
+			phasor_cos = phasor_cos * step_cos - phasor_sin * step_sin;
+			phasor_sin = next_sin;
+		}
+		else
+		{
+			tone_value = sin(2.0 * M_PI * in_tone_freq * static_cast<double>(in_sample_time + i) / in_sample_rate);
+		}
+		float float_value = in_volume * tone_value;
+		int16_t integer_value = FloatToInt16(float_value);
+		for (uint32_t channel_index = 0; channel_index < in_num_channels; channel_index++)
+		{
+			auto ring_index = (in_num_channels * (in_ring_frame + i) + channel_index) % in_ring_length;
+			io_ring[ring_index] = integer_value;
+		}
+	}
+}
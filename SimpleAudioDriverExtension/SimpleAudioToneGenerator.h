@@ -0,0 +1,42 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Headers for the tone generator behind the input stream's data sources.
+*/
+
+#ifndef SimpleAudioToneGenerator_h
+#define SimpleAudioToneGenerator_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The generator has no DriverKit dependencies, so the app can run it offline
+// and get exactly the samples the device produces.
+//
+// Every sample is derived from its sample time rather than from a running
+// counter, so any block can be rendered on its own. The cheap oscillator takes
+// the phase from the sample time only at the start of the block, then rotates
+// a phasor, so two renders with it agree only if they start blocks at the same
+// sample times.
+class SimpleAudioToneGenerator
+{
+public:
+	static int16_t	FloatToInt16(float in_sample);
+
+	// Writes in_num_frames frames starting at in_sample_time into an
+	// interleaved ring, at the ring position of frame in_ring_frame, with the
+	// same value in every channel.
+	static void		Render(double in_tone_freq,
+						   float in_volume,
+						   double in_sample_rate,
+						   uint64_t in_sample_time,
+						   size_t in_num_frames,
+						   bool in_cheap_oscillator,
+						   int16_t* io_ring,
+						   size_t in_ring_length,
+						   uint64_t in_ring_frame,
+						   uint32_t in_num_channels);
+};
+
+#endif /* SimpleAudioToneGenerator_h */